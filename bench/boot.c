@@ -0,0 +1,240 @@
+// end-to-end benchmark of booting a service tree generated by 'gen'
+// usage: boot -r <root> [-R rounds] [-x] [-t target [-b] [-d]]
+//
+// each round goes through the same steps as init does, and times each of them:
+//  - "discover": reading and parsing all the services in '<root>/etc/init/services' and '<root>/etc/rc.d'
+//  - "resolve": building the dependency graph
+//  - "circular": checking it for cycles
+//  - "reduce": removing redundant dependencies
+//  - "select": setting up the scheduler and selecting the services to start
+//  - "run": actually starting all the services and waiting for them to complete (only with '-x', as this isn't free)
+//
+// with '-t', it also times how long into the run the target service completed ("target"), and with '-b', the services holding it up are boosted as init would (cf. 'sched_boost')
+// e.g. on a tree generated with 'gen -s login -w cpu', running this with and without '-b' shows how much boosting gets a login prompt up sooner under contention
+// with '-d', every service is flagged as deferred, so that only what the target depends on runs before it (cf. 'sched_defer'), and the rest runs after it at low priority
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "discover.h"
+#include "sched.h"
+
+#define MAX_ROUNDS 1024
+
+typedef enum {
+	PHASE_DISCOVER,
+	PHASE_RESOLVE,
+	PHASE_CIRCULAR,
+	PHASE_SELECT,
+	PHASE_REDUCE,
+	PHASE_RUN,
+	PHASE_TARGET, // not a phase of its own, but part of the run
+	PHASE_COUNT,
+} phase_t;
+
+static char const* phase_names[PHASE_COUNT] = {
+	[PHASE_DISCOVER] = "discover",
+	[PHASE_RESOLVE]  = "resolve",
+	[PHASE_CIRCULAR] = "circular",
+	[PHASE_SELECT]   = "select",
+	[PHASE_REDUCE]   = "reduce",
+	[PHASE_RUN]      = "run",
+	[PHASE_TARGET]   = "target",
+};
+
+static long double times[PHASE_COUNT][MAX_ROUNDS];
+
+static int cmp_time(void const* _a, void const* _b) {
+	long double a = *(long double const*) _a;
+	long double b = *(long double const*) _b;
+
+	return (a > b) - (a < b);
+}
+
+static size_t round_(char const* root, size_t round, bool execute, char const* target_name, bool boost, bool defer) {
+	char aquabsd_dir[4096];
+	char research_dir[4096];
+	char rc_subr[4096];
+
+	snprintf(aquabsd_dir, sizeof aquabsd_dir, "%s/etc/init/services", root);
+	snprintf(research_dir, sizeof research_dir, "%s/etc/rc.d", root);
+	snprintf(rc_subr, sizeof rc_subr, "%s/etc/rc.subr", root);
+
+	graph_t graph;
+	arena_t arena;
+	sched_t sched;
+
+	long double start = bench_time();
+
+	arena_init(&arena, 64 * 1024);
+	graph_init(&graph, &arena);
+
+	if (discover_aquabsd(&graph, &arena, aquabsd_dir) < 0 || discover_research(&graph, &arena, research_dir) < 0) {
+		fprintf(stderr, "Couldn't open service directories in %s\n", root);
+		exit(EXIT_FAILURE);
+	}
+
+	long double now = bench_time();
+	times[PHASE_DISCOVER][round] = now - start;
+	start = now;
+
+	graph_resolve(&graph);
+	arena_free(&arena);
+
+	now = bench_time();
+	times[PHASE_RESOLVE][round] = now - start;
+	start = now;
+
+	if (graph_check_circular(&graph)) {
+		fprintf(stderr, "Found circular dependency\n");
+		exit(EXIT_FAILURE);
+	}
+
+	now = bench_time();
+	times[PHASE_CIRCULAR][round] = now - start;
+	start = now;
+
+	if (defer) {
+		for (size_t i = 0; i < graph.services_len; i++) {
+			graph.services[i].flags |= SERVICE_FLAG_DEFERRED;
+		}
+	}
+
+	sched_init(&sched, &graph);
+	sched.rc_subr = rc_subr;
+
+	sched_select(&sched, false, false, NULL);
+
+	now = bench_time();
+	times[PHASE_SELECT][round] = now - start;
+	start = now;
+
+	sched_reduce(&sched, false);
+
+	now = bench_time();
+	times[PHASE_REDUCE][round] = now - start;
+	start = now;
+
+	uint32_t target = target_name ? graph_search(&graph, target_name) : GRAPH_NONE;
+
+	if (target_name && target == GRAPH_NONE) {
+		fprintf(stderr, "Couldn't find target %s\n", target_name);
+		exit(EXIT_FAILURE);
+	}
+
+	if (boost) {
+		sched_boost(&sched, 1, &target, NULL);
+	}
+
+	if (defer) {
+		sched_defer(&sched, 1, &target, SCHED_DEFERRED_CONCURRENCY);
+	}
+
+	now = bench_time();
+	times[PHASE_SELECT][round] += now - start;
+	start = now;
+
+	if (execute) {
+		sched_run(&sched);
+
+		// deferred services are still running in the background once the boot is done, so wait them out to keep the runs comparable
+
+		while (sched.running) {
+			usleep(1000);
+			sched_reap(&sched);
+		}
+
+		times[PHASE_RUN][round] = bench_time() - start;
+
+		if (target != GRAPH_NONE) {
+			times[PHASE_TARGET][round] = sched.start_times[target] + sched.total_times[target] - start;
+		}
+	}
+
+	size_t services_len = graph.services_len;
+
+	for (size_t i = 0; i < services_len; i++) {
+		service_t* service = &graph.services[i];
+
+		if (service->kind == SERVICE_KIND_AQUABSD) {
+			dlclose(service->aquabsd.lib);
+		}
+	}
+
+	sched_free(&sched);
+	graph_free(&graph);
+
+	return services_len;
+}
+
+int main(int argc, char* argv[]) {
+	char const* root = NULL;
+	size_t rounds = 10;
+	bool execute = false;
+	char const* target = NULL;
+	bool boost = false;
+	bool defer = false;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "bdr:R:t:x")) != -1) {
+		switch (c) {
+			case 'b': boost = true; break;
+			case 'd': defer = true; break;
+			case 'r': root = optarg; break;
+			case 't': target = optarg; break;
+			case 'R': rounds = atoi(optarg); break;
+			case 'x': execute = true; break;
+
+			default:
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (!root || !rounds || rounds > MAX_ROUNDS || ((boost || defer) && !target)) {
+		fprintf(stderr, "usage: %s -r root [-R rounds (1 to %d)] [-x] [-t target [-b] [-d]]\n", argv[0], MAX_ROUNDS);
+		return EXIT_FAILURE;
+	}
+
+	// fake aquaBSD services look for their sidecar files here
+
+	setenv("BENCH_ROOT", root, 1);
+
+	size_t services_len = 0;
+
+	for (size_t i = 0; i < rounds; i++) {
+		services_len = round_(root, i, execute, target, boost, defer);
+	}
+
+	printf("%s: %zu services, %zu rounds\n", root, services_len, rounds);
+
+	long double total_min = 0;
+	long double total_median = 0;
+
+	for (phase_t phase = 0; phase < PHASE_COUNT; phase++) {
+		if ((phase == PHASE_RUN && !execute) || (phase == PHASE_TARGET && (!execute || !target))) {
+			continue;
+		}
+
+		qsort(times[phase], rounds, sizeof **times, cmp_time);
+
+		long double min = times[phase][0];
+		long double median = times[phase][rounds / 2];
+
+		// the target is reached during the run, so it doesn't add anything to the total
+
+		if (phase != PHASE_TARGET) {
+			total_min += min;
+			total_median += median;
+		}
+
+		printf("  %-10s min %10.3Lf ms, median %10.3Lf ms\n", phase_names[phase], min * 1000, median * 1000);
+	}
+
+	printf("  %-10s min %10.3Lf ms, median %10.3Lf ms\n", "total", total_min * 1000, total_median * 1000);
+
+	return EXIT_SUCCESS;
+}
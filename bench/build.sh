@@ -0,0 +1,34 @@
+#!/bin/sh
+set -e
+
+# benchmarks for init's hot paths
+# these link directly against init's sources, so run this from the root of the repository
+
+mkdir -p bin/bench
+
+CFLAGS="-O2 -g -std=c11 -iquote src -I/usr/local/include"
+LDFLAGS="-lpthread -lumber -L/usr/local/lib"
+
+if [ "$(uname)" = Linux ]; then
+	CFLAGS="$CFLAGS -D_GNU_SOURCE"
+	LDFLAGS="$LDFLAGS -lbsd -ldl"
+else
+	LDFLAGS="$LDFLAGS -lutil"
+fi
+
+cc $CFLAGS bench/closure.c src/graph.c src/log.c src/strtab.c src/arena.c -o bin/bench/closure $LDFLAGS
+cc $CFLAGS bench/reduce.c src/graph.c src/log.c src/strtab.c src/arena.c -o bin/bench/reduce $LDFLAGS
+cc $CFLAGS bench/timer.c src/timer.c -o bin/bench/timer $LDFLAGS
+cc $CFLAGS bench/sampler.c src/sampler.c src/proctree.c src/pidmap.c src/timer.c src/log.c -o bin/bench/sampler $LDFLAGS
+cc $CFLAGS bench/output.c src/output.c src/graph.c src/log.c src/strtab.c src/arena.c -o bin/bench/output $LDFLAGS
+
+# end-to-end boot benchmarks (cf. 'bench/suite.sh')
+
+cc $CFLAGS bench/gen.c -o bin/bench/gen
+cc $CFLAGS bench/work.c -o bin/bench/work
+cc $CFLAGS -shared -fPIC bench/fake_service.c -o bin/bench/fake_service.so
+cc $CFLAGS bench/boot.c src/discover.c src/graph.c src/log.c src/strtab.c src/arena.c src/pidmap.c src/sched.c src/output.c src/status.c src/table.c src/events.c src/timer.c src/memo.c src/readahead.c src/proctree.c src/prio.c -o bin/bench/boot $LDFLAGS
+
+# control socket load generator
+
+cc $CFLAGS bench/control.c src/control.c src/graph.c src/log.c src/strtab.c src/arena.c src/pidmap.c src/sched.c src/output.c src/status.c src/table.c src/events.c src/timer.c src/memo.c src/readahead.c src/proctree.c src/sampler.c src/prio.c -o bin/bench/control $LDFLAGS
@@ -0,0 +1,50 @@
+// benchmark for 'graph_closure', i.e. computing which services need to be started to reach a set of targets
+
+#include <string.h>
+
+#include "common.h"
+
+#define SERVICES_LEN 100000
+#define ROUNDS 100
+
+static void bench(char const* label, size_t max_deps, size_t locality, size_t targets_len) {
+	graph_t graph;
+	bench_random_dag(&graph, SERVICES_LEN, max_deps, locality);
+
+	bitset_word_t* closure = bitset_new(SERVICES_LEN);
+
+	// take the last services as targets, as they're the ones with the deepest closures
+
+	uint32_t* targets = malloc(targets_len * sizeof *targets);
+
+	for (size_t i = 0; i < targets_len; i++) {
+		targets[i] = SERVICES_LEN - 1 - i;
+	}
+
+	long double start = bench_time();
+	size_t closure_len = 0;
+
+	for (size_t i = 0; i < ROUNDS; i++) {
+		memset(closure, 0, bitset_words(SERVICES_LEN) * sizeof *closure);
+
+		graph_closure(&graph, targets_len, targets, closure);
+		closure_len = bitset_count(closure, SERVICES_LEN);
+	}
+
+	long double per_round = (bench_time() - start) / ROUNDS;
+	printf("%-24s %zu services, %zu edges, %zu targets, closure of %zu: %.3Lf ms\n", label, (size_t) SERVICES_LEN, (size_t) bench_edges_len(&graph), targets_len, closure_len, per_round * 1000);
+
+	free(targets);
+	free(closure);
+	graph_free(&graph);
+}
+
+int main(void) {
+	bench("sparse, shallow", 2,  SERVICES_LEN, 1);
+	bench("sparse, deep",    2,  16,           1);
+	bench("dense, shallow",  16, SERVICES_LEN, 1);
+	bench("dense, deep",     16, 64,           1);
+	bench("many targets",    4,  256,          64);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "graph.h"
+
+// small deterministic PRNG (xorshift64*), so that benchmark graphs are the same from one run to the next
+
+static uint64_t bench_seed = 0x9e3779b97f4a7c15;
+
+static inline uint64_t bench_rand(void) {
+	bench_seed ^= bench_seed >> 12;
+	bench_seed ^= bench_seed << 25;
+	bench_seed ^= bench_seed >> 27;
+
+	return bench_seed * 0x2545f4914f6cdd1d;
+}
+
+static inline long double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long double) now.tv_sec + 1.e-9 * (long double) now.tv_nsec;
+}
+
+// generate a random DAG of 'services_len' services, where each service depends on between 1 and 'max_deps' services with a lower index
+// 'locality' bounds how far back a dependency can be, which roughly controls the depth of the graph
+// services are named after their index, and the graph is resolved just like init would
+
+static inline void bench_random_dag(graph_t* graph, size_t services_len, size_t max_deps, size_t locality) {
+	arena_t arena;
+	arena_init(&arena, 64 * 1024);
+
+	graph_init(graph, &arena);
+
+	char name[32];
+
+	for (size_t i = 0; i < services_len; i++) {
+		snprintf(name, sizeof name, "s%zu", i);
+
+		service_t* service = graph_new_service(graph, name);
+		service_parse_t* parse = graph_parse_info(graph, service);
+
+		size_t deps_len = i ? 1 + bench_rand() % max_deps : 0;
+
+		for (size_t j = 0; j < deps_len; j++) {
+			size_t back = 1 + bench_rand() % (i < locality ? i : locality);
+
+			snprintf(name, sizeof name, "s%zu", i - back);
+			graph_push_name(graph, &parse->dep_names, name);
+		}
+	}
+
+	graph_resolve(graph);
+	arena_free(&arena);
+}
+
+static inline size_t bench_edges_len(graph_t const* graph) {
+	return graph->dep_offs[graph->services_len];
+}
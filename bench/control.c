@@ -0,0 +1,203 @@
+// load generator for init's control socket
+// usage: control [-s services] [-c clients] [-n requests] [-b batch] [-C command]
+//
+// serves requests on a scratch socket from a thread running the same loop as init does, over a random graph of services
+// each client connects once and then sends its requests back-to-back, waiting for each response before sending the next
+// reports the overall throughput in commands per second, and the latency percentiles of individual requests
+// without '-c', a sweep over a range of client counts is run instead
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "control.h"
+#include "proto.h"
+#include "sched.h"
+
+static graph_t graph;
+static sched_t sched;
+static control_t control;
+
+static char sock_path[64];
+static int stop_pipe[2];
+
+static size_t requests_len = 1000;
+static size_t batch = 1;
+static proto_cmd_t cmd = PROTO_CMD_STATUS;
+
+typedef struct {
+	pthread_t thread;
+	size_t index;
+	long double* latencies;
+} client_t;
+
+static void* serve(void* arg) {
+	(void) arg;
+
+	while (!control_poll(&control, 1, stop_pipe, -1));
+	return NULL;
+}
+
+static void* client(void* arg) {
+	client_t* self = arg;
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, sock_path, sizeof addr.sun_path - 1);
+
+	int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+	if (sock < 0 || connect(sock, (struct sockaddr*) &addr, sizeof addr) < 0) {
+		perror("connect");
+		exit(EXIT_FAILURE);
+	}
+
+	// every client asks about different services, so that they don't all hit the same ones
+
+	proto_req_msg_t req;
+	memset(&req, 0, sizeof req);
+
+	req.header = (proto_req_t) {
+		.magic = PROTO_MAGIC,
+		.version = PROTO_VERSION,
+		.cmd = cmd,
+		.count = cmd == PROTO_CMD_EXPORT ? 0 : batch,
+	};
+
+	for (size_t i = 0; i < req.header.count; i++) {
+		snprintf(req.names[i], PROTO_NAME_LEN, "s%zu", (self->index * batch + i) % graph.services_len);
+	}
+
+	size_t req_len = sizeof req.header + req.header.count * PROTO_NAME_LEN;
+
+	for (size_t i = 0; i < requests_len; i++) {
+		req.header.id = i;
+		long double start = bench_time();
+
+		if (send(sock, &req, req_len, MSG_EOR) < 0) {
+			perror("send");
+			exit(EXIT_FAILURE);
+		}
+
+		// streamed responses only count as done once the last of them is in
+
+		proto_res_msg_t res;
+
+		do {
+			if (recv(sock, &res, sizeof res, 0) < (ssize_t) sizeof res.header || res.header.id != i || res.header.err) {
+				fprintf(stderr, "Bad response to request %zu\n", i);
+				exit(EXIT_FAILURE);
+			}
+		} while (res.header.flags & PROTO_RES_MORE);
+
+		self->latencies[i] = bench_time() - start;
+	}
+
+	close(sock);
+	return NULL;
+}
+
+static int cmp_time(void const* _a, void const* _b) {
+	long double a = *(long double const*) _a;
+	long double b = *(long double const*) _b;
+
+	return (a > b) - (a < b);
+}
+
+static void bench(size_t clients_len) {
+	client_t* clients = calloc(clients_len, sizeof *clients);
+	long double* latencies = malloc(clients_len * requests_len * sizeof *latencies);
+
+	long double start = bench_time();
+
+	for (size_t i = 0; i < clients_len; i++) {
+		clients[i].index = i;
+		clients[i].latencies = latencies + i * requests_len;
+
+		pthread_create(&clients[i].thread, NULL, client, &clients[i]);
+	}
+
+	for (size_t i = 0; i < clients_len; i++) {
+		pthread_join(clients[i].thread, NULL);
+	}
+
+	long double total = bench_time() - start;
+	size_t count = clients_len * requests_len;
+
+	qsort(latencies, count, sizeof *latencies, cmp_time);
+
+	printf("%4zu clients, %zu requests of %zu services each: %9.0Lf commands/s, latency p50 %7.1Lf us, p99 %7.1Lf us, max %7.1Lf us\n",
+		clients_len, requests_len, cmd == PROTO_CMD_EXPORT ? (size_t) 0 : batch,
+		count * (cmd == PROTO_CMD_EXPORT ? 1 : batch) / total,
+		latencies[count / 2] * 1e6, latencies[count * 99 / 100] * 1e6, latencies[count - 1] * 1e6);
+
+	free(latencies);
+	free(clients);
+}
+
+int main(int argc, char* argv[]) {
+	size_t services_len = 1000;
+	size_t clients_len = 0;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "b:c:C:n:s:")) != -1) {
+		switch (c) {
+			case 'b': batch = atoi(optarg); break;
+			case 'c': clients_len = atoi(optarg); break;
+			case 'n': requests_len = atoi(optarg); break;
+			case 's': services_len = atoi(optarg); break;
+
+			case 'C':
+				cmd = !strcmp(optarg, "export") ? PROTO_CMD_EXPORT : PROTO_CMD_STATUS;
+				break;
+
+			default:
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (!batch || batch > PROTO_MAX_NAMES || !requests_len || !services_len || clients_len > CONTROL_MAX_CLIENTS) {
+		fprintf(stderr, "usage: %s [-s services] [-c clients (up to %d)] [-n requests] [-b batch (1 to %zu)] [-C status|export]\n", argv[0], CONTROL_MAX_CLIENTS, PROTO_MAX_NAMES);
+		return EXIT_FAILURE;
+	}
+
+	bench_random_dag(&graph, services_len, 4, 64);
+	sched_init(&sched, &graph);
+
+	snprintf(sock_path, sizeof sock_path, "/tmp/init-bench.%d.sock", getpid());
+
+	control_init(&control, &sched, NULL, sock_path, getgid());
+
+	if (control_listen(&control) < 0 || pipe(stop_pipe) < 0) {
+		perror("control_listen");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t server;
+	pthread_create(&server, NULL, serve, NULL);
+
+	if (clients_len) {
+		bench(clients_len);
+	}
+
+	else {
+		size_t const sweep[] = { 1, 4, 16, 64, 256 };
+
+		for (size_t i = 0; i < sizeof sweep / sizeof *sweep; i++) {
+			bench(sweep[i]);
+		}
+	}
+
+	write(stop_pipe[1], "", 1);
+	pthread_join(server, NULL);
+
+	control_free(&control);
+	sched_free(&sched);
+	graph_free(&graph);
+
+	return EXIT_SUCCESS;
+}
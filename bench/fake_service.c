@@ -0,0 +1,73 @@
+// fake aquaBSD service generated by 'gen'
+// every generated service is a copy of this same library, which reads its dependencies and workload from '$BENCH_ROOT/bench/<name>' when loaded (<name> being the filename it was loaded from)
+// that file contains the kind of workload and its amount on the first line, and the names of the service's dependencies on the second
+
+#include <dlfcn.h>
+#include <libgen.h>
+
+#include "work.h"
+
+#define flag int
+
+flag on_start;
+
+#define MAX_DEPS 256
+
+static char kind[16] = "none";
+static unsigned amount = 0;
+
+static size_t deps_len = 0;
+static char* dep_names[MAX_DEPS];
+static char deps_buf[MAX_DEPS * 32];
+
+static char scratch[4096];
+
+__attribute__((constructor)) static void load(void) {
+	Dl_info info;
+
+	if (!dladdr((void*) load, &info)) {
+		return;
+	}
+
+	char const* root = getenv("BENCH_ROOT");
+
+	if (!root) {
+		return;
+	}
+
+	char lib_path[4096];
+	snprintf(lib_path, sizeof lib_path, "%s", info.dli_fname);
+
+	char path[4096];
+	snprintf(path, sizeof path, "%s/bench/%s", root, basename(lib_path));
+	snprintf(scratch, sizeof scratch, "%s/bench", root);
+
+	FILE* fp = fopen(path, "r");
+
+	if (!fp) {
+		return;
+	}
+
+	if (fscanf(fp, "%15s %u\n", kind, &amount) != 2 || !fgets(deps_buf, sizeof deps_buf, fp)) {
+		fclose(fp);
+		return;
+	}
+
+	fclose(fp);
+
+	for (char* str = strtok(deps_buf, " \n"); str && deps_len < MAX_DEPS; str = strtok(NULL, " \n")) {
+		dep_names[deps_len++] = str;
+	}
+}
+
+int start(void) {
+	return bench_work(kind, amount, scratch);
+}
+
+size_t get_deps_len(void) {
+	return deps_len;
+}
+
+char** get_dep_names(void) {
+	return dep_names;
+}
@@ -0,0 +1,342 @@
+// generator of synthetic service trees, for benchmarking init end-to-end
+// usage: gen -r <root> [-s shape] [-n services] [-k kind] [-w work] [-a amount] [-m max deps] [-l locality] [-W width] [-t fake service library] [-S seed]
+//
+// shapes:
+//  - "chain": each service depends on the previous one
+//  - "fanout": every service depends on a single root service
+//  - "diamond": a chain of diamonds, 'width' services wide
+//  - "aggregator": groups of 'width' services, each aggregated by a dummy service (similar to NETWORKING), which the next group depends on (along with some redundant dependencies on the group itself, as is often the case in practice)
+//  - "random": random DAG where each service has up to 'max deps' dependencies, at most 'locality' services back
+//  - "login": a chain of 'width' services leading up to a dummy 'LOGIN' service, with all the others running alongside it in the background (with '-w cpu', this is for measuring how long it takes to get to a login prompt under contention)
+//
+// kinds (i.e. what the services are generated as):
+//  - "rc": research UNIX-style scripts in '<root>/etc/rc.d', with a '<root>/etc/rc.subr' to run them
+//  - "so": aquaBSD services in '<root>/etc/init/services', as copies of the fake service library
+//  - "mixed": alternate between "rc" and "so"
+// there's no kind for 'desc.json' service directories, as discovery doesn't load those (yet), so they'd just be skipped
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#define MAX_DEPS 256
+
+typedef struct {
+	char name[32];
+
+	bool dummy; // dummy services don't do any work
+
+	size_t deps_len;
+	char deps[MAX_DEPS][32];
+} gen_service_t;
+
+static size_t services_len;
+static gen_service_t* services;
+
+static void add_dep(gen_service_t* service, char const* fmt, size_t index) {
+	if (service->deps_len < MAX_DEPS) {
+		snprintf(service->deps[service->deps_len++], sizeof *service->deps, fmt, index);
+	}
+}
+
+static void shape(char const* shape, size_t max_deps, size_t locality, size_t width) {
+	for (size_t i = 0; i < services_len; i++) {
+		snprintf(services[i].name, sizeof services[i].name, "svc%zu", i);
+	}
+
+	if (!strcmp(shape, "chain")) {
+		for (size_t i = 1; i < services_len; i++) {
+			add_dep(&services[i], "svc%zu", i - 1);
+		}
+	}
+
+	else if (!strcmp(shape, "fanout")) {
+		for (size_t i = 1; i < services_len; i++) {
+			add_dep(&services[i], "svc%zu", 0);
+		}
+	}
+
+	else if (!strcmp(shape, "diamond")) {
+		// blocks of a top, 'width' middles depending on it, and a bottom depending on all the middles
+		// each top depends on the previous block's bottom
+
+		size_t block = width + 2;
+
+		for (size_t i = 0; i < services_len; i++) {
+			size_t top = i - i % block;
+			size_t bottom = top + block - 1;
+
+			if (i == top && top) {
+				add_dep(&services[i], "svc%zu", top - 1);
+			}
+
+			else if (i == bottom) {
+				for (size_t j = top + 1; j < bottom; j++) {
+					add_dep(&services[i], "svc%zu", j);
+				}
+			}
+
+			else if (i != top) {
+				add_dep(&services[i], "svc%zu", top);
+			}
+		}
+	}
+
+	else if (!strcmp(shape, "aggregator")) {
+		// groups of 'width' services followed by a dummy 'AGGREGATOR<group>' service
+
+		size_t block = width + 1;
+
+		for (size_t i = 0; i < services_len; i++) {
+			size_t group = i / block;
+			size_t first = group * block;
+
+			if (i % block == width) {
+				services[i].dummy = true;
+				snprintf(services[i].name, sizeof services[i].name, "AGGREGATOR%zu", group);
+
+				for (size_t j = first; j < i; j++) {
+					add_dep(&services[i], "svc%zu", j);
+				}
+			}
+
+			else if (group) {
+				add_dep(&services[i], "AGGREGATOR%zu", group - 1);
+				add_dep(&services[i], "svc%zu", first - block + bench_rand() % width);
+			}
+		}
+	}
+
+	else if (!strcmp(shape, "random")) {
+		for (size_t i = 1; i < services_len; i++) {
+			size_t deps_len = 1 + bench_rand() % max_deps;
+
+			for (size_t j = 0; j < deps_len; j++) {
+				size_t back = 1 + bench_rand() % (i < locality ? i : locality);
+				add_dep(&services[i], "svc%zu", i - back);
+			}
+		}
+	}
+
+	else if (!strcmp(shape, "login")) {
+		for (size_t i = 1; i < width && i < services_len; i++) {
+			add_dep(&services[i], "svc%zu", i - 1);
+		}
+
+		if (width < services_len) {
+			services[width].dummy = true;
+			snprintf(services[width].name, sizeof services[width].name, "LOGIN");
+
+			add_dep(&services[width], "svc%zu", width - 1);
+		}
+	}
+
+	else {
+		fprintf(stderr, "Unknown shape '%s'\n", shape);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void mkdirs(char const* root, char const* dir) {
+	char path[4096];
+	snprintf(path, sizeof path, "%s/%s", root, dir);
+
+	for (char* p = path + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0755);
+			*p = '/';
+		}
+	}
+
+	if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "mkdir(\"%s\"): %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+static FILE* create(char const* path, mode_t mode) {
+	unlink(path);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+
+	if (fd < 0) {
+		fprintf(stderr, "open(\"%s\"): %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	fchmod(fd, mode); // not affected by umask
+	return fdopen(fd, "w");
+}
+
+static void gen_rc(char const* root, gen_service_t* service, char const* work, unsigned amount, char const* work_bin) {
+	char path[4096];
+	snprintf(path, sizeof path, "%s/etc/rc.d/%s", root, service->name);
+
+	FILE* fp = create(path, 0555);
+
+	fprintf(fp, "#!/bin/sh\n#\n");
+	fprintf(fp, "# PROVIDE: %s\n", service->name);
+	fprintf(fp, "# REQUIRE:");
+
+	for (size_t i = 0; i < service->deps_len; i++) {
+		fprintf(fp, " %s", service->deps[i]);
+	}
+
+	fprintf(fp, "\n\n");
+
+	if (!service->dummy) {
+		fprintf(fp, "exec %s %s %u %s/bench\n", work_bin, work, amount, root);
+	}
+
+	fclose(fp);
+}
+
+static void gen_so(char const* root, gen_service_t* service, char const* work, unsigned amount, void* lib, size_t lib_size) {
+	char path[4096];
+	snprintf(path, sizeof path, "%s/etc/init/services/%s", root, service->name);
+
+	FILE* fp = create(path, 0755);
+	fwrite(lib, 1, lib_size, fp);
+	fclose(fp);
+
+	// sidecar file read by the library when loaded
+
+	snprintf(path, sizeof path, "%s/bench/%s", root, service->name);
+	fp = create(path, 0644);
+
+	fprintf(fp, "%s %u\n", service->dummy ? "none" : work, amount);
+
+	for (size_t i = 0; i < service->deps_len; i++) {
+		fprintf(fp, "%s ", service->deps[i]);
+	}
+
+	fprintf(fp, "\n");
+	fclose(fp);
+}
+
+static void* read_file(char const* path, size_t* size) {
+	FILE* fp = fopen(path, "r");
+
+	if (!fp) {
+		fprintf(stderr, "fopen(\"%s\"): %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	*size = ftell(fp);
+	rewind(fp);
+
+	void* data = malloc(*size);
+
+	if (fread(data, 1, *size, fp) != *size) {
+		fprintf(stderr, "fread(\"%s\"): %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(fp);
+	return data;
+}
+
+int main(int argc, char* argv[]) {
+	char const* root = NULL;
+	char const* shape_name = "random";
+	char const* kind = "rc";
+	char const* work = "sleep";
+	char const* lib_path = "bin/bench/fake_service.so";
+	char const* work_bin = "bin/bench/work";
+
+	unsigned amount = 10;
+
+	size_t max_deps = 4;
+	size_t locality = 64;
+	size_t width = 8;
+
+	services_len = 100;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "a:b:k:l:m:n:r:s:S:t:w:W:")) != -1) {
+		switch (c) {
+			case 'a': amount = atoi(optarg); break;
+			case 'b': work_bin = optarg; break;
+			case 'k': kind = optarg; break;
+			case 'l': locality = atoi(optarg); break;
+			case 'm': max_deps = atoi(optarg); break;
+			case 'n': services_len = atoi(optarg); break;
+			case 'r': root = optarg; break;
+			case 's': shape_name = optarg; break;
+			case 'S': bench_seed = strtoull(optarg, NULL, 0); break;
+			case 't': lib_path = optarg; break;
+			case 'w': work = optarg; break;
+			case 'W': width = atoi(optarg); break;
+
+			default:
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (!root || !services_len || !max_deps || !locality || !width) {
+		fprintf(stderr, "usage: %s -r root [-s shape] [-n services] [-k kind] [-w work] [-a amount] [-m max deps] [-l locality] [-W width] [-t fake service library] [-b work binary] [-S seed]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// paths written into services must be absolute
+
+	char work_bin_abs[4096];
+
+	if (!realpath(work_bin, work_bin_abs)) {
+		fprintf(stderr, "realpath(\"%s\"): %s\n", work_bin, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	services = calloc(services_len, sizeof *services);
+	shape(shape_name, max_deps, locality, width);
+
+	mkdirs(root, "etc/rc.d");
+	mkdirs(root, "etc/init/services");
+	mkdirs(root, "bench");
+
+	// minimal 'rc.subr', just enough to run the generated scripts
+
+	char path[4096];
+	snprintf(path, sizeof path, "%s/etc/rc.subr", root);
+
+	FILE* fp = create(path, 0444);
+	fprintf(fp, "run_rc_script() {\n\tsh \"$1\" \"$2\"\n}\n");
+	fclose(fp);
+
+	size_t lib_size = 0;
+	void* lib = NULL;
+
+	if (!strcmp(kind, "so") || !strcmp(kind, "mixed")) {
+		lib = read_file(lib_path, &lib_size);
+	}
+
+	for (size_t i = 0; i < services_len; i++) {
+		gen_service_t* service = &services[i];
+
+		if (!strcmp(kind, "rc") || (!strcmp(kind, "mixed") && i % 2)) {
+			gen_rc(root, service, work, amount, work_bin_abs);
+		}
+
+		else if (!strcmp(kind, "so") || !strcmp(kind, "mixed")) {
+			gen_so(root, service, work, amount, lib, lib_size);
+		}
+
+		else {
+			fprintf(stderr, "Unknown kind '%s'\n", kind);
+			return EXIT_FAILURE;
+		}
+	}
+
+	free(lib);
+	free(services);
+
+	return EXIT_SUCCESS;
+}
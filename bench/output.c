@@ -0,0 +1,107 @@
+// benchmark for capturing service output, i.e. how fast output makes its way from a service's pipe to its log file
+// on Linux, this also checks that the output actually went through 'splice(2)' (cf. 'output_ring_t.spliced'), rather than silently falling back to reading it in
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "output.h"
+
+#define CHUNK (64 * 1024)
+
+static void bench(size_t total) {
+	char dir[] = "/tmp/bench-output-XXXXXX";
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	// the output thread never exits, so neither of these are ever freed
+
+	graph_t* graph = malloc(sizeof *graph);
+	bench_random_dag(graph, 1, 1, 1);
+
+	output_t* output = malloc(sizeof *output);
+	output_init(output, graph, dir);
+
+	// wait for the output thread to have noticed the log directory is writable, so that everything can go straight to the log file
+
+	for (;;) {
+		pthread_mutex_lock(&output->lock);
+		bool writable = output->writable;
+		pthread_mutex_unlock(&output->lock);
+
+		if (writable) {
+			break;
+		}
+
+		usleep(1000);
+	}
+
+	int fd = output_pipe(output, 0);
+
+	char* chunk = malloc(CHUNK);
+	memset(chunk, 'x', CHUNK);
+
+	long double start = bench_time();
+
+	for (size_t written = 0; written < total; written += CHUNK) {
+		if (write(fd, chunk, CHUNK) != CHUNK) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	close(fd);
+
+	// the output thread closes its end once it's drained everything
+
+	for (;;) {
+		pthread_mutex_lock(&output->lock);
+		bool done = output->rings[0].fd < 0;
+		pthread_mutex_unlock(&output->lock);
+
+		if (done) {
+			break;
+		}
+
+		usleep(100);
+	}
+
+	long double took = bench_time() - start;
+
+	char path[4096];
+	snprintf(path, sizeof path, "%s/%s.log", dir, graph_name(graph, 0));
+
+	struct stat sb;
+
+	if (stat(path, &sb) < 0 || (size_t) sb.st_size != total) {
+		fprintf(stderr, "Log file '%s' doesn't have all %zu bytes written to the pipe!\n", path, total);
+		exit(EXIT_FAILURE);
+	}
+
+	bool spliced = output->rings[0].spliced;
+
+	printf("%5zu MiB: %8.1Lf MiB/s (%s)\n", total >> 20, (long double) total / (1 << 20) / took, spliced ? "spliced" : "read into the ring");
+
+#if defined(__linux__)
+	if (!spliced) {
+		fprintf(stderr, "Output never went through splice(2)!\n");
+		exit(EXIT_FAILURE);
+	}
+#endif
+
+	unlink(path);
+	rmdir(dir);
+
+	free(chunk);
+}
+
+int main(void) {
+	bench(16 << 20);
+	bench(256 << 20);
+
+	return 0;
+}
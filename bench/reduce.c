@@ -0,0 +1,127 @@
+// benchmark for 'graph_reduce', i.e. the transitive reduction of the dependency graph
+
+#include <string.h>
+
+#include "common.h"
+
+static bitset_word_t** closures(graph_t const* graph) {
+	size_t services_len = graph->services_len;
+	bitset_word_t** closures = malloc(services_len * sizeof *closures);
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		closures[i] = bitset_new(services_len);
+		graph_closure(graph, 1, &i, closures[i]);
+	}
+
+	return closures;
+}
+
+// make sure reducing the graph didn't change what each service can reach
+
+static void check(graph_t const* graph, bitset_word_t** before) {
+	size_t services_len = graph->services_len;
+	bitset_word_t** after = closures(graph);
+
+	for (size_t i = 0; i < services_len; i++) {
+		if (memcmp(before[i], after[i], bitset_words(services_len) * sizeof **after)) {
+			fprintf(stderr, "Reachability of service %zu changed after reduction!\n", i);
+			exit(EXIT_FAILURE);
+		}
+
+		free(before[i]);
+		free(after[i]);
+	}
+
+	free(before);
+	free(after);
+}
+
+static void bench(char const* label, size_t services_len, size_t max_deps, size_t locality, bool verify) {
+	graph_t graph;
+	bench_random_dag(&graph, services_len, max_deps, locality);
+
+	size_t edges_len = bench_edges_len(&graph);
+	bitset_word_t** before = verify ? closures(&graph) : NULL;
+
+	long double start = bench_time();
+	size_t removed = graph_reduce(&graph, NULL, false);
+	long double took = bench_time() - start;
+
+	printf("%-16s %6zu services, %7zu edges, %7zu removed: %.3Lf ms\n", label, services_len, edges_len, removed, took * 1000);
+
+	if (verify) {
+		check(&graph, before);
+	}
+
+	graph_free(&graph);
+}
+
+// regression check for reducing only what's selected: with a depending on b and c, and b depending on c, a's dependency on c is only redundant if b actually runs
+// otherwise, nothing would stop a from starting before c has completed
+
+static void check_selected(bool b_selected) {
+	arena_t arena;
+	arena_init(&arena, 64 * 1024);
+
+	graph_t graph;
+	graph_init(&graph, &arena);
+
+	service_t* service = graph_new_service(&graph, "a");
+	graph_push_name(&graph, &graph_parse_info(&graph, service)->dep_names, "b");
+	graph_push_name(&graph, &graph_parse_info(&graph, service)->dep_names, "c");
+
+	service = graph_new_service(&graph, "b");
+	graph_push_name(&graph, &graph_parse_info(&graph, service)->dep_names, "c");
+
+	graph_new_service(&graph, "c");
+
+	graph_resolve(&graph);
+	arena_free(&arena);
+
+	uint32_t a = graph_search(&graph, "a");
+	uint32_t b = graph_search(&graph, "b");
+	uint32_t c = graph_search(&graph, "c");
+
+	bitset_word_t* selected = bitset_new(graph.services_len);
+	bitset_set(selected, a);
+	bitset_set(selected, c);
+
+	if (b_selected) {
+		bitset_set(selected, b);
+	}
+
+	graph_reduce(&graph, selected, false);
+
+	bool kept = false;
+
+	for (uint32_t i = graph.dep_offs[a]; i < graph.dep_offs[a + 1]; i++) {
+		kept |= graph.deps[i] == c;
+	}
+
+	if (kept == b_selected) {
+		fprintf(stderr, "Dependency of a on c was %s with b %s!\n", kept ? "kept" : "removed", b_selected ? "selected" : "not selected");
+		exit(EXIT_FAILURE);
+	}
+
+	free(selected);
+	graph_free(&graph);
+}
+
+int main(void) {
+	check_selected(true);
+	check_selected(false);
+
+	bench("verify",  2000,   8,  64,    true );
+
+	bench("sparse",  1000,   4,  1000,  false);
+	bench("sparse",  5000,   4,  5000,  false);
+	bench("sparse",  20000,  4,  20000, false);
+
+	bench("dense",   1000,   16, 64,    false);
+	bench("dense",   5000,   16, 64,    false);
+	bench("dense",   20000,  16, 64,    false);
+
+	bench("huge",    100000, 8,  256,   false);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+// benchmark for sampling the CPU and memory use of services (cf. 'service top'), i.e. how much of a core init spends on it at the default interval
+// each service gets a real process of its own, which just sleeps, as it's reading their counters from the kernel which costs anything
+
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "common.h"
+#include "proctree.h"
+#include "sampler.h"
+
+#define SAMPLES_LEN 100
+
+static void bench(size_t services_len) {
+	// services are only ever looked at through 'services_len', 'usage', and 'tree' by the sampler, so there's no need for an actual graph
+
+	sched_t sched;
+	memset(&sched, 0, sizeof sched);
+
+	proctree_t tree;
+	proctree_init(&tree, services_len);
+
+	sched.services_len = services_len;
+	sched.usage = calloc(services_len, sizeof *sched.usage);
+	sched.tree = &tree;
+
+	for (size_t i = 0; i < services_len; i++) {
+		pid_t pid = fork();
+
+		if (!pid) {
+			pause();
+			_exit(EXIT_SUCCESS);
+		}
+
+		proctree_add(&tree, i, pid);
+	}
+
+	timers_t timers;
+	timers_init(&timers, bench_time());
+
+	sampler_t sampler;
+	sampler_init(&sampler, &sched, &timers, SAMPLER_INTERVAL);
+
+	long double start = bench_time();
+
+	for (size_t i = 0; i < SAMPLES_LEN; i++) {
+		sampler_sample(&sampler);
+	}
+
+	long double per_sample = (bench_time() - start) / SAMPLES_LEN;
+
+	sampler_stats_t stats = { 0 };
+	sampler_stats(&sampler, 0, &stats);
+
+	printf("%5zu services: %8.1Lf us per sample, %.3Lf%% of a core at one sample every %g s (%u process, %" PRIu64 " KiB for the first service)\n",
+		services_len, per_sample * 1e6, per_sample / SAMPLER_INTERVAL * 100, SAMPLER_INTERVAL, stats.procs, stats.rss);
+
+	for (size_t i = 0; i < services_len; i++) {
+		kill(tree.pids[i][0], SIGKILL);
+	}
+
+	while (wait(NULL) > 0);
+
+	sampler_free(&sampler);
+	timers_free(&timers);
+	proctree_free(&tree);
+	free(sched.usage);
+}
+
+int main(void) {
+	bench(10);
+	bench(100);
+	bench(1000);
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+set -e
+
+# end-to-end boot benchmark suite
+# generates a bunch of service trees of different shapes, sizes, and kinds with 'gen', and benchmarks booting each of them with 'boot'
+# run this from the root of the repository after 'bench/build.sh'
+#
+# environment variables:
+#  - SIZES: service counts to generate (default "100 1000 10000")
+#  - SHAPES: graph shapes (default "chain fanout diamond aggregator random")
+#  - KINDS: service kinds (default "rc so mixed")
+#  - WORK, AMOUNT: what each service does when run (default "sleep" for "1" ms)
+#  - ROUNDS: rounds per configuration (default 5)
+#  - EXECUTE: set to actually run services too, not just the boot plan
+
+SIZES=${SIZES:-"100 1000 10000"}
+SHAPES=${SHAPES:-"chain fanout diamond aggregator random"}
+KINDS=${KINDS:-"rc so mixed"}
+WORK=${WORK:-sleep}
+AMOUNT=${AMOUNT:-1}
+ROUNDS=${ROUNDS:-5}
+
+BOOT_FLAGS=""
+
+if [ -n "$EXECUTE" ]; then
+	BOOT_FLAGS="-x"
+fi
+
+SCRATCH=$(mktemp -d)
+trap 'rm -rf "$SCRATCH"' EXIT
+
+for size in $SIZES; do
+	for shape in $SHAPES; do
+		for kind in $KINDS; do
+			root="$SCRATCH/$shape-$size-$kind"
+
+			bin/bench/gen -r "$root" -s $shape -n $size -k $kind -w $WORK -a $AMOUNT
+			bin/bench/boot -r "$root" -R $ROUNDS $BOOT_FLAGS
+
+			rm -rf "$root"
+		done
+	done
+done
+
+# run one small configuration with its services executed (and nothing boosted) even without 'EXECUTE', so that the boot itself is always exercised and not just the boot plan
+
+root="$SCRATCH/execute"
+
+bin/bench/gen -r "$root" -s random -n 100 -k mixed -w $WORK -a $AMOUNT
+bin/bench/boot -r "$root" -R 1 -x
+
+rm -rf "$root"
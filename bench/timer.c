@@ -0,0 +1,79 @@
+// benchmark for init's timer wheel, i.e. adding, cancelling, and running timers, and how often an idle init has to wake up with lots of them pending
+// time is simulated, so that hours of timers can be run through in no time
+
+#include "common.h"
+#include "timer.h"
+
+#define TIMERS_LEN 100000
+
+static size_t fired;
+
+static void count(void* data, uint32_t arg) {
+	(void) data;
+	(void) arg;
+
+	fired++;
+}
+
+// add 'TIMERS_LEN' timers spread over 'span' seconds, then run through all of them the way init's main loop would, sleeping for as long as 'timers_timeout' says
+
+static void bench(char const* label, long double span) {
+	timers_t timers;
+	long double now = 1000;
+
+	timers_init(&timers, now);
+
+	uint32_t* ids = malloc(TIMERS_LEN * sizeof *ids);
+	long double start = bench_time();
+
+	for (size_t i = 0; i < TIMERS_LEN; i++) {
+		long double deadline = now + span * (bench_rand() % 1000000) / 1000000;
+		ids[i] = timers_add(&timers, deadline, count, NULL, i);
+	}
+
+	long double add = bench_time() - start;
+
+	// cancel half of them, and add them back
+
+	start = bench_time();
+
+	for (size_t i = 0; i < TIMERS_LEN; i += 2) {
+		timers_cancel(&timers, ids[i]);
+		ids[i] = timers_add(&timers, now + span * (bench_rand() % 1000000) / 1000000, count, NULL, i);
+	}
+
+	long double cancel = bench_time() - start;
+
+	// run through all of them
+
+	size_t wakeups = 0;
+	int timeout;
+
+	fired = 0;
+	start = bench_time();
+
+	while ((timeout = timers_timeout(&timers, now)) >= 0) {
+		now += (long double) timeout / TIMER_HZ;
+		timers_run(&timers, now);
+
+		wakeups++;
+	}
+
+	long double run = bench_time() - start;
+
+	printf("%-12s %d timers over %7.0Lf s: add %5.1Lf ns, cancel & re-add %5.1Lf ns, run %5.1Lf ns per timer, %zu wakeups (%zu fired), %.3Lf us per wakeup\n",
+		label, TIMERS_LEN, span, add / TIMERS_LEN * 1e9, cancel / (TIMERS_LEN / 2) * 1e9, run / TIMERS_LEN * 1e9, wakeups, fired, run / wakeups * 1e6);
+
+	free(ids);
+	timers_free(&timers);
+}
+
+int main(void) {
+	bench("second", 1);
+	bench("minute", 60);
+	bench("hour", 3600);
+	bench("day", 86400);
+	bench("month", 30 * 86400);
+
+	return 0;
+}
@@ -0,0 +1,13 @@
+// workload of the fake research UNIX-style services generated by 'gen'
+// usage: work <kind> <amount> <scratch dir>
+
+#include "work.h"
+
+int main(int argc, char* argv[]) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s <sleep|spin|cpu|io|none> <amount> <scratch dir>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return bench_work(argv[1], atoi(argv[2]), argv[3]) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
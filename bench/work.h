@@ -0,0 +1,92 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// what fake services actually do when started:
+//  - "sleep": sleep for 'amount' milliseconds
+//  - "spin": busy-loop on the CPU for 'amount' milliseconds
+//  - "cpu": busy-loop until 'amount' milliseconds of CPU time were used (so, unlike "spin", this takes longer when competing for the CPU)
+//  - "io": write and sync 'amount' blocks of 64 KiB to a scratch file in 'dir'
+//  - "none": exit straight away
+
+#define BENCH_IO_BLOCK_SIZE (64 * 1024)
+
+static inline long double bench_work_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long double) now.tv_sec + 1.e-9 * (long double) now.tv_nsec;
+}
+
+static inline int bench_work(char const* kind, unsigned amount, char const* dir) {
+	if (!strcmp(kind, "sleep")) {
+		struct timespec ts = {
+			.tv_sec = amount / 1000,
+			.tv_nsec = (amount % 1000) * 1000000l,
+		};
+
+		return nanosleep(&ts, NULL);
+	}
+
+	if (!strcmp(kind, "spin")) {
+		long double end = bench_work_time() + amount / 1000.l;
+		volatile unsigned long counter = 0;
+
+		while (bench_work_time() < end) {
+			counter++;
+		}
+
+		return 0;
+	}
+
+	if (!strcmp(kind, "cpu")) {
+		struct timespec ts;
+		volatile unsigned long counter = 0;
+
+		do {
+			counter++;
+			clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		} while (ts.tv_sec * 1000 + ts.tv_nsec / 1000000 < (long) amount);
+
+		return 0;
+	}
+
+	if (!strcmp(kind, "io")) {
+		char path[4096];
+
+		if (snprintf(path, sizeof path, "%s/io.%d", dir, getpid()) >= (int) sizeof path) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+		if (fd < 0) {
+			return -1;
+		}
+
+		static char block[BENCH_IO_BLOCK_SIZE];
+		memset(block, getpid() & 0xff, sizeof block);
+
+		for (unsigned i = 0; i < amount; i++) {
+			if (write(fd, block, sizeof block) != sizeof block) {
+				break;
+			}
+
+			fsync(fd);
+		}
+
+		close(fd);
+		unlink(path);
+
+		return 0;
+	}
+
+	return 0;
+}
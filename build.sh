@@ -6,7 +6,16 @@ mkdir -p bin/services
 
 SERVICES_BIN_PATH=$(realpath bin/services)
 
-cc -g src/main.c -o bin/init -std=c11 -lpthread -lrt -lutil -lumber -I/usr/local/include -L/usr/local/lib
+cc -g src/main.c src/control.c src/discover.c src/graph.c src/log.c src/strtab.c src/arena.c src/pidmap.c src/sched.c src/output.c src/status.c src/sim.c src/history.c src/table.c src/events.c src/timer.c src/memo.c src/readahead.c src/proctree.c src/sampler.c src/prio.c -o bin/init -std=c11 -lpthread -lrt -lutil -lumber -I/usr/local/include -L/usr/local/lib
+
+# libinit, for programs to interact with init
+
+cc -g -c src/libinit/table.c -o bin/libinit-table.o -std=c11
+cc -g -c src/libinit/subscribe.c -o bin/libinit-subscribe.o -std=c11
+ar rcs bin/libinit.a bin/libinit-table.o bin/libinit-subscribe.o
+rm bin/libinit-*.o
+
+cc -g src/cmd/service.c src/history.c src/strtab.c bin/libinit.a -o bin/service -std=c11 -lm -lrt -lumber -I/usr/local/include -L/usr/local/lib
 
 (
 	cd src/services
@@ -0,0 +1,105 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ALIGNMENT 16
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1))
+
+void arena_init(arena_t* arena, size_t block_size) {
+	memset(arena, 0, sizeof *arena);
+	arena->block_size = block_size;
+}
+
+void arena_free(arena_t* arena) {
+	arena_block_t* block = arena->block;
+
+	while (block) {
+		arena_block_t* prev = block->prev;
+		free(block);
+		block = prev;
+	}
+
+	arena->block = NULL;
+	arena->last = NULL;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+	size = ALIGN(size);
+	arena_block_t* block = arena->block;
+
+	if (!block || block->used + size > block->size) {
+		// allocations bigger than a block get a block of their own
+
+		size_t block_size = size > arena->block_size ? size : arena->block_size;
+
+		block = malloc(sizeof *block + block_size);
+
+		block->prev = arena->block;
+		block->size = block_size;
+		block->used = 0;
+
+		arena->block = block;
+	}
+
+	void* ptr = block->data + block->used;
+	block->used += size;
+
+	arena->last = ptr;
+	arena->last_size = size;
+
+	return ptr;
+}
+
+void* arena_grow(arena_t* arena, void* ptr, size_t old_size, size_t new_size) {
+	// if this was the last allocation and there's enough space left in its block, just extend it
+
+	if (ptr && ptr == arena->last) {
+		if (ALIGN(new_size) <= arena->last_size) {
+			return ptr;
+		}
+
+		arena_block_t* block = arena->block;
+		size_t extra = ALIGN(new_size) - arena->last_size;
+
+		if (block->used + extra <= block->size) {
+			block->used += extra;
+			arena->last_size += extra;
+
+			return ptr;
+		}
+	}
+
+	// otherwise, copy it over to a new allocation (the old one is only released with the rest of the arena)
+
+	void* grown = arena_alloc(arena, new_size);
+
+	if (ptr) {
+		memcpy(grown, ptr, old_size);
+	}
+
+	return grown;
+}
+
+char* arena_strdup(arena_t* arena, char const* str) {
+	size_t size = strlen(str) + 1;
+	return memcpy(arena_alloc(arena, size), str, size);
+}
+
+char* arena_printf(arena_t* arena, char const* fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	int len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	char* str = arena_alloc(arena, len + 1);
+
+	va_start(args, fmt);
+	vsnprintf(str, len + 1, fmt, args);
+	va_end(args);
+
+	return str;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+// bump allocator for data which all shares the same lifetime
+// allocations are never freed individually, everything is released at once with 'arena_free'
+
+typedef struct arena_block_t arena_block_t;
+
+struct arena_block_t {
+	arena_block_t* prev;
+
+	size_t size;
+	size_t used;
+
+	_Alignas(16) char data[];
+};
+
+typedef struct {
+	arena_block_t* block; // current block, the ones before it are full
+	size_t block_size;
+
+	// last allocation, which can be grown in place
+
+	void* last;
+	size_t last_size;
+} arena_t;
+
+void arena_init(arena_t* arena, size_t block_size);
+void arena_free(arena_t* arena);
+
+void* arena_alloc(arena_t* arena, size_t size);
+void* arena_grow(arena_t* arena, void* ptr, size_t old_size, size_t new_size);
+
+char* arena_strdup(arena_t* arena, char const* str);
+char* arena_printf(arena_t* arena, char const* fmt, ...) __attribute__((format(printf, 2, 3)));
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// simple fixed-size bitsets, stored as arrays of 64-bit words
+// these are used all over the place for sets of services (indexed by 'service_t.index')
+
+typedef uint64_t bitset_word_t;
+
+#define BITSET_WORD_BITS 64
+
+static inline size_t bitset_words(size_t bits) {
+	return (bits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+}
+
+static inline bitset_word_t* bitset_new(size_t bits) {
+	return calloc(bitset_words(bits) ? bitset_words(bits) : 1, sizeof(bitset_word_t));
+}
+
+static inline void bitset_set(bitset_word_t* set, size_t bit) {
+	set[bit / BITSET_WORD_BITS] |= (bitset_word_t) 1 << (bit % BITSET_WORD_BITS);
+}
+
+static inline void bitset_clear(bitset_word_t* set, size_t bit) {
+	set[bit / BITSET_WORD_BITS] &= ~((bitset_word_t) 1 << (bit % BITSET_WORD_BITS));
+}
+
+static inline bool bitset_test(bitset_word_t const* set, size_t bit) {
+	return set[bit / BITSET_WORD_BITS] >> (bit % BITSET_WORD_BITS) & 1;
+}
+
+static inline size_t bitset_count(bitset_word_t const* set, size_t bits) {
+	size_t count = 0;
+
+	for (size_t i = 0; i < bitset_words(bits); i++) {
+		count += __builtin_popcountll(set[i]);
+	}
+
+	return count;
+}
@@ -0,0 +1,893 @@
+// 'service' command, for querying and interacting with init
+//
+// subcommands:
+//  - 'service history [-u] [-f ring file] [-n boots] [-t threshold] [service ...]': percentiles of each service's duration across the last boots, flagging services which regressed on the latest one (and their typical resource usage with '-u')
+//  - 'service start|stop|restart service ...': ask init to start, stop, or restart services
+//  - 'service status [service ...]': status of services (all of them if none are given), read straight from the status table init publishes in shared memory
+//  - 'service usage [service ...]': resources used by services so far (all of them if none are given), from the same table
+//  - 'service output service': latest output of a service
+//  - 'service graph': dependency graph in GraphViz format
+//  - 'service watch [-r] [-e event,...] [service ...]': follow lifecycle events of services as they happen (all of them if none are given)
+//  - 'service top [-d delay] [-n iterations] [service ...]': live view of the CPU and memory use of services (all running ones if none are given), as sampled by init
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <umber.h>
+#define UMBER_COMPONENT "SERVICE"
+
+#include "../history.h"
+#include "../libinit/subscribe.h"
+#include "../libinit/table.h"
+#include "../proto.h"
+#include "../strtab.h"
+
+#define FATAL_ERROR(...) \
+	LOG_FATAL(__VA_ARGS__); \
+	exit(EXIT_FAILURE);
+
+// regressions smaller than this are just noise, however large they are relative to the baseline
+
+#define REGRESSION_FLOOR 0.01
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: service history [-u] [-f ring file] [-n boots] [-t threshold] [service ...]\n"
+		"       service start|stop|restart service ...\n"
+		"       service status [service ...]\n"
+		"       service usage [service ...]\n"
+		"       service output service\n"
+		"       service graph\n"
+		"       service watch [-r] [-e event,...] [service ...]\n"
+		"       service top [-d delay] [-n iterations] [service ...]\n"
+	);
+
+	exit(EXIT_FAILURE);
+}
+
+static int cmp_float(void const* _a, void const* _b) {
+	float a = *(float const*) _a;
+	float b = *(float const*) _b;
+
+	return (a > b) - (a < b);
+}
+
+// nearest-rank percentile of a sorted array
+
+static float percentile(float const* sorted, size_t len, unsigned p) {
+	if (!len) {
+		return NAN;
+	}
+
+	size_t rank = (p * len + 99) / 100;
+	return sorted[rank ? rank - 1 : 0];
+}
+
+static float median(float* samples, size_t len) {
+	qsort(samples, len, sizeof *samples, cmp_float);
+	return percentile(samples, len, 50);
+}
+
+// whether a service is wanted, if we were given a list of services
+
+static bool wanted(int argc, char* argv[], char const* name) {
+	if (optind >= argc) {
+		return true;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (!strcmp(argv[i], name)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int history(int argc, char* argv[]) {
+	char const* path = HISTORY_PATH;
+	size_t max = 20;
+	float threshold = 0.25; // fraction over the median of previous boots a service's latest duration must be to count as a regression
+	bool show_usage = false;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "f:n:t:u")) != -1) {
+		if (c == 'f') {
+			path = optarg;
+		}
+
+		else if (c == 'u') {
+			show_usage = true;
+		}
+
+		else if (c == 'n') {
+			max = strtoul(optarg, NULL, 10);
+		}
+
+		else if (c == 't') {
+			threshold = strtof(optarg, NULL);
+		}
+
+		else {
+			usage();
+		}
+	}
+
+	if (!max) {
+		usage();
+	}
+
+	history_boot_t* boots;
+	ssize_t boots_len = history_read(path, max, &boots);
+
+	if (boots_len < 0) {
+		FATAL_ERROR("Couldn't open boot history at '%s': %s", path, strerror(errno))
+	}
+
+	if (!boots_len) {
+		LOG_WARN("No boots recorded in '%s' yet", path)
+		history_boots_free(boots_len, boots);
+
+		return EXIT_SUCCESS;
+	}
+
+	// boots, latest first
+
+	printf("Last %zd boot(s):\n", boots_len);
+
+	for (ssize_t i = 0; i < boots_len; i++) {
+		history_boot_t* boot = &boots[i];
+
+		time_t time = boot->time;
+		char date[64];
+		strftime(date, sizeof date, "%Y-%m-%d %H:%M:%S", localtime(&time));
+
+		size_t failed = 0;
+
+		for (size_t j = 0; j < boot->services_len; j++) {
+			failed += boot->services[j].state == SERVICE_STATE_FAILED;
+		}
+
+		printf("  #%-6" PRIu64 " %s  %8.3f s  %5zu services  %zu failed\n", boot->seq, date, boot->phases[HISTORY_PHASE_RUN], boot->services_len, failed);
+	}
+
+	// init phases
+
+	float* samples = malloc(boots_len * sizeof *samples);
+
+	printf("\n%-24s %10s %10s %10s %10s\n", "phase", "p50", "p90", "p99", "max");
+
+	for (size_t phase = 0; phase < HISTORY_PHASE_COUNT; phase++) {
+		for (ssize_t i = 0; i < boots_len; i++) {
+			samples[i] = boots[i].phases[phase];
+		}
+
+		qsort(samples, boots_len, sizeof *samples, cmp_float);
+		printf("%-24s %10.3f %10.3f %10.3f %10.3f\n", history_phase_names[phase], percentile(samples, boots_len, 50), percentile(samples, boots_len, 90), percentile(samples, boots_len, 99), samples[boots_len - 1]);
+	}
+
+	// gather up the durations of each service across boots, by name (services may come and go from one boot to the next)
+	// 'durations' is a matrix of services by boots, with NANs for boots a service wasn't started on
+
+	strtab_t names;
+	strtab_init(&names);
+
+	for (ssize_t i = 0; i < boots_len; i++) {
+		for (size_t j = 0; j < boots[i].services_len; j++) {
+			strtab_intern(&names, boots[i].services[j].name);
+		}
+	}
+
+	float* durations = malloc((names.len ? names.len : 1) * boots_len * sizeof *durations);
+	history_service_t** entries = calloc((names.len ? names.len : 1) * boots_len, sizeof *entries);
+
+	for (size_t i = 0; i < names.len * boots_len; i++) {
+		durations[i] = NAN;
+	}
+
+	for (ssize_t i = 0; i < boots_len; i++) {
+		for (size_t j = 0; j < boots[i].services_len; j++) {
+			history_service_t* service = &boots[i].services[j];
+			size_t cell = strtab_find(&names, service->name) * boots_len + i;
+
+			durations[cell] = service->duration;
+			entries[cell] = service;
+		}
+	}
+
+	// per-service percentiles, and whether the latest boot regressed compared to the median of the ones before it
+
+	printf("\n%-24s %6s %10s %10s %10s %10s %10s\n", "service", "boots", "p50", "p90", "p99", "max", "latest");
+
+	size_t regressed = 0;
+
+	for (uint32_t id = 0; id < names.len; id++) {
+		char const* name = strtab_str(&names, id);
+
+		// if we were given services, only show those
+
+		if (!wanted(argc, argv, name)) {
+			continue;
+		}
+
+		float* row = &durations[id * boots_len];
+		float latest = row[0];
+
+		size_t samples_len = 0;
+
+		for (ssize_t i = 1; i < boots_len; i++) {
+			if (!isnan(row[i])) {
+				samples[samples_len++] = row[i];
+			}
+		}
+
+		qsort(samples, samples_len, sizeof *samples, cmp_float);
+		float baseline = percentile(samples, samples_len, 50);
+
+		bool regression = !isnan(latest) && !isnan(baseline) && latest > baseline * (1 + threshold) && latest - baseline > REGRESSION_FLOOR;
+		regressed += regression;
+
+		// percentiles are over all boots, including the latest one
+
+		if (!isnan(latest)) {
+			samples[samples_len++] = latest;
+			qsort(samples, samples_len, sizeof *samples, cmp_float);
+		}
+
+		printf("%-24s %6zu %10.3f %10.3f %10.3f %10.3f %10.3f%s\n", name, samples_len, percentile(samples, samples_len, 50), percentile(samples, samples_len, 90), percentile(samples, samples_len, 99), samples_len ? samples[samples_len - 1] : NAN, latest, regression ? "  REGRESSED" : "");
+	}
+
+	// median resource usage of each service, over the boots it was recorded on
+	// the CPU share is the fraction of the service's duration it spent on-CPU, so services which spent most of theirs waiting (on I/O, mostly) stand out
+
+	if (show_usage) {
+		printf("\n%-24s %6s %10s %10s %6s %10s %10s %10s %10s %10s\n", "service", "boots", "user", "sys", "cpu%", "maxrss", "inblock", "oublock", "vcsw", "ivcsw");
+
+		float m[8];
+		size_t const metrics_len = sizeof m / sizeof *m;
+
+		float* metrics = malloc(metrics_len * boots_len * sizeof *metrics);
+
+		for (uint32_t id = 0; id < names.len; id++) {
+			char const* name = strtab_str(&names, id);
+
+			if (!wanted(argc, argv, name)) {
+				continue;
+			}
+
+			size_t len = 0;
+
+			for (ssize_t i = 0; i < boots_len; i++) {
+				history_service_t* service = entries[id * boots_len + i];
+
+				// any process reaped has a resident set, so boots without one are boots recorded before resource usage was
+
+				if (!service || !service->usage.maxrss) {
+					continue;
+				}
+
+				usage_t* usage = &service->usage;
+				float cpu = service->duration > 0 ? 100 * (usage->utime + usage->stime) / service->duration : NAN;
+
+				float const values[] = { usage->utime, usage->stime, cpu, usage->maxrss / 1024., usage->inblock, usage->oublock, usage->nvcsw, usage->nivcsw };
+
+				for (size_t j = 0; j < metrics_len; j++) {
+					metrics[j * boots_len + len] = values[j];
+				}
+
+				len++;
+			}
+
+			if (!len) {
+				continue;
+			}
+
+			for (size_t j = 0; j < metrics_len; j++) {
+				m[j] = median(&metrics[j * boots_len], len);
+			}
+
+			printf("%-24s %6zu %10.3f %10.3f %6.1f %8.1fMi %10.0f %10.0f %10.0f %10.0f\n", name, len, m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7]);
+		}
+
+		free(metrics);
+	}
+
+	if (regressed) {
+		LOG_WARN("%zu service(s) regressed by more than %.0f%% on the latest boot compared to the median of the %zd boot(s) before it", regressed, threshold * 100, boots_len - 1)
+	}
+
+	free(samples);
+	free(durations);
+	free(entries);
+	strtab_free(&names);
+
+	history_boots_free(boots_len, boots);
+	return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// control requests to init
+
+#define RESPONSE_TIMEOUT 5 // seconds
+
+static char const* state_names[] = {
+	[SERVICE_STATE_INACTIVE] = "inactive",
+	[SERVICE_STATE_WAITING]  = "waiting",
+	[SERVICE_STATE_RUNNING]  = "running",
+	[SERVICE_STATE_DONE]     = "done",
+	[SERVICE_STATE_FAILED]   = "failed",
+};
+
+static char const* err_names[] = {
+	[PROTO_OK]                  = "ok",
+	[PROTO_ERR_BAD_REQUEST]     = "bad request",
+	[PROTO_ERR_VERSION]         = "unsupported protocol version",
+	[PROTO_ERR_UNKNOWN_SERVICE] = "unknown service",
+	[PROTO_ERR_RUNNING]         = "already running",
+	[PROTO_ERR_NOT_RUNNING]     = "not running",
+	[PROTO_ERR_UNSUPPORTED]     = "unsupported",
+	[PROTO_ERR_FAILED]          = "failed",
+	[PROTO_ERR_PERM]            = "permission denied (must be root or in the service group)",
+};
+
+static char const* err_name(unsigned err) {
+	return err < sizeof err_names / sizeof *err_names ? err_names[err] : "unknown error";
+}
+
+// connection to init's control socket, shared by all the requests we make
+
+static int sock = -1;
+
+static void connect_init(void) {
+	if (sock >= 0) {
+		return;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, PROTO_SOCK_PATH, sizeof addr.sun_path - 1);
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+	if (sock < 0) {
+		FATAL_ERROR("socket: %s", strerror(errno))
+	}
+
+	if (connect(sock, (struct sockaddr*) &addr, sizeof addr) < 0) {
+		FATAL_ERROR("connect(\"" PROTO_SOCK_PATH "\"): %s (is init running?)", strerror(errno))
+	}
+
+	struct timeval timeout = { .tv_sec = RESPONSE_TIMEOUT };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+}
+
+static void send_request(proto_cmd_t cmd, uint32_t id, size_t count, char* names[]) {
+	connect_init();
+
+	proto_req_msg_t req;
+	memset(&req, 0, sizeof req);
+
+	req.header = (proto_req_t) {
+		.magic = PROTO_MAGIC,
+		.version = PROTO_VERSION,
+		.cmd = cmd,
+		.id = id,
+		.count = count,
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		strncpy(req.names[i], names[i], PROTO_NAME_LEN - 1);
+	}
+
+	if (send(sock, &req, sizeof req.header + count * PROTO_NAME_LEN, MSG_EOR) < 0) {
+		FATAL_ERROR("send: %s", strerror(errno))
+	}
+}
+
+// wait for a single response to the request with the given ID
+// returns the length of the response
+
+static size_t recv_response(uint32_t id, proto_res_msg_t* res) {
+	ssize_t len = recv(sock, res, sizeof *res, 0);
+
+	if (len < 0) {
+		FATAL_ERROR("Didn't get a response from init: %s", strerror(errno))
+	}
+
+	if (!len) {
+		FATAL_ERROR("init closed the connection")
+	}
+
+	if ((size_t) len < sizeof res->header || res->header.magic != PROTO_MAGIC || res->header.id != id) {
+		FATAL_ERROR("Got a malformed response from init")
+	}
+
+	if (res->header.err) {
+		FATAL_ERROR("Request failed: %s", err_name(res->header.err))
+	}
+
+	return len;
+}
+
+// send a request for a batch of services, and wait for the response
+// returns the length of the response
+
+static size_t request(proto_cmd_t cmd, size_t count, char* names[], proto_res_msg_t* res) {
+	static uint32_t id = 0;
+
+	send_request(cmd, ++id, count, names);
+	return recv_response(id, res);
+}
+
+// send a request whose response is streamed back, and write it all out to 'fp'
+
+static void request_stream(proto_cmd_t cmd, size_t count, char* names[], FILE* fp) {
+	proto_res_msg_t res;
+	size_t len = request(cmd, count, names, &res);
+
+	for (;;) {
+		if (len < sizeof res.header + res.header.count) {
+			FATAL_ERROR("Got a truncated response from init")
+		}
+
+		fwrite(res.payload, 1, res.header.count, fp);
+
+		if (!(res.header.flags & PROTO_RES_MORE)) {
+			break;
+		}
+
+		len = recv_response(res.header.id, &res);
+	}
+}
+
+static char const* state_name(unsigned state) {
+	return state < sizeof state_names / sizeof *state_names ? state_names[state] : "unknown";
+}
+
+// status of services, read from the status table init publishes in shared memory without going through init at all
+// returns -1 if there's no table to read from
+
+static int table_status(size_t names_len, char* names[]) {
+	table_view_t view;
+
+	if (table_view_open(&view) < 0) {
+		return -1;
+	}
+
+	size_t services_len = view.header->services_len;
+	table_service_t* services = malloc((services_len ? services_len : 1) * sizeof *services);
+
+	table_view_snapshot(&view, services);
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	double now = ts.tv_sec + 1.e-9 * ts.tv_nsec;
+
+	// no names means every service
+
+	int rv = EXIT_SUCCESS;
+	size_t count = names_len ? names_len : services_len;
+
+	for (size_t i = 0; i < count; i++) {
+		ssize_t index = names_len ? table_view_search(&view, names[i]) : (ssize_t) i;
+		char const* name = names_len ? names[i] : view.entries[i].name;
+
+		if (index < 0) {
+			printf("%-24s %s\n", name, err_name(PROTO_ERR_UNKNOWN_SERVICE));
+			rv = EXIT_FAILURE;
+
+			continue;
+		}
+
+		table_service_t* service = &services[index];
+		printf("%-24s %-8s", name, state_name(service->state));
+
+		if (service->pid) {
+			printf(" pid %-7d", service->pid);
+		}
+
+		if (service->state >= SERVICE_STATE_RUNNING) {
+			bool running = service->state == SERVICE_STATE_RUNNING;
+			printf(" started %.3fs ago, %s %.3fs", now - service->start_time, running ? "running for" : "took", (running ? now : service->exit_time) - service->start_time);
+		}
+
+		if (service->state > SERVICE_STATE_RUNNING && service->exit_code) {
+			printf(service->exit_code < 0 ? ", killed by a signal" : ", exited with %d", service->exit_code);
+		}
+
+		if (service->restarts) {
+			printf(", restarted %u time%s", service->restarts, service->restarts == 1 ? "" : "s");
+		}
+
+		printf("\n");
+	}
+
+	free(services);
+	table_view_close(&view);
+
+	return rv;
+}
+
+// resources used so far by services, from the same table
+
+static int resource_usage(int argc, char* argv[]) {
+	table_view_t view;
+
+	if (table_view_open(&view) < 0) {
+		FATAL_ERROR("Couldn't open status table '" TABLE_SHM_NAME "': %s (is init running?)", strerror(errno))
+	}
+
+	size_t services_len = view.header->services_len;
+	table_service_t* services = malloc((services_len ? services_len : 1) * sizeof *services);
+
+	table_view_snapshot(&view, services);
+
+	size_t names_len = argc - 1;
+	char** names = argv + 1;
+
+	int rv = EXIT_SUCCESS;
+	size_t count = names_len ? names_len : services_len;
+
+	printf("%-24s %10s %10s %10s %10s %10s %10s %10s\n", "service", "user", "sys", "maxrss", "inblock", "oublock", "vcsw", "ivcsw");
+
+	for (size_t i = 0; i < count; i++) {
+		ssize_t index = names_len ? table_view_search(&view, names[i]) : (ssize_t) i;
+		char const* name = names_len ? names[i] : view.entries[i].name;
+
+		if (index < 0) {
+			printf("%-24s %s\n", name, err_name(PROTO_ERR_UNKNOWN_SERVICE));
+			rv = EXIT_FAILURE;
+
+			continue;
+		}
+
+		table_service_t* service = &services[index];
+
+		// services which have never had a process reaped have nothing to show (when listing all of them)
+
+		if (!names_len && !service->maxrss) {
+			continue;
+		}
+
+		printf("%-24s %10.3f %10.3f %8.1fMi %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n", name, service->utime, service->stime, service->maxrss / 1024., service->inblock, service->oublock, service->nvcsw, service->nivcsw);
+	}
+
+	free(services);
+	table_view_close(&view);
+
+	return rv;
+}
+
+static int control(proto_cmd_t cmd, int argc, char* argv[]) {
+	if (cmd == PROTO_CMD_STATUS) {
+		int rv = table_status(argc - 1, argv + 1);
+
+		if (rv >= 0) {
+			return rv;
+		}
+
+		// no status table (e.g. init couldn't create one), so fall back to asking init
+	}
+
+	if (cmd == PROTO_CMD_EXPORT) {
+		if (argc != 1) {
+			usage();
+		}
+
+		request_stream(cmd, 0, NULL, stdout);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc < 2) {
+		usage();
+	}
+
+	size_t names_len = argc - 1;
+	char** names = argv + 1;
+
+	if (cmd == PROTO_CMD_OUTPUT) {
+		if (names_len != 1) {
+			usage();
+		}
+
+		request_stream(cmd, 1, names, stdout);
+		return EXIT_SUCCESS;
+	}
+
+	// send the services in as few batches as possible
+
+	int rv = EXIT_SUCCESS;
+
+	for (size_t off = 0; off < names_len; off += PROTO_MAX_NAMES) {
+		size_t count = names_len - off < PROTO_MAX_NAMES ? names_len - off : PROTO_MAX_NAMES;
+
+		proto_res_msg_t res;
+		size_t len = request(cmd, count, names + off, &res);
+
+		if (res.header.count != count || len < sizeof res.header + count * sizeof *res.entries) {
+			FATAL_ERROR("Got a truncated response from init")
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			proto_entry_t* entry = &res.entries[i];
+
+			if (entry->err) {
+				printf("%-24s %s\n", names[off + i], err_name(entry->err));
+				rv = EXIT_FAILURE;
+
+				continue;
+			}
+
+			printf("%-24s %-8s", names[off + i], state_name(entry->state));
+
+			if (entry->pid) {
+				printf(" pid %-7d", entry->pid);
+			}
+
+			if (entry->state >= SERVICE_STATE_RUNNING) {
+				printf(" started %.3fs ago, %s %.3fs", entry->age, entry->state == SERVICE_STATE_RUNNING ? "running for" : "took", entry->duration);
+			}
+
+			printf("\n");
+		}
+	}
+
+	return rv;
+}
+
+// following events
+
+static char const* event_names[PROTO_EVENT_COUNT] = {
+	[PROTO_EVENT_STARTED]   = "started",
+	[PROTO_EVENT_RESTARTED] = "restarted",
+	[PROTO_EVENT_READY]     = "ready",
+	[PROTO_EVENT_FAILED]    = "failed",
+	[PROTO_EVENT_EXITED]    = "exited",
+	[PROTO_EVENT_UNHEALTHY] = "unhealthy",
+};
+
+static uint16_t parse_events(char* list) {
+	uint16_t mask = 0;
+
+	for (char* tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+		size_t type;
+
+		for (type = 0; type < PROTO_EVENT_COUNT; type++) {
+			if (!strcmp(tok, event_names[type])) {
+				break;
+			}
+		}
+
+		if (type == PROTO_EVENT_COUNT) {
+			FATAL_ERROR("Unknown event '%s' (expected started, restarted, ready, failed, or exited)", tok)
+		}
+
+		mask |= 1 << type;
+	}
+
+	return mask;
+}
+
+static int watch(int argc, char* argv[]) {
+	bool replay = false;
+	uint16_t mask = 0;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "e:r")) != -1) {
+		if (c == 'e') {
+			mask |= parse_events(optarg);
+		}
+
+		else if (c == 'r') {
+			// start with the events init still remembers (e.g. from the boot) rather than just new ones
+
+			replay = true;
+		}
+
+		else {
+			usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if ((size_t) argc > PROTO_MAX_NAMES) {
+		FATAL_ERROR("Can't watch more than %zu services at once", PROTO_MAX_NAMES)
+	}
+
+	subscription_t sub;
+
+	if (subscription_open(&sub, argc, (char const* const*) argv, mask, replay) < 0) {
+		FATAL_ERROR("Couldn't subscribe to events: %s%s", strerror(errno), errno == ENOENT ? "" : " (is init running?)")
+	}
+
+	uint64_t last_seq = 0;
+	proto_event_t events[PROTO_MAX_EVENTS];
+	ssize_t count;
+
+	// follow events line-by-line, so this can be piped into other tools
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	while ((count = subscription_read(&sub, events)) >= 0) {
+		for (ssize_t i = 0; i < count; i++) {
+			proto_event_t* event = &events[i];
+
+			// events are only filtered out if we asked for that, so a gap otherwise means we fell behind
+
+			if (!argc && !mask && last_seq && event->seq > last_seq + 1) {
+				printf("(missed %" PRIu64 " events)\n", event->seq - last_seq - 1);
+			}
+
+			last_seq = event->seq;
+
+			char const* type = event->type < PROTO_EVENT_COUNT ? event_names[event->type] : "unknown";
+			printf("%12.3f %-24s %-9s pid %d", event->time, event->name, type, event->pid);
+
+			if (event->type >= PROTO_EVENT_READY && event->type <= PROTO_EVENT_EXITED && event->exit_code) {
+				printf(event->exit_code < 0 ? " killed by a signal" : " exited with %d", event->exit_code);
+			}
+
+			printf("\n");
+		}
+	}
+
+	subscription_close(&sub);
+	FATAL_ERROR("Lost connection to init: %s", strerror(errno))
+}
+
+// live view of CPU and memory use
+
+static int cmp_top(void const* _a, void const* _b) {
+	proto_top_t const* a = _a;
+	proto_top_t const* b = _b;
+
+	return (a->cpu < b->cpu) - (a->cpu > b->cpu);
+}
+
+static int top(int argc, char* argv[]) {
+	double delay = 2;
+	size_t iterations = 0; // forever
+
+	int c;
+
+	while ((c = getopt(argc, argv, "d:n:")) != -1) {
+		if (c == 'd') {
+			delay = strtod(optarg, NULL);
+		}
+
+		else if (c == 'n') {
+			iterations = strtoul(optarg, NULL, 10);
+		}
+
+		else {
+			usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if ((size_t) argc > PROTO_MAX_NAMES) {
+		FATAL_ERROR("Can't show more than %zu services at once (leave them out to show all of them)", PROTO_MAX_NAMES)
+	}
+
+	if (delay <= 0) {
+		usage();
+	}
+
+	// only clear the screen between iterations if someone's actually looking at it
+
+	bool tty = isatty(STDOUT_FILENO);
+
+	size_t tops_len = 0;
+	proto_top_t* tops = NULL;
+
+	for (size_t iteration = 0; !iterations || iteration < iterations; iteration++) {
+		if (iteration) {
+			struct timespec ts = { .tv_sec = delay, .tv_nsec = (delay - (time_t) delay) * 1e9 };
+			nanosleep(&ts, NULL);
+		}
+
+		// gather up the records of all services, which may come over several responses
+
+		proto_res_msg_t res;
+		size_t len = request(PROTO_CMD_TOP, argc, argv, &res);
+
+		tops_len = 0;
+
+		for (;;) {
+			size_t count = res.header.count;
+
+			if (count > PROTO_MAX_TOPS || len < sizeof res.header + count * sizeof *res.tops) {
+				FATAL_ERROR("Got a truncated response from init")
+			}
+
+			tops = realloc(tops, (tops_len + count) * sizeof *tops);
+			memcpy(&tops[tops_len], res.tops, count * sizeof *tops);
+			tops_len += count;
+
+			if (!(res.header.flags & PROTO_RES_MORE)) {
+				break;
+			}
+
+			len = recv_response(res.header.id, &res);
+		}
+
+		qsort(tops, tops_len, sizeof *tops, cmp_top);
+
+		if (tty) {
+			printf("\033[H\033[2J");
+		}
+
+		printf("%-24s %-8s %6s %7s %7s %7s %10s %10s\n", "service", "state", "procs", "cpu%", "avg%", "max%", "rss", "maxrss");
+
+		for (size_t i = 0; i < tops_len; i++) {
+			proto_top_t* entry = &tops[i];
+			entry->name[PROTO_NAME_LEN - 1] = '\0';
+
+			// services with nothing running have nothing to show (when listing all of them)
+
+			if (!argc && !entry->procs) {
+				continue;
+			}
+
+			printf("%-24s %-8s %6u %7.1f %7.1f %7.1f %8.1fMi %8.1fMi\n", entry->name, state_name(entry->state), entry->procs, entry->cpu * 100, entry->cpu_avg * 100, entry->cpu_max * 100, entry->rss / 1024., entry->rss_max / 1024.);
+		}
+
+		fflush(stdout);
+	}
+
+	free(tops);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		usage();
+	}
+
+	char const* cmd = argv[1];
+
+	if (!strcmp(cmd, "history")) {
+		return history(argc - 1, argv + 1);
+	}
+
+	if (!strcmp(cmd, "watch")) {
+		return watch(argc - 1, argv + 1);
+	}
+
+	if (!strcmp(cmd, "top")) {
+		return top(argc - 1, argv + 1);
+	}
+
+	if (!strcmp(cmd, "usage")) {
+		return resource_usage(argc - 1, argv + 1);
+	}
+
+	proto_cmd_t proto_cmd =
+		!strcmp(cmd, "start")   ? PROTO_CMD_START :
+		!strcmp(cmd, "stop")    ? PROTO_CMD_STOP :
+		!strcmp(cmd, "restart") ? PROTO_CMD_RESTART :
+		!strcmp(cmd, "status")  ? PROTO_CMD_STATUS :
+		!strcmp(cmd, "output")  ? PROTO_CMD_OUTPUT :
+		!strcmp(cmd, "graph")   ? PROTO_CMD_EXPORT : 0;
+
+	if (proto_cmd) {
+		return control(proto_cmd, argc - 1, argv + 1);
+	}
+
+	LOG_ERROR("Unknown subcommand '%s'", cmd)
+	usage();
+}
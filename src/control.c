@@ -0,0 +1,712 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(__FreeBSD__)
+#include <sys/ucred.h>
+#endif
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "control.h"
+#include "log.h"
+#include "timing.h"
+
+#define MAX_PEER_GROUPS 256
+
+static int sock_addr(char const* path, struct sockaddr_un* addr) {
+	memset(addr, 0, sizeof *addr);
+	addr->sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof addr->sun_path) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+bool control_running(char const* path) {
+	struct sockaddr_un addr;
+
+	if (sock_addr(path, &addr) < 0) {
+		return false;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	// a stale socket left behind by a previous instance refuses connections
+
+	bool running = connect(fd, (struct sockaddr*) &addr, sizeof addr) == 0;
+	close(fd);
+
+	return running;
+}
+
+void control_init(control_t* control, sched_t* sched, output_t* output, char const* path, gid_t gid) {
+	memset(control, 0, sizeof *control);
+
+	control->sched = sched;
+	control->output = output;
+
+	control->path = path;
+	control->gid = gid;
+
+	control->sock = -1;
+	control->buf = malloc(OUTPUT_RING_SIZE);
+}
+
+int control_listen(control_t* control) {
+	struct sockaddr_un addr;
+
+	if (sock_addr(control->path, &addr) < 0) {
+		return -1;
+	}
+
+	int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (sock < 0) {
+		return -1;
+	}
+
+	// anyone may connect, what they're allowed to do is decided by their credentials
+
+	if (
+		(unlink(control->path) < 0 && errno != ENOENT) ||
+		bind(sock, (struct sockaddr*) &addr, sizeof addr) < 0 ||
+		chmod(control->path, 0666) < 0 ||
+		listen(sock, CONTROL_BACKLOG) < 0
+	) {
+		int err = errno;
+		close(sock);
+		errno = err;
+
+		return -1;
+	}
+
+	control->sock = sock;
+	return 0;
+}
+
+// check the credentials the kernel recorded for the peer when it connected
+
+static bool peer_privileged(control_t const* control, int fd) {
+#if defined(__FreeBSD__)
+	struct xucred cred;
+	socklen_t len = sizeof cred;
+
+	if (getsockopt(fd, SOL_LOCAL, LOCAL_PEERCRED, &cred, &len) < 0 || cred.cr_version != XUCRED_VERSION) {
+		LOG_WARN("getsockopt(LOCAL_PEERCRED): %s", strerror(errno))
+		return false;
+	}
+
+	if (!cred.cr_uid) {
+		return true;
+	}
+
+	for (int i = 0; i < cred.cr_ngroups; i++) {
+		if (cred.cr_groups[i] == control->gid) {
+			return true;
+		}
+	}
+
+	return false;
+#else
+	struct ucred cred;
+	socklen_t len = sizeof cred;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+		LOG_WARN("getsockopt(SO_PEERCRED): %s", strerror(errno))
+		return false;
+	}
+
+	if (!cred.uid || cred.gid == control->gid) {
+		return true;
+	}
+
+	gid_t groups[MAX_PEER_GROUPS];
+	len = sizeof groups;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len) < 0) {
+		LOG_WARN("getsockopt(SO_PEERGROUPS): %s", strerror(errno))
+		return false;
+	}
+
+	for (size_t i = 0; i < len / sizeof *groups; i++) {
+		if (groups[i] == control->gid) {
+			return true;
+		}
+	}
+
+	return false;
+#endif
+}
+
+static void accept_clients(control_t* control) {
+	while (control->clients_len < CONTROL_MAX_CLIENTS) {
+		int fd = accept4(control->sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+				LOG_WARN("accept4: %s", strerror(errno))
+			}
+
+			return;
+		}
+
+		control->clients[control->clients_len++] = (control_client_t) {
+			.fd = fd,
+			.privileged = peer_privileged(control, fd),
+		};
+	}
+}
+
+static void drop_client(control_t* control, size_t index) {
+	control_client_t* client = &control->clients[index];
+
+	free(client->filter);
+
+	for (size_t i = client->pending_head; i < client->pending_len; i++) {
+		free(client->pending[i].data);
+	}
+
+	free(client->pending);
+	close(client->fd);
+
+	*client = control->clients[--control->clients_len];
+}
+
+// send as many of a client's pending responses as it'll take
+// returns -1 if the client should be dropped
+
+static int flush_client(control_client_t* client) {
+	while (client->pending_head < client->pending_len) {
+		control_msg_t* msg = &client->pending[client->pending_head];
+
+		if (send(client->fd, msg->data, msg->len, MSG_NOSIGNAL | MSG_EOR) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		free(msg->data);
+		client->pending_head++;
+	}
+
+	client->pending_head = 0;
+	client->pending_len = 0;
+
+	return 0;
+}
+
+static void respond(control_client_t* client, proto_res_msg_t const* res, size_t len) {
+	// send directly if nothing is queued up before this response
+
+	if (client->pending_head == client->pending_len) {
+		if (send(client->fd, res, len, MSG_NOSIGNAL | MSG_EOR) == (ssize_t) len) {
+			return;
+		}
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			return; // client is gone, which we'll notice when reading from it
+		}
+	}
+
+	// otherwise, queue it up to be sent when the client is writable again
+
+	client->pending = realloc(client->pending, (client->pending_len + 1) * sizeof *client->pending);
+
+	client->pending[client->pending_len++] = (control_msg_t) {
+		.len = len,
+		.data = memcpy(malloc(len), res, len),
+	};
+}
+
+// split a payload too large for a single response over as many as it takes
+
+static void stream(control_client_t* client, proto_res_msg_t* res, char const* payload, size_t len) {
+	do {
+		size_t chunk = len < PROTO_MAX_PAYLOAD ? len : PROTO_MAX_PAYLOAD;
+
+		res->header.count = chunk;
+		res->header.flags = chunk < len ? PROTO_RES_MORE : 0;
+
+		memcpy(res->payload, payload, chunk);
+		respond(client, res, sizeof res->header + chunk);
+
+		payload += chunk;
+		len -= chunk;
+	} while (len);
+}
+
+// send a subscriber the events it hasn't been sent yet (and is interested in)
+// only one message's worth of events is ever queued up for a subscriber, so that a slow one costs a bounded amount of memory
+
+static void deliver(control_t* control, control_client_t* client) {
+	events_t const* events = control->sched->events;
+	graph_t const* graph = control->sched->graph;
+
+	if (!client->subscribed) {
+		return;
+	}
+
+	// if the subscriber fell so far behind that events it hasn't been sent were overwritten, skip ahead (it'll notice the gap in the numbering)
+
+	uint64_t tail = events_tail(events);
+
+	if (client->cursor < tail) {
+		client->cursor = tail;
+	}
+
+	while (client->cursor < events->head && client->pending_head == client->pending_len) {
+		proto_res_msg_t res;
+
+		res.header = (proto_res_t) {
+			.magic = PROTO_MAGIC,
+			.version = PROTO_VERSION,
+			.cmd = PROTO_CMD_EVENTS,
+		};
+
+		size_t count = 0;
+
+		for (; client->cursor < events->head && count < PROTO_MAX_EVENTS; client->cursor++) {
+			event_t const* event = events_get(events, client->cursor);
+
+			if (!(client->event_mask & 1 << event->type) || (client->filter && !bitset_test(client->filter, event->service))) {
+				continue;
+			}
+
+			proto_event_t* out = &res.events[count++];
+			memset(out, 0, sizeof *out);
+
+			out->seq = event->seq;
+			out->time = event->time;
+			out->type = event->type;
+			out->pid = event->pid;
+			out->exit_code = event->exit_code;
+
+			strncpy(out->name, graph_name(graph, event->service), sizeof out->name - 1);
+		}
+
+		if (!count) {
+			break;
+		}
+
+		res.header.count = count;
+		respond(client, &res, sizeof res.header + count * sizeof *res.events);
+	}
+}
+
+static proto_err_t err_from_errno(void) {
+	return
+		errno == EALREADY ? PROTO_ERR_RUNNING :
+		errno == ESRCH ? PROTO_ERR_NOT_RUNNING :
+		PROTO_ERR_FAILED;
+}
+
+static void fill_entry(sched_t const* sched, uint32_t service, proto_entry_t* entry) {
+	long double now = __get_time();
+	uint8_t state = sched->states[service];
+
+	entry->state = state;
+	entry->pid = state == SERVICE_STATE_RUNNING ? sched->pids[service] : 0;
+
+	if (state < SERVICE_STATE_RUNNING) {
+		return;
+	}
+
+	entry->age = now - sched->start_times[service];
+	entry->duration = state == SERVICE_STATE_RUNNING ? entry->age : sched->total_times[service];
+}
+
+static void handle(control_t* control, control_client_t* client, void const* msg, size_t len) {
+	sched_t* sched = control->sched;
+	graph_t const* graph = sched->graph;
+
+	proto_req_msg_t req;
+	proto_res_msg_t res;
+
+	memset(&req, 0, sizeof req);
+	memset(&res, 0, sizeof res.header);
+
+	memcpy(&req, msg, len < sizeof req ? len : sizeof req);
+
+	res.header = (proto_res_t) {
+		.magic = PROTO_MAGIC,
+		.version = PROTO_VERSION,
+		.cmd = req.header.cmd,
+		.id = req.header.id,
+	};
+
+	// sanity checks on the request as a whole
+
+	if (len < sizeof req.header || req.header.magic != PROTO_MAGIC) {
+		res.header.err = PROTO_ERR_BAD_REQUEST;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	if (req.header.version != PROTO_VERSION) {
+		res.header.err = PROTO_ERR_VERSION;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	size_t count = req.header.count;
+
+	if (count > PROTO_MAX_NAMES || len < sizeof req.header + count * PROTO_NAME_LEN) {
+		res.header.err = PROTO_ERR_BAD_REQUEST;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	// only privileged clients may act on services, or read their output (which may well contain secrets)
+
+	proto_cmd_t cmd = req.header.cmd;
+	bool mutates = cmd == PROTO_CMD_START || cmd == PROTO_CMD_STOP || cmd == PROTO_CMD_RESTART || cmd == PROTO_CMD_RUN_CMD;
+	bool sensitive = cmd == PROTO_CMD_OUTPUT;
+
+	if ((mutates || sensitive) && !client->privileged) {
+		res.header.err = PROTO_ERR_PERM;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	// commands not acting on any service
+
+	if (cmd == PROTO_CMD_EXPORT) {
+		char* buf = NULL;
+		size_t buf_len = 0;
+
+		FILE* fp = open_memstream(&buf, &buf_len);
+
+		if (!fp) {
+			LOG_WARN("open_memstream: %s", strerror(errno))
+
+			res.header.err = PROTO_ERR_FAILED;
+			respond(client, &res, sizeof res.header);
+
+			return;
+		}
+
+		graph_export(graph, fp);
+		fclose(fp);
+
+		stream(client, &res, buf, buf_len);
+		free(buf);
+
+		return;
+	}
+
+	// look up every service named
+
+	uint32_t services[PROTO_MAX_NAMES];
+
+	for (size_t i = 0; i < count; i++) {
+		req.names[i][PROTO_NAME_LEN - 1] = '\0';
+		services[i] = graph_search(graph, req.names[i]);
+	}
+
+	// subscription to the events of the services named (or all of them if none are)
+	// this replaces whatever subscription the client had before
+
+	if (cmd == PROTO_CMD_SUBSCRIBE) {
+		if (!sched->events) {
+			res.header.err = PROTO_ERR_UNSUPPORTED;
+			respond(client, &res, sizeof res.header);
+
+			return;
+		}
+
+		bitset_word_t* filter = NULL;
+
+		if (count) {
+			filter = bitset_new(sched->services_len);
+
+			for (size_t i = 0; i < count; i++) {
+				if (services[i] == GRAPH_NONE) {
+					free(filter);
+
+					res.header.err = PROTO_ERR_UNKNOWN_SERVICE;
+					respond(client, &res, sizeof res.header);
+
+					return;
+				}
+
+				bitset_set(filter, services[i]);
+			}
+		}
+
+		uint16_t flags = req.header.flags;
+
+		free(client->filter);
+
+		client->subscribed = true;
+		client->event_mask = flags & PROTO_SUB_TYPES ? flags & PROTO_SUB_TYPES : PROTO_SUB_TYPES;
+		client->cursor = flags & PROTO_SUB_REPLAY ? events_tail(sched->events) : sched->events->head;
+		client->filter = filter;
+
+		respond(client, &res, sizeof res.header);
+		return;
+	}
+
+	// CPU and memory use of the services named (or all of them if none are)
+
+	if (cmd == PROTO_CMD_TOP) {
+		if (!control->sampler) {
+			res.header.err = PROTO_ERR_UNSUPPORTED;
+			respond(client, &res, sizeof res.header);
+
+			return;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if (services[i] == GRAPH_NONE) {
+				res.header.err = PROTO_ERR_UNKNOWN_SERVICE;
+				respond(client, &res, sizeof res.header);
+
+				return;
+			}
+		}
+
+		size_t total = count ? count : sched->services_len;
+		size_t i = 0;
+
+		do {
+			size_t batch = total - i < PROTO_MAX_TOPS ? total - i : PROTO_MAX_TOPS;
+
+			for (size_t j = 0; j < batch; j++, i++) {
+				uint32_t service = count ? services[i] : i;
+				proto_top_t* top = &res.tops[j];
+
+				sampler_stats_t stats = { 0 };
+				sampler_stats(control->sampler, service, &stats);
+
+				*top = (proto_top_t) {
+					.state = sched->states[service],
+					.procs = stats.procs,
+					.cpu = stats.cpu,
+					.cpu_avg = stats.cpu_avg,
+					.cpu_max = stats.cpu_max,
+					.rss = stats.rss,
+					.rss_max = stats.rss_max,
+				};
+
+				strncpy(top->name, graph_name(graph, service), sizeof top->name - 1);
+			}
+
+			res.header.count = batch;
+			res.header.flags = i < total ? PROTO_RES_MORE : 0;
+
+			respond(client, &res, sizeof res.header + batch * sizeof *res.tops);
+		} while (i < total);
+
+		return;
+	}
+
+	// commands acting on a single service
+
+	if (cmd == PROTO_CMD_OUTPUT) {
+		if (count != 1 || services[0] == GRAPH_NONE) {
+			res.header.err = count != 1 ? PROTO_ERR_BAD_REQUEST : PROTO_ERR_UNKNOWN_SERVICE;
+			respond(client, &res, sizeof res.header);
+
+			return;
+		}
+
+		size_t tail_len = control->output && control->buf ? output_tail(control->output, services[0], control->buf, OUTPUT_RING_SIZE) : 0;
+		stream(client, &res, control->buf, tail_len);
+
+		return;
+	}
+
+	if (cmd == PROTO_CMD_RUN_CMD) {
+		// services can't declare custom commands yet
+
+		res.header.err = count != 2 ? PROTO_ERR_BAD_REQUEST : services[0] == GRAPH_NONE ? PROTO_ERR_UNKNOWN_SERVICE : PROTO_ERR_UNSUPPORTED;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	// batched commands, with an entry per service in the response
+
+	if (cmd < PROTO_CMD_START || cmd > PROTO_CMD_STATUS) {
+		res.header.err = PROTO_ERR_BAD_REQUEST;
+		respond(client, &res, sizeof res.header);
+
+		return;
+	}
+
+	res.header.count = count;
+
+	for (size_t i = 0; i < count; i++) {
+		uint32_t service = services[i];
+		proto_entry_t* entry = &res.entries[i];
+
+		memset(entry, 0, sizeof *entry);
+
+		if (service == GRAPH_NONE) {
+			entry->err = PROTO_ERR_UNKNOWN_SERVICE;
+			continue;
+		}
+
+		int rv = 0;
+
+		if (cmd == PROTO_CMD_START) {
+			LOG_INFO("Starting %s on request", graph_name(graph, service))
+			rv = sched_start(sched, service);
+		}
+
+		else if (cmd == PROTO_CMD_STOP) {
+			LOG_INFO("Stopping %s on request", graph_name(graph, service))
+			rv = sched_stop(sched, service);
+		}
+
+		else if (cmd == PROTO_CMD_RESTART) {
+			LOG_INFO("Restarting %s on request", graph_name(graph, service))
+			rv = sched_restart(sched, service);
+		}
+
+		entry->err = rv < 0 ? err_from_errno() : PROTO_OK;
+		fill_entry(sched, service, entry);
+	}
+
+	respond(client, &res, sizeof res.header + count * sizeof *res.entries);
+}
+
+// read and handle a batch of requests from a client
+// returns -1 if the client should be dropped
+
+static int serve_client(control_t* control, control_client_t* client) {
+	for (size_t i = 0; i < CONTROL_BATCH && client->pending_len - client->pending_head < CONTROL_MAX_PENDING; i++) {
+		_Alignas(uint64_t) char msg[PROTO_MSG_SIZE];
+		ssize_t len = recv(client->fd, msg, sizeof msg, 0);
+
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (len < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		if (!len) {
+			return -1; // client hung up
+		}
+
+		handle(control, client, msg, len);
+	}
+
+	return 0;
+}
+
+unsigned control_poll(control_t* control, size_t wakes_len, int const* wakes, int timeout) {
+	// first come the wake descriptors and the listening socket (if there's room for more clients), then all the clients in order
+	// negative descriptors are ignored by 'poll', which saves us from keeping track of which is where
+
+	// send subscribers whatever happened since we last polled (including anything caused by the requests we last served)
+
+	for (size_t i = 0; i < control->clients_len; i++) {
+		deliver(control, &control->clients[i]);
+	}
+
+	struct pollfd* fds = control->fds;
+	bool full = control->clients_len >= CONTROL_MAX_CLIENTS;
+
+	for (size_t i = 0; i < wakes_len; i++) {
+		fds[i] = (struct pollfd) { .fd = wakes[i], .events = POLLIN };
+	}
+
+	struct pollfd* sock = &fds[wakes_len];
+	struct pollfd* client_fds = sock + 1;
+
+	*sock = (struct pollfd) { .fd = full ? -1 : control->sock, .events = POLLIN };
+
+	for (size_t i = 0; i < control->clients_len; i++) {
+		control_client_t* client = &control->clients[i];
+		size_t pending = client->pending_len - client->pending_head;
+
+		client_fds[i] = (struct pollfd) {
+			.fd = client->fd,
+			.events = (pending < CONTROL_MAX_PENDING ? POLLIN : 0) | (pending ? POLLOUT : 0),
+		};
+	}
+
+	size_t clients_len = control->clients_len;
+
+	if (poll(fds, wakes_len + 1 + clients_len, timeout) < 0) {
+		if (errno != EINTR) {
+			LOG_WARN("poll: %s", strerror(errno))
+		}
+
+		return 0;
+	}
+
+	// go through the clients backwards, so that dropping one (which swaps the last one into its place) doesn't skip any
+
+	for (size_t i = clients_len; i--;) {
+		control_client_t* client = &control->clients[i];
+		short revents = client_fds[i].revents;
+
+		if (!revents) {
+			continue;
+		}
+
+		if (
+			((revents & POLLOUT) && flush_client(client) < 0) ||
+			((revents & (POLLIN | POLLHUP | POLLERR)) && serve_client(control, client) < 0) ||
+			flush_client(client) < 0
+		) {
+			drop_client(control, i);
+		}
+	}
+
+	if (sock->revents & POLLIN) {
+		accept_clients(control);
+	}
+
+	unsigned woken = 0;
+
+	for (size_t i = 0; i < wakes_len; i++) {
+		woken |= (fds[i].revents & POLLIN ? 1u : 0) << i;
+	}
+
+	return woken;
+}
+
+void control_free(control_t* control) {
+	while (control->clients_len) {
+		drop_client(control, control->clients_len - 1);
+	}
+
+	if (control->sock >= 0) {
+		close(control->sock);
+		unlink(control->path);
+	}
+
+	free(control->buf);
+}
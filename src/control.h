@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <poll.h>
+#include <sys/types.h>
+
+#include "bitset.h"
+#include "output.h"
+#include "proto.h"
+#include "sampler.h"
+#include "sched.h"
+
+// control socket which init serves requests on (cf. 'proto.h')
+// all clients are served from a single 'poll' loop, and responses are queued up for clients which aren't reading them as fast as they're produced
+// subscribers are sent events from the scheduler's event ring (cf. 'events.h') whenever they have nothing else queued up, so a slow subscriber just falls behind rather than holding anything up
+
+#define CONTROL_MAX_CLIENTS 256 // past which new connections wait in the listen backlog until others close
+#define CONTROL_BACKLOG 128
+#define CONTROL_MAX_PENDING 64 // responses queued for a client before we stop reading its requests
+#define CONTROL_BATCH 16 // requests read from a client per round, so that a busy client can't starve the others
+#define CONTROL_MAX_WAKES 4
+
+typedef struct {
+	size_t len;
+	char* data;
+} control_msg_t;
+
+typedef struct {
+	int fd;
+	bool privileged; // root or in the service group, and so allowed to act on services (and read their output) rather than just query them
+
+	// responses which couldn't be sent yet, oldest first
+
+	size_t pending_head;
+	size_t pending_len;
+	control_msg_t* pending;
+
+	// subscription to service lifecycle events, if any
+
+	bool subscribed;
+	uint16_t event_mask; // '1 << type' for each event type subscribed to
+	uint64_t cursor; // next event to send
+	bitset_word_t* filter; // services subscribed to, or NULL for all of them
+} control_client_t;
+
+typedef struct {
+	sched_t* sched;
+	output_t* output;
+	sampler_t const* sampler; // NULL if services aren't being sampled (cf. 'PROTO_CMD_TOP')
+
+	char const* path;
+	gid_t gid; // group whose members are privileged
+
+	int sock; // -1 until listening
+	char* buf; // scratch space for streamed payloads
+
+	size_t clients_len;
+	control_client_t clients[CONTROL_MAX_CLIENTS];
+
+	struct pollfd fds[CONTROL_MAX_WAKES + CONTROL_MAX_CLIENTS + 1];
+} control_t;
+
+// check whether something is already serving requests on the socket at 'path'
+
+bool control_running(char const* path);
+
+void control_init(control_t* control, sched_t* sched, output_t* output, char const* path, gid_t gid);
+void control_free(control_t* control);
+
+// start listening on the control socket, replacing whatever stale socket might have been left at its path
+// returns -1 and sets 'errno' if that's not possible yet (e.g. the filesystem it's on isn't writable yet)
+
+int control_listen(control_t* control);
+
+// wait for up to 'timeout' milliseconds (-1 to wait indefinitely) for something to happen on the control socket, and serve whatever requests came in
+// 'wakes' are up to 'CONTROL_MAX_WAKES' additional file descriptors which also end the wait when readable (e.g. a self-pipe for signals), negative ones are ignored
+// returns a bitmask of which of 'wakes' are readable
+
+unsigned control_poll(control_t* control, size_t wakes_len, int const* wakes, int timeout);
@@ -0,0 +1,481 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+	#include <bsd/libutil.h>
+#else
+	#include <libutil.h>
+#endif
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "discover.h"
+#include "log.h"
+
+static service_t* new_service(graph_t* graph, const char* name, const char* path) {
+	service_t* service = graph_new_service(graph, name);
+
+	service->kind = SERVICE_KIND_GENERIC;
+	service->path = strtab_intern(&graph->strtab, path);
+
+	// set defaults for service flags
+	// by default, a service is launched on start (on regular systems and any jails)
+
+	service->flags = SERVICE_FLAG_ON_START;
+
+	return service;
+}
+
+static int fill_research_service(graph_t* graph, arena_t* arena, service_t* service) {
+	// yeah, this function really isn't pretty, but I'd rather make is as compact as possible with ugly macros as I don't really want this to be the focus of this source file
+
+	service->kind = SERVICE_KIND_RESEARCH;
+	service_parse_t* parse = graph_parse_info(graph, service);
+
+	// read the service script, similar to what rcorder(8) does on NetBSD
+	// a lot of this code is actually even stolen from NetBSD's 'sbin/rcorder/rcorder.c'
+
+	FILE* fp = fopen(graph_str(graph, service->path), "r");
+
+	if (!fp) {
+		return -1;
+	}
+
+	char* buf;
+
+	// now that's what I call a BIG GRAYSON
+	// TODO little note, and probably something to fix in both FreeBSD & NetBSD, the 'REQUIRES', 'PROVIDES', & 'KEYWORDS' directives are useless (it's pretty obvious how when looking at the code)
+
+	char* require  = NULL;
+	char* provide  = NULL;
+	char* before   = NULL;
+	char* keyword  = NULL;
+	char* restart  = NULL;
+	char* priority = NULL;
+	char* health   = NULL;
+	char* inputs   = NULL;
+	char* outputs  = NULL;
+
+	enum { BEFORE_PARSING, PARSING, PARSING_DONE } state;
+
+	for (
+		state = BEFORE_PARSING;
+		state != PARSING_DONE && (buf = fparseln(fp, NULL, NULL, "\\\\", 0));
+		free(buf)
+	) {
+		#define DIRECTIVE(lower,    upper   ) \
+			else if (strncmp("# " #upper ":", buf, sizeof(#upper) - 1) == 0) { \
+				lower = arena_strdup(arena, buf + sizeof(#upper) + 3); \
+			}
+
+		if (0) {}
+
+		DIRECTIVE(require,  REQUIRE )
+		DIRECTIVE(provide,  PROVIDE )
+		DIRECTIVE(before,   BEFORE  )
+		DIRECTIVE(keyword,  KEYWORD )
+		DIRECTIVE(restart,  RESTART )
+		DIRECTIVE(priority, PRIORITY)
+		DIRECTIVE(health,   HEALTH  )
+		DIRECTIVE(inputs,   INPUTS  )
+		DIRECTIVE(outputs,  OUTPUTS )
+
+		else {
+			if (state == PARSING) {
+				state = PARSING_DONE;
+			}
+
+			continue;
+		}
+
+		#undef DIRECTIVE
+
+		state = PARSING;
+	}
+
+	// parse 'require' as service dependency names
+
+	char* str;
+
+	while ((str = strsep(&require, " \t\n"))) {
+		if (!*str) {
+			continue;
+		}
+
+		graph_push_name(graph, &parse->dep_names, str);
+	}
+
+	// parse 'before' as the names of services which must wait for this one
+	// these are only turned into actual edges in the graph when resolving dependencies
+
+	while ((str = strsep(&before, " \t\n"))) {
+		if (!*str) {
+			continue;
+		}
+
+		graph_push_name(graph, &parse->before_names, str);
+	}
+
+	// parse 'provide' as, well, provide
+
+	while ((str = strsep(&provide, " \t\n"))) {
+		if (!*str) {
+			continue;
+		}
+
+		graph_push_name(graph, &parse->provides, str);
+	}
+
+	// parse 'keyword' as service flags
+	// default were already set when creating the service object
+
+	while ((str = strsep(&keyword, " \t\n"))) {
+		if (!*str) {
+			continue;
+		}
+
+		#define KEYWORD(keyword, flag, val) \
+			else if (strcmp(str, (keyword)) == 0) { \
+				service->flags = (val) ? service->flags | SERVICE_FLAG_##flag : service->flags & ~SERVICE_FLAG_##flag; \
+			}
+
+		if (0) {}
+
+		KEYWORD("nostart",    ON_START,        false)
+		KEYWORD("shutdown",   ON_STOP,         true )
+		KEYWORD("resume",     ON_RESUME,       true )
+
+		KEYWORD("firstboot",  FIRST_BOOT,      true )
+
+		KEYWORD("nojail",     DISABLE_IN_JAIL, true )
+		KEYWORD("nojailvnet", DISABLE_IN_VNET, true )
+
+		KEYWORD("deferred",   DEFERRED,        true )
+
+		else {
+			LOG_WARN("Unknown research UNIX-style service keyword '%s'", str)
+		}
+
+		#undef KEYWORD
+	}
+
+	// parse 'restart' as the service's restart policy (this one isn't in rc.d(8), it's ours)
+
+	if ((str = strsep(&restart, " \t\n"))) {
+		if (!strcmp(str, "never")) {
+			service->restart = SERVICE_RESTART_NEVER;
+		}
+
+		else if (!strcmp(str, "on-failure")) {
+			service->restart = SERVICE_RESTART_ON_FAILURE;
+		}
+
+		else if (!strcmp(str, "always")) {
+			service->restart = SERVICE_RESTART_ALWAYS;
+		}
+
+		else {
+			LOG_WARN("Unknown research UNIX-style service restart policy '%s' (expected never, on-failure, or always)", str)
+		}
+	}
+
+	// parse 'priority' as the service's priority class (ours too)
+
+	if ((str = strsep(&priority, " \t\n"))) {
+		if (!strcmp(str, "normal")) {
+			service->priority = SERVICE_PRIORITY_NORMAL;
+		}
+
+		else if (!strcmp(str, "high")) {
+			service->priority = SERVICE_PRIORITY_HIGH;
+		}
+
+		else if (!strcmp(str, "low")) {
+			service->priority = SERVICE_PRIORITY_LOW;
+		}
+
+		else {
+			LOG_WARN("Unknown research UNIX-style service priority '%s' (expected normal, high, or low)", str)
+		}
+	}
+
+	// parse 'health' as the service's health probe, i.e. an interval in seconds, followed by either 'exec' and a command, or 'connect' and a socket path (ours too)
+
+	char* interval = strsep(&health, " \t\n");
+	char* probe = strsep(&health, " \t\n");
+
+	if (probe && health) {
+		char* end;
+		service->probe_interval = strtof(interval, &end);
+
+		if (*end || service->probe_interval <= 0) {
+			LOG_WARN("Invalid research UNIX-style service health probe interval '%s', defaulting to %d seconds", interval, SERVICE_PROBE_INTERVAL)
+			service->probe_interval = SERVICE_PROBE_INTERVAL;
+		}
+
+		health[strcspn(health, "\n")] = '\0';
+
+		if (!strcmp(probe, "exec")) {
+			service->probe = SERVICE_PROBE_EXEC;
+		}
+
+		else if (!strcmp(probe, "connect")) {
+			service->probe = SERVICE_PROBE_CONNECT;
+		}
+
+		else {
+			LOG_WARN("Unknown research UNIX-style service health probe '%s' (expected exec or connect)", probe)
+		}
+
+		if (service->probe != SERVICE_PROBE_NONE) {
+			service->probe_arg = strtab_intern(&graph->strtab, health);
+		}
+	}
+
+	else if (interval) {
+		LOG_WARN("Research UNIX-style service health probes are of the form '# HEALTH: <interval> exec <command>' or '# HEALTH: <interval> connect <socket>'")
+	}
+
+	// 'inputs' and 'outputs' are kept as is, as they're only ever looked at when the service is started (cf. 'memo.h')
+	// only services declaring their inputs are memoised, but they needn't have any outputs (e.g. setting sysctls)
+
+	if (inputs) {
+		service->inputs = strtab_intern(&graph->strtab, inputs);
+	}
+
+	if (outputs) {
+		service->outputs = strtab_intern(&graph->strtab, outputs);
+	}
+
+	// the directives themselves were allocated on the parse arena, so they'll be freed with the rest of it
+
+	fclose(fp);
+
+	LOG_VERBOSE("Filled research UNIX-style service %s", graph_str(graph, service->name))
+
+	return 0;
+}
+
+typedef size_t (*get_deps_len_func_t)  (void);
+typedef char** (*get_dep_names_func_t) (void);
+
+static int fill_aquabsd_service(graph_t* graph, service_t* service) {
+	service->kind = SERVICE_KIND_AQUABSD;
+	service_parse_t* parse = graph_parse_info(graph, service);
+
+	// we're using 'RTLD_NOW' here instead of 'RTLD_LAZY' as would normally be preferred
+	// since we only have a small number of functions that we know we'll eventually use, it's better to resolve all external symbols straight away
+
+	char const* path = graph_str(graph, service->path);
+	service->aquabsd.lib = dlopen(path, RTLD_NOW);
+
+	if (!service->aquabsd.lib) {
+		LOG_WARN("dlopen: failed to load %s: %s", path, dlerror())
+		return -1;
+	}
+
+	dlerror(); // clear last error
+
+	// get start function, duh
+
+	service->aquabsd.start = dlsym(service->aquabsd.lib, "start");
+
+	if (!service->aquabsd.start) {
+		LOG_WARN("aquaBSD services must have start symbol")
+
+		dlclose(service->aquabsd.lib);
+		return -1;
+	}
+
+	// get dependencies
+
+	get_deps_len_func_t  get_deps_len  = dlsym(service->aquabsd.lib, "get_deps_len" );
+	get_dep_names_func_t get_dep_names = dlsym(service->aquabsd.lib, "get_dep_names");
+
+	if (!get_deps_len || !get_dep_names) {
+		LOG_WARN("aquaBSD services must have get_deps_len & get_dep_names symbols")
+
+		dlclose(service->aquabsd.lib);
+		return -1;
+	}
+
+	size_t deps_len  = get_deps_len ();
+	char** dep_names = get_dep_names();
+
+	for (size_t i = 0; i < deps_len; i++) {
+		graph_push_name(graph, &parse->dep_names, dep_names[i]);
+	}
+
+	// get services which must wait for this one (optional)
+	// this is the aquaBSD counterpart to the 'before' array of 'desc.json', which isn't read at all yet (service directories are skipped by discovery)
+
+	get_deps_len_func_t  get_before_len   = dlsym(service->aquabsd.lib, "get_before_len"  );
+	get_dep_names_func_t get_before_names = dlsym(service->aquabsd.lib, "get_before_names");
+
+	if (get_before_len && get_before_names) {
+		size_t before_len   = get_before_len  ();
+		char** before_names = get_before_names();
+
+		for (size_t i = 0; i < before_len; i++) {
+			graph_push_name(graph, &parse->before_names, before_names[i]);
+		}
+	}
+
+	// get service flags
+
+	#define FLAG(sym, flag) \
+		if (dlsym(service->aquabsd.lib, #sym)) { \
+			service->flags |= SERVICE_FLAG_##flag; \
+		}
+
+	FLAG(on_start,        ON_START       )
+	FLAG(on_stop,         ON_STOP        )
+	FLAG(on_resume,       ON_RESUME      )
+
+	FLAG(first_boot,      FIRST_BOOT     )
+
+	FLAG(disable_in_jail, DISABLE_IN_JAIL)
+	FLAG(disable_in_vnet, DISABLE_IN_VNET)
+
+	FLAG(deferred,        DEFERRED       )
+
+	#undef FLAG
+
+	// get restart policy (never restarted if neither symbol is there)
+
+	if (dlsym(service->aquabsd.lib, "restart_always")) {
+		service->restart = SERVICE_RESTART_ALWAYS;
+	}
+
+	else if (dlsym(service->aquabsd.lib, "restart_on_failure")) {
+		service->restart = SERVICE_RESTART_ON_FAILURE;
+	}
+
+	// get priority class (normal if neither symbol is there)
+
+	if (dlsym(service->aquabsd.lib, "priority_high")) {
+		service->priority = SERVICE_PRIORITY_HIGH;
+	}
+
+	else if (dlsym(service->aquabsd.lib, "priority_low")) {
+		service->priority = SERVICE_PRIORITY_LOW;
+	}
+
+	// get inputs and outputs, for memoised services (optional, cf. 'memo.h')
+	// these are whitespace-separated lists, as for research UNIX-style services
+
+	char const** memo_inputs  = dlsym(service->aquabsd.lib, "memo_inputs" );
+	char const** memo_outputs = dlsym(service->aquabsd.lib, "memo_outputs");
+
+	if (memo_inputs) {
+		service->inputs = strtab_intern(&graph->strtab, *memo_inputs);
+	}
+
+	if (memo_outputs) {
+		service->outputs = strtab_intern(&graph->strtab, *memo_outputs);
+	}
+
+	// get health probe (optional)
+	// these are strings, for which dlsym gives us the address of the pointer
+
+	char const** health_command = dlsym(service->aquabsd.lib, "health_command");
+	char const** health_socket  = dlsym(service->aquabsd.lib, "health_socket" );
+
+	if (health_command || health_socket) {
+		service->probe = health_command ? SERVICE_PROBE_EXEC : SERVICE_PROBE_CONNECT;
+		service->probe_arg = strtab_intern(&graph->strtab, health_command ? *health_command : *health_socket);
+		service->probe_interval = SERVICE_PROBE_INTERVAL;
+	}
+
+	LOG_VERBOSE("Filled aquaBSD service %s", graph_str(graph, service->name))
+
+	return 0;
+}
+
+int discover_aquabsd(graph_t* graph, arena_t* arena, char const* dir) {
+	DIR* dp = opendir(dir);
+
+	if (!dp) {
+		return -1;
+	}
+
+	int found = 0;
+	struct dirent* ent;
+
+	while ((ent = readdir(dp))) {
+		if (ent->d_type != DT_REG) {
+			continue; // anything other than a regular file is invalid
+		}
+
+		if (*ent->d_name == '.') {
+			continue; // don't care about '.', '..', & other entries starting with a dot
+		}
+
+		char* path = arena_printf(arena, "%s/%s", dir, ent->d_name);
+
+		// okay! add the service
+
+		service_t* service = new_service(graph, ent->d_name, path);
+
+		if (fill_aquabsd_service(graph, service) < 0) {
+			graph_drop_service(graph);
+			continue;
+		}
+
+		found++;
+	}
+
+	closedir(dp);
+	return found;
+}
+
+int discover_research(graph_t* graph, arena_t* arena, char const* dir) {
+	DIR* dp = opendir(dir);
+
+	if (!dp) {
+		return -1;
+	}
+
+	int found = 0;
+	struct dirent* ent;
+
+	while ((ent = readdir(dp))) {
+		if (ent->d_type != DT_REG) {
+			continue; // anything other than a regular file is invalid
+		}
+
+		if (*ent->d_name == '.') {
+			continue; // don't care about '.', '..', & other entries starting with a dot
+		}
+
+		char* path = arena_printf(arena, "%s/%s", dir, ent->d_name);
+
+		struct stat sb;
+
+		if (stat(path, &sb) < 0) {
+			LOG_FATAL("stat(\"%s\"): %s", path, strerror(errno))
+			exit(EXIT_FAILURE);
+		}
+
+		// okay! add the service
+
+		service_t* service = new_service(graph, ent->d_name, path);
+
+		if (fill_research_service(graph, arena, service) < 0) {
+			graph_drop_service(graph);
+			continue;
+		}
+
+		found++;
+	}
+
+	closedir(dp);
+	return found;
+}
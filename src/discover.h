@@ -0,0 +1,11 @@
+#pragma once
+
+#include "arena.h"
+#include "graph.h"
+
+// discover all the services in a directory and add them to the graph
+// anything only needed until the graph is resolved is allocated on 'arena'
+// these return the number of services found, or -1 if the directory couldn't be opened (in which case 'errno' is set)
+
+int discover_aquabsd(graph_t* graph, arena_t* arena, char const* dir); // aquaBSD services, as shared libraries
+int discover_research(graph_t* graph, arena_t* arena, char const* dir); // research UNIX-style runcom scripts (i.e. '/etc/rc.d')
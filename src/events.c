@@ -0,0 +1,35 @@
+#include <string.h>
+
+#include "events.h"
+
+#define RING_MASK (EVENTS_RING_LEN - 1)
+
+void events_init(events_t* events) {
+	memset(events, 0, sizeof *events);
+	events->head = 1;
+}
+
+void events_push(events_t* events, proto_event_type_t type, uint32_t service, pid_t pid, int exit_code, long double time) {
+	uint64_t seq = events->head++;
+
+	events->ring[seq & RING_MASK] = (event_t) {
+		.seq = seq,
+		.time = time,
+		.service = service,
+		.type = type,
+		.pid = pid,
+		.exit_code = exit_code,
+	};
+}
+
+uint64_t events_tail(events_t const* events) {
+	return events->head > EVENTS_RING_LEN ? events->head - EVENTS_RING_LEN : 1;
+}
+
+event_t const* events_get(events_t const* events, uint64_t seq) {
+	if (seq >= events->head || seq < events_tail(events)) {
+		return NULL;
+	}
+
+	return &events->ring[seq & RING_MASK];
+}
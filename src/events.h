@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "proto.h"
+
+// ring of the latest service lifecycle events, which subscribers on the control socket are sent from (cf. 'PROTO_CMD_SUBSCRIBE')
+// the scheduler only ever appends to it, and never waits on anyone: each subscriber has its own cursor into the ring, and if one falls so far behind that the events it hasn't been sent yet are overwritten, it just skips ahead
+
+#define EVENTS_RING_LEN 4096 // must be a power of two
+
+typedef struct {
+	uint64_t seq;
+	double time;
+	uint32_t service;
+	uint8_t type; // 'proto_event_type_t'
+	int32_t pid;
+	int32_t exit_code;
+} event_t;
+
+typedef struct {
+	uint64_t head; // number of the next event to be pushed (events are numbered from 1)
+	event_t ring[EVENTS_RING_LEN];
+} events_t;
+
+void events_init(events_t* events);
+void events_push(events_t* events, proto_event_type_t type, uint32_t service, pid_t pid, int exit_code, long double time);
+
+// number of the oldest event still in the ring
+
+uint64_t events_tail(events_t const* events);
+
+// event number 'seq', or NULL if it hasn't happened yet or has already been overwritten
+
+event_t const* events_get(events_t const* events, uint64_t seq);
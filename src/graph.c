@@ -0,0 +1,490 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "graph.h"
+#include "log.h"
+
+#define INITIAL_SERVICES_CAP 64
+#define INITIAL_NAMES_CAP 256
+
+void graph_init(graph_t* graph, arena_t* arena) {
+	memset(graph, 0, sizeof *graph);
+	strtab_init(&graph->strtab);
+
+	graph->services_cap = INITIAL_SERVICES_CAP;
+	graph->services = malloc(graph->services_cap * sizeof *graph->services);
+
+	graph->arena = arena;
+	graph->parse = arena_alloc(arena, graph->services_cap * sizeof *graph->parse);
+
+	graph->names_cap = INITIAL_NAMES_CAP;
+	graph->names = arena_alloc(arena, graph->names_cap * sizeof *graph->names);
+}
+
+void graph_free(graph_t* graph) {
+	strtab_free(&graph->strtab);
+
+	#define FREE(thing) \
+		if ((thing)) { \
+			free((thing)); \
+		}
+
+	FREE(graph->services)
+	FREE(graph->providers)
+	FREE(graph->dep_offs)
+	FREE(graph->deps)
+
+	#undef FREE
+}
+
+service_t* graph_new_service(graph_t* graph, char const* name) {
+	if (graph->services_len == graph->services_cap) {
+		graph->parse = arena_grow(graph->arena, graph->parse, graph->services_cap * sizeof *graph->parse, graph->services_cap * 2 * sizeof *graph->parse);
+
+		graph->services_cap *= 2;
+		graph->services = realloc(graph->services, graph->services_cap * sizeof *graph->services);
+	}
+
+	memset(&graph->parse[graph->services_len], 0, sizeof *graph->parse);
+
+	service_t* service = &graph->services[graph->services_len++];
+	memset(service, 0, sizeof *service);
+
+	service->name = strtab_intern(&graph->strtab, name);
+
+	service->inputs = STRTAB_NONE;
+	service->outputs = STRTAB_NONE;
+
+	return service;
+}
+
+void graph_drop_service(graph_t* graph) {
+	graph->services_len--;
+}
+
+void graph_push_name(graph_t* graph, service_names_t* list, char const* name) {
+	if (!list->len) {
+		list->off = graph->names_len;
+	}
+
+	if (graph->names_len == graph->names_cap) {
+		graph->names = arena_grow(graph->arena, graph->names, graph->names_cap * sizeof *graph->names, graph->names_cap * 2 * sizeof *graph->names);
+		graph->names_cap *= 2;
+	}
+
+	graph->names[graph->names_len++] = strtab_intern(&graph->strtab, name);
+	list->len++;
+}
+
+void graph_resolve(graph_t* graph) {
+	size_t services_len = graph->services_len;
+
+	// map every name to the first service which has it or provides it
+
+	graph->providers_len = graph->strtab.len;
+	graph->providers = malloc((graph->providers_len ? graph->providers_len : 1) * sizeof *graph->providers);
+	memset(graph->providers, 0xff, graph->providers_len * sizeof *graph->providers); // all 'GRAPH_NONE'
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		service_t* service = &graph->services[i];
+		service_parse_t* parse = &graph->parse[i];
+
+		if (graph->providers[service->name] == GRAPH_NONE) {
+			graph->providers[service->name] = i;
+		}
+
+		for (size_t j = 0; j < parse->provides.len; j++) {
+			uint32_t name = graph->names[parse->provides.off + j];
+
+			if (graph->providers[name] == GRAPH_NONE) {
+				graph->providers[name] = i;
+			}
+		}
+	}
+
+	// count how many edges each service is going to have, which is the number of dependencies it has plus the number of services which must come before it
+	// if A must complete before B, that's the same as B depending on A, so A is added to B's dependencies
+
+	graph->dep_offs = calloc(services_len + 1, sizeof *graph->dep_offs);
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		service_parse_t* parse = &graph->parse[i];
+
+		for (size_t j = 0; j < parse->dep_names.len; j++) {
+			uint32_t name = graph->names[parse->dep_names.off + j];
+
+			if (graph->providers[name] != GRAPH_NONE) {
+				graph->dep_offs[i + 1]++;
+			}
+		}
+
+		for (size_t j = 0; j < parse->before_names.len; j++) {
+			uint32_t name = graph->names[parse->before_names.off + j];
+			uint32_t before = graph->providers[name];
+
+			if (before != GRAPH_NONE) {
+				graph->dep_offs[before + 1]++;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < services_len; i++) {
+		graph->dep_offs[i + 1] += graph->dep_offs[i];
+	}
+
+	// actually fill in the edges
+	// from here on out, reverse edges are indistinguishable from regular dependencies, so cycle detection and scheduling take them into account for free
+
+	uint32_t* cursors = malloc((services_len ? services_len : 1) * sizeof *cursors);
+	memcpy(cursors, graph->dep_offs, services_len * sizeof *cursors);
+
+	graph->deps = malloc((graph->dep_offs[services_len] ? graph->dep_offs[services_len] : 1) * sizeof *graph->deps);
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		service_parse_t* parse = &graph->parse[i];
+
+		for (size_t j = 0; j < parse->dep_names.len; j++) {
+			uint32_t name = graph->names[parse->dep_names.off + j];
+			uint32_t dep = graph->providers[name];
+
+			if (dep == GRAPH_NONE) {
+				LOG_VERBOSE("%s depends on %s, which doesn't exist", graph_name(graph, i), graph_str(graph, name))
+				continue;
+			}
+
+			graph->deps[cursors[i]++] = dep;
+		}
+
+		for (size_t j = 0; j < parse->before_names.len; j++) {
+			uint32_t name = graph->names[parse->before_names.off + j];
+			uint32_t before = graph->providers[name];
+
+			if (before == GRAPH_NONE) {
+				LOG_WARN("%s must come before %s, which doesn't exist", graph_name(graph, i), graph_str(graph, name))
+				continue;
+			}
+
+			graph->deps[cursors[before]++] = i;
+		}
+	}
+
+	free(cursors);
+
+	// we don't need anything in the parse arena anymore
+	// also take the opportunity to trim everything which is going to stick around for the rest of init's life (i.e. forever)
+
+	graph->arena = NULL;
+	graph->parse = NULL;
+
+	graph->names = NULL;
+	graph->names_len = 0;
+	graph->names_cap = 0;
+
+	graph->services_cap = services_len ? services_len : 1;
+	graph->services = realloc(graph->services, graph->services_cap * sizeof *graph->services);
+
+	strtab_shrink(&graph->strtab);
+}
+
+uint32_t graph_search(graph_t const* graph, char const* name) {
+	uint32_t id = strtab_find(&graph->strtab, name);
+
+	if (id == STRTAB_NONE || id >= graph->providers_len) {
+		return GRAPH_NONE; // couldn't find service!
+	}
+
+	return graph->providers[id];
+}
+
+// sort services topologically, such that all dependencies come before their dependents
+// this is an iterative depth-first search, so even very deep graphs won't blow the stack
+// returns false if a cycle was found, in which case 'cycle' is set to a service in that cycle
+
+enum {
+	UNVISITED = 0,
+	VISITING,
+	VISITED,
+};
+
+static bool topo_sort(graph_t const* graph, uint32_t* order, uint32_t* cycle) {
+	size_t services_len = graph->services_len;
+	size_t order_len = 0;
+
+	uint8_t* states = calloc(services_len ? services_len : 1, sizeof *states);
+
+	// each stack entry is a service and the next of its edges to look at
+
+	uint32_t* stack = malloc((services_len ? services_len : 1) * sizeof *stack);
+	uint32_t* cursors = malloc((services_len ? services_len : 1) * sizeof *cursors);
+
+	bool acyclic = true;
+
+	for (uint32_t root = 0; acyclic && root < services_len; root++) {
+		if (states[root] != UNVISITED) {
+			continue;
+		}
+
+		size_t depth = 0;
+
+		stack[depth] = root;
+		cursors[depth++] = graph->dep_offs[root];
+		states[root] = VISITING;
+
+		while (depth) {
+			uint32_t service = stack[depth - 1];
+			uint32_t edge = cursors[depth - 1]++;
+
+			if (edge == graph->dep_offs[service + 1]) {
+				states[service] = VISITED;
+				order[order_len++] = service;
+				depth--;
+
+				continue;
+			}
+
+			uint32_t dep = graph->deps[edge];
+
+			if (states[dep] == VISITING) {
+				*cycle = dep;
+				acyclic = false;
+
+				break;
+			}
+
+			if (states[dep] == UNVISITED) {
+				stack[depth] = dep;
+				cursors[depth++] = graph->dep_offs[dep];
+				states[dep] = VISITING;
+			}
+		}
+	}
+
+	free(states);
+	free(stack);
+	free(cursors);
+
+	return acyclic;
+}
+
+bool graph_check_circular(graph_t* graph) {
+	uint32_t* order = malloc((graph->services_len ? graph->services_len : 1) * sizeof *order);
+	uint32_t cycle;
+
+	bool acyclic = topo_sort(graph, order, &cycle);
+	free(order);
+
+	if (!acyclic) {
+		LOG_ERROR("Found circular dependency involving %s", graph_name(graph, cycle))
+	}
+
+	return !acyclic;
+}
+
+// number of 64-bit words of reachability we keep track of per service at once when reducing the graph
+// reachability is computed for one chunk of services at a time, so that memory use stays linear in the number of services (and not quadratic)
+
+#define REDUCE_CHUNK_WORDS 64
+
+static inline bool reduce_selected(bitset_word_t const* selected, uint32_t service) {
+	return !selected || bitset_test(selected, service);
+}
+
+size_t graph_reduce(graph_t* graph, bitset_word_t const* selected, bool report) {
+	size_t services_len = graph->services_len;
+	size_t removed = 0;
+
+	#define REMOVED(service, dep, why) { \
+		removed++; \
+		\
+		if (report) { \
+			LOG_INFO("Redundant dependency of %s on %s (%s)", graph_name(graph, (service)), graph_name(graph, (dep)), (why)) \
+		} \
+		\
+		else { \
+			LOG_VERBOSE("Redundant dependency of %s on %s (%s)", graph_name(graph, (service)), graph_name(graph, (dep)), (why)) \
+		} \
+	}
+
+	// get rid of duplicates, compacting the edges in place
+	// 'seen' records, for each service, the last service which was found to depend on it
+
+	uint32_t* seen = malloc((services_len ? services_len : 1) * sizeof *seen);
+	memset(seen, 0xff, services_len * sizeof *seen);
+
+	uint32_t edges_len = 0;
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		uint32_t start = graph->dep_offs[i];
+		uint32_t end = graph->dep_offs[i + 1];
+
+		graph->dep_offs[i] = edges_len;
+
+		for (uint32_t j = start; j < end; j++) {
+			uint32_t dep = graph->deps[j];
+
+			if (seen[dep] == i) {
+				REMOVED(i, dep, "duplicate")
+				continue;
+			}
+
+			seen[dep] = i;
+			graph->deps[edges_len++] = dep;
+		}
+	}
+
+	graph->dep_offs[services_len] = edges_len;
+	free(seen);
+
+	// compute which edges are redundant
+	// an edge from a service to one of its dependencies is redundant if that dependency is already reachable through any of the other ones
+	// only paths going through selected services count, as unselected ones never run and so are never waited on
+
+	uint32_t* order = malloc((services_len ? services_len : 1) * sizeof *order);
+	uint32_t cycle;
+
+	if (!topo_sort(graph, order, &cycle)) {
+		free(order);
+		return removed; // shouldn't happen, circular dependencies are checked for beforehand
+	}
+
+	bool* redundant = calloc(edges_len ? edges_len : 1, sizeof *redundant);
+
+	size_t chunk_words = bitset_words(services_len) < REDUCE_CHUNK_WORDS ? bitset_words(services_len) : REDUCE_CHUNK_WORDS;
+	size_t chunk_bits = chunk_words * BITSET_WORD_BITS;
+
+	bitset_word_t* reach = malloc((services_len ? services_len : 1) * chunk_words * sizeof *reach);
+
+	for (size_t chunk = 0; chunk < services_len; chunk += chunk_bits) {
+		for (size_t i = 0; i < services_len; i++) {
+			uint32_t service = order[i];
+			bitset_word_t* row = reach + service * chunk_words;
+
+			uint32_t start = graph->dep_offs[service];
+			uint32_t end = graph->dep_offs[service + 1];
+
+			// everything reachable through dependencies (but not the dependencies themselves)
+			// all dependencies' rows are already final here, because of the topological order
+
+			memset(row, 0, chunk_words * sizeof *row);
+
+			for (uint32_t j = start; j < end; j++) {
+				if (!reduce_selected(selected, graph->deps[j])) {
+					continue;
+				}
+
+				bitset_word_t* dep_row = reach + graph->deps[j] * chunk_words;
+
+				for (size_t k = 0; k < chunk_words; k++) {
+					row[k] |= dep_row[k];
+				}
+			}
+
+			// any dependency in this chunk which is already reachable is redundant
+			// the rest are added to what this service can reach (unselected ones can't be reached, so their edges are never redundant)
+
+			for (uint32_t j = start; j < end; j++) {
+				uint32_t dep = graph->deps[j];
+
+				if (dep < chunk || dep >= chunk + chunk_bits) {
+					continue;
+				}
+
+				if (bitset_test(row, dep - chunk)) {
+					redundant[j] = true;
+				}
+			}
+
+			for (uint32_t j = start; j < end; j++) {
+				uint32_t dep = graph->deps[j];
+
+				if (dep >= chunk && dep < chunk + chunk_bits && reduce_selected(selected, dep)) {
+					bitset_set(row, dep - chunk);
+				}
+			}
+		}
+	}
+
+	free(reach);
+	free(order);
+
+	// actually remove the redundant edges
+
+	uint32_t kept = 0;
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		uint32_t start = graph->dep_offs[i];
+		uint32_t end = graph->dep_offs[i + 1];
+
+		graph->dep_offs[i] = kept;
+
+		for (uint32_t j = start; j < end; j++) {
+			uint32_t dep = graph->deps[j];
+
+			if (redundant[j]) {
+				REMOVED(i, dep, "already implied by other dependencies")
+				continue;
+			}
+
+			graph->deps[kept++] = dep;
+		}
+	}
+
+	graph->dep_offs[services_len] = kept;
+
+	#undef REMOVED
+
+	free(redundant);
+
+	return removed;
+}
+
+void graph_closure(graph_t const* graph, size_t targets_len, uint32_t const* targets, bitset_word_t* closure) {
+	// breadth-first search over the resolved dependencies, starting from the targets
+	// each service can only ever be pushed to the queue once (its bit is set when pushed), so the queue never needs to be bigger than the number of services
+
+	uint32_t* queue = malloc((graph->services_len ? graph->services_len : 1) * sizeof *queue);
+	size_t head = 0;
+	size_t tail = 0;
+
+	#define PUSH(service) \
+		if (!bitset_test(closure, (service))) { \
+			bitset_set(closure, (service)); \
+			queue[tail++] = (service); \
+		}
+
+	for (size_t i = 0; i < targets_len; i++) {
+		PUSH(targets[i])
+	}
+
+	while (head < tail) {
+		uint32_t service = queue[head++];
+
+		for (uint32_t i = graph->dep_offs[service]; i < graph->dep_offs[service + 1]; i++) {
+			PUSH(graph->deps[i])
+		}
+	}
+
+	#undef PUSH
+
+	free(queue);
+}
+
+void graph_export(graph_t const* graph, FILE* fp) {
+	fprintf(fp, "digraph services {\n");
+
+	for (uint32_t i = 0; i < graph->services_len; i++) {
+		fprintf(fp, "\t\"%s\";\n", graph_name(graph, i));
+	}
+
+	for (uint32_t i = 0; i < graph->services_len; i++) {
+		for (uint32_t j = graph->dep_offs[i]; j < graph->dep_offs[i + 1]; j++) {
+			fprintf(fp, "\t\"%s\" -> \"%s\";\n", graph_name(graph, i), graph_name(graph, graph->deps[j]));
+		}
+	}
+
+	fprintf(fp, "}\n");
+}
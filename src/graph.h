@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "arena.h"
+#include "bitset.h"
+#include "service.h"
+#include "strtab.h"
+
+// everything to do with the dependency graph between services
+// services are referred to by their index in 'graph_t.services'
+
+#define GRAPH_NONE UINT32_MAX
+
+// list of interned names, stored as a slice of the graph's name pool ('graph_t.names')
+
+typedef struct {
+	uint32_t off;
+	uint32_t len;
+} service_names_t;
+
+// what we know about a service before the graph is resolved
+// i.e. the names of its dependencies, the services it must complete before (i.e. the reverse of a dependency), and other names it provides (only for research UNIX-style services)
+
+typedef struct {
+	service_names_t dep_names;
+	service_names_t before_names;
+	service_names_t provides;
+} service_parse_t;
+
+typedef struct {
+	strtab_t strtab;
+
+	size_t services_len;
+	size_t services_cap;
+	service_t* services;
+
+	// everything only needed until the graph is resolved lives in the parse arena
+	// 'parse' runs parallel to 'services', and 'names' is the pool of name lists referred to by it
+
+	arena_t* arena;
+	service_parse_t* parse;
+
+	size_t names_len;
+	size_t names_cap;
+	uint32_t* names;
+
+	// maps string IDs to the index of the service with that name or providing it (filled in when resolving)
+
+	size_t providers_len;
+	uint32_t* providers;
+
+	// resolved dependencies, in compressed sparse row form
+	// the dependencies of service 'i' are 'deps[dep_offs[i]]' up to (but excluding) 'deps[dep_offs[i + 1]]'
+
+	uint32_t* dep_offs;
+	uint32_t* deps;
+} graph_t;
+
+void graph_init(graph_t* graph, arena_t* arena);
+void graph_free(graph_t* graph);
+
+// adds a new service to the graph
+// the returned pointer is only valid until the next service is added, as the services array may move
+
+service_t* graph_new_service(graph_t* graph, char const* name);
+void graph_drop_service(graph_t* graph); // removes the last service added
+
+// appends a name to one of a service's name lists
+// all the names of a list must be pushed one after the other, as each list is stored contiguously in the pool
+
+void graph_push_name(graph_t* graph, service_names_t* list, char const* name);
+
+static inline service_parse_t* graph_parse_info(graph_t* graph, service_t const* service) {
+	return &graph->parse[service - graph->services];
+}
+
+static inline char const* graph_str(graph_t const* graph, uint32_t id) {
+	return strtab_str(&graph->strtab, id);
+}
+
+static inline char const* graph_name(graph_t const* graph, uint32_t service) {
+	return graph_str(graph, graph->services[service].name);
+}
+
+// build the actual edges of the graph out of the services' name lists
+// after this, nothing in the parse arena is referred to by the graph anymore, so it can be released, and 'graph_search' can be used
+
+void graph_resolve(graph_t* graph);
+uint32_t graph_search(graph_t const* graph, char const* name);
+
+bool graph_check_circular(graph_t* graph);
+
+// removes all the redundant edges from the (acyclic!) graph, i.e. dependencies which are already implied by other dependencies, unresolved dependencies, and duplicates
+// reachability between services is left untouched, it's just that there are less things to wait for when scheduling
+// if 'selected' isn't NULL, only paths going through the services set in it are considered, i.e. an edge is only redundant if it's implied by services which are actually going to run
+// returns the number of edges removed, and if 'report' is set, logs each of them (useful for package maintainers to clean up their services)
+
+size_t graph_reduce(graph_t* graph, bitset_word_t const* selected, bool report);
+
+// computes the transitive dependency closure of 'targets' (i.e. all the services which need to be run for the targets to be reached, including the targets themselves)
+// 'closure' must be a bitset of at least 'graph_t.services_len' bits
+
+void graph_closure(graph_t const* graph, size_t targets_len, uint32_t const* targets, bitset_word_t* closure);
+
+// export the graph in GraphViz format
+
+void graph_export(graph_t const* graph, FILE* fp);
@@ -0,0 +1,468 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+
+char const* history_phase_names[HISTORY_PHASE_COUNT] = {
+	[HISTORY_PHASE_DISCOVER] = "discover",
+	[HISTORY_PHASE_RESOLVE]  = "resolve",
+	[HISTORY_PHASE_SELECT]   = "select",
+	[HISTORY_PHASE_RUN]      = "run",
+};
+
+// on-disk format
+// everything is stored in native byte order, as the ring file never leaves the machine it was written on
+
+#define MAGIC 0x48544e49 // "INTH"
+#define RECORD_MAGIC 0x43524e49 // "INRC"
+#define VERSION 1
+
+#define HEADER_SLOT_SIZE 512 // a single sector, so a header write is most likely atomic anyway
+#define DATA_OFF 4096
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+
+	uint64_t seq; // sequence number of the latest record (0 if there are none)
+	uint64_t last; // offset of the latest record
+	uint64_t head; // offset where the next record goes
+
+	uint32_t crc;
+} header_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t len; // of the payload following the record header
+
+	uint64_t seq;
+	uint64_t prev; // offset of the previous record
+
+	uint32_t crc; // of the payload
+	uint32_t format; // 'FORMAT_*', of the payload
+} record_t;
+
+// the payload of a record is a 'payload_t', followed by a 'payload_service_t', a 'usage_t' (since 'FORMAT_USAGE'), and the name for each service
+// records are only ever added to, so new formats can still be read back alongside old ones in the same ring file (which keeps its version)
+
+#define FORMAT_TIMINGS 0
+#define FORMAT_USAGE 1
+
+typedef struct {
+	int64_t time;
+	float phases[HISTORY_PHASE_COUNT];
+	uint32_t services_len;
+} payload_t;
+
+typedef struct {
+	float start;
+	float duration;
+	uint8_t state;
+	uint8_t name_len; // names are truncated to 255 characters, and stored without a null terminator
+} payload_service_t;
+
+// CRC-32 (IEEE)
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32(void const* data, size_t len) {
+	if (!crc_table[1]) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+
+			for (size_t j = 0; j < 8; j++) {
+				crc = crc & 1 ? 0xedb88320 ^ crc >> 1 : crc >> 1;
+			}
+
+			crc_table[i] = crc;
+		}
+	}
+
+	uint32_t crc = ~0u;
+	uint8_t const* bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ crc >> 8;
+	}
+
+	return ~crc;
+}
+
+static uint32_t header_crc(header_t const* header) {
+	return crc32(header, offsetof(header_t, crc));
+}
+
+void history_init(history_t* history, char const* path) {
+	history->path = path;
+	history->pending = NULL;
+}
+
+void history_free(history_t* history) {
+	while (history->pending) {
+		history_pending_t* next = history->pending->next;
+
+		free(history->pending);
+		history->pending = next;
+	}
+}
+
+void history_record(history_t* history, sched_t const* sched, long double const* phases, long double run_start) {
+	graph_t const* graph = sched->graph;
+
+	// work out how big the record is going to be first
+
+	size_t len = sizeof(payload_t);
+	uint32_t services_len = 0;
+
+	for (size_t i = 0; i < sched->services_len; i++) {
+		if (sched->states[i] < SERVICE_STATE_RUNNING) {
+			continue;
+		}
+
+		size_t name_len = strlen(graph_name(graph, i));
+		len += sizeof(payload_service_t) + sizeof(usage_t) + (name_len > UINT8_MAX ? UINT8_MAX : name_len);
+
+		services_len++;
+	}
+
+	history_pending_t* pending = malloc(sizeof *pending + len);
+
+	pending->next = NULL;
+	pending->len = len;
+
+	// serialise it
+
+	payload_t payload = {
+		.time = time(NULL),
+		.services_len = services_len,
+	};
+
+	for (size_t i = 0; i < HISTORY_PHASE_COUNT; i++) {
+		payload.phases[i] = phases[i];
+	}
+
+	char* ptr = pending->buf;
+
+	memcpy(ptr, &payload, sizeof payload);
+	ptr += sizeof payload;
+
+	for (size_t i = 0; i < sched->services_len; i++) {
+		if (sched->states[i] < SERVICE_STATE_RUNNING) {
+			continue;
+		}
+
+		char const* name = graph_name(graph, i);
+		size_t name_len = strlen(name);
+
+		payload_service_t service = {
+			.start = sched->start_times[i] - run_start,
+			.duration = sched->total_times[i],
+			.state = sched->states[i],
+			.name_len = name_len > UINT8_MAX ? UINT8_MAX : name_len,
+		};
+
+		memcpy(ptr, &service, sizeof service);
+		ptr += sizeof service;
+
+		memcpy(ptr, &sched->usage[i], sizeof(usage_t));
+		ptr += sizeof(usage_t);
+
+		memcpy(ptr, name, service.name_len);
+		ptr += service.name_len;
+	}
+
+	// append it to the pending list
+
+	history_pending_t** tail = &history->pending;
+
+	while (*tail) {
+		tail = &(*tail)->next;
+	}
+
+	*tail = pending;
+}
+
+// read the latest valid header, if any
+
+static bool read_header(int fd, header_t* header) {
+	bool found = false;
+
+	for (size_t i = 0; i < 2; i++) {
+		header_t slot;
+
+		if (pread(fd, &slot, sizeof slot, i * HEADER_SLOT_SIZE) != sizeof slot) {
+			continue;
+		}
+
+		if (slot.magic != MAGIC || slot.version != VERSION || slot.size != HISTORY_SIZE || slot.crc != header_crc(&slot)) {
+			continue;
+		}
+
+		if (!found || slot.seq > header->seq) {
+			*header = slot;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static int write_header(int fd, header_t* header) {
+	header->crc = header_crc(header);
+
+	if (pwrite(fd, header, sizeof *header, (header->seq % 2) * HEADER_SLOT_SIZE) != sizeof *header) {
+		return -1;
+	}
+
+	return fsync(fd);
+}
+
+static int append(int fd, header_t* header, history_pending_t const* pending) {
+	size_t frame_len = (sizeof(record_t) + pending->len + 7) & ~(size_t) 7;
+
+	if (frame_len > HISTORY_SIZE - DATA_OFF) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	// wrap around if the record doesn't fit at the end
+
+	uint64_t off = header->head;
+
+	if (off + frame_len > HISTORY_SIZE) {
+		off = DATA_OFF;
+	}
+
+	record_t record = {
+		.magic = RECORD_MAGIC,
+		.len = pending->len,
+		.seq = header->seq + 1,
+		.prev = header->last,
+		.crc = crc32(pending->buf, pending->len),
+		.format = FORMAT_USAGE,
+	};
+
+	if (pwrite(fd, &record, sizeof record, off) != sizeof record) {
+		return -1;
+	}
+
+	if (pwrite(fd, pending->buf, pending->len, off + sizeof record) != (ssize_t) pending->len) {
+		return -1;
+	}
+
+	// make sure the record is on disk before the header points to it
+
+	if (fsync(fd) < 0) {
+		return -1;
+	}
+
+	header->seq = record.seq;
+	header->last = off;
+	header->head = off + frame_len;
+
+	return write_header(fd, header);
+}
+
+int history_flush(history_t* history) {
+	if (!history->pending) {
+		return 0;
+	}
+
+	int fd = open(history->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	// the directory the ring file goes in may not exist yet on the first boot
+
+	if (fd < 0 && errno == ENOENT) {
+		char dir[4096];
+		snprintf(dir, sizeof dir, "%s", history->path);
+
+		if (mkdir(dirname(dir), 0755) == 0) {
+			fd = open(history->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		}
+	}
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	// start a new ring file if there isn't a valid one already there
+
+	header_t header;
+
+	if (!read_header(fd, &header)) {
+		memset(&header, 0, sizeof header);
+
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.size = HISTORY_SIZE;
+		header.head = DATA_OFF;
+
+		if (ftruncate(fd, HISTORY_SIZE) < 0 || write_header(fd, &header) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	int rv = 0;
+
+	while (history->pending) {
+		history_pending_t* pending = history->pending;
+
+		// records too big to ever fit in the ring file are dropped, as they'd never be written out
+
+		if (append(fd, &header, pending) < 0 && errno != EFBIG) {
+			rv = -1;
+			break;
+		}
+
+		history->pending = pending->next;
+		free(pending);
+	}
+
+	close(fd);
+	return rv;
+}
+
+static bool parse(history_boot_t* boot, uint32_t format, void* buf, size_t len) {
+	payload_t payload;
+
+	if (len < sizeof payload) {
+		return false;
+	}
+
+	memcpy(&payload, buf, sizeof payload);
+
+	boot->time = payload.time;
+	memcpy(boot->phases, payload.phases, sizeof boot->phases);
+
+	boot->buf = buf;
+	boot->services_len = payload.services_len;
+	boot->services = calloc(payload.services_len ? payload.services_len : 1, sizeof *boot->services);
+
+	char* ptr = (char*) buf + sizeof payload;
+	char* end = (char*) buf + len;
+
+	for (size_t i = 0; i < payload.services_len; i++) {
+		payload_service_t service;
+
+		if (ptr + sizeof service > end) {
+			return false;
+		}
+
+		memcpy(&service, ptr, sizeof service);
+		ptr += sizeof service;
+
+		usage_t usage = { 0 };
+
+		if (format >= FORMAT_USAGE) {
+			if (ptr + sizeof usage > end) {
+				return false;
+			}
+
+			memcpy(&usage, ptr, sizeof usage);
+			ptr += sizeof usage;
+		}
+
+		if (ptr + service.name_len > end) {
+			return false;
+		}
+
+		// null-terminate names in place, by shifting each one back over the last byte of whatever comes before it (which has already been copied out)
+
+		char* name = ptr - 1;
+		memmove(name, ptr, service.name_len);
+		name[service.name_len] = '\0';
+
+		ptr += service.name_len;
+
+		boot->services[i] = (history_service_t) {
+			.name = name,
+			.start = service.start,
+			.duration = service.duration,
+			.state = service.state,
+			.usage = usage,
+		};
+	}
+
+	return true;
+}
+
+ssize_t history_read(char const* path, size_t max, history_boot_t** boots) {
+	*boots = NULL;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	header_t header;
+
+	if (!read_header(fd, &header)) {
+		close(fd);
+		return 0;
+	}
+
+	// follow the chain of records back from the latest one
+	// stop at the first record which doesn't check out, as it (and everything before it) has been overwritten
+
+	*boots = calloc(max ? max : 1, sizeof **boots);
+	size_t boots_len = 0;
+
+	uint64_t off = header.last;
+
+	for (uint64_t seq = header.seq; seq && boots_len < max; seq--) {
+		record_t record;
+
+		if (off < DATA_OFF || pread(fd, &record, sizeof record, off) != sizeof record) {
+			break;
+		}
+
+		if (record.magic != RECORD_MAGIC || record.seq != seq || record.format > FORMAT_USAGE || off + sizeof record + record.len > HISTORY_SIZE) {
+			break;
+		}
+
+		void* buf = malloc(record.len ? record.len : 1);
+
+		if (pread(fd, buf, record.len, off + sizeof record) != (ssize_t) record.len || crc32(buf, record.len) != record.crc) {
+			free(buf);
+			break;
+		}
+
+		history_boot_t* boot = &(*boots)[boots_len];
+
+		if (!parse(boot, record.format, buf, record.len)) {
+			free(boot->services);
+			free(buf);
+
+			break;
+		}
+
+		boot->seq = seq;
+		boots_len++;
+
+		off = record.prev;
+	}
+
+	close(fd);
+	return boots_len;
+}
+
+void history_boots_free(size_t boots_len, history_boot_t* boots) {
+	for (size_t i = 0; i < boots_len; i++) {
+		free(boots[i].services);
+		free(boots[i].buf);
+	}
+
+	free(boots);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "sched.h"
+#include "usage.h"
+
+// persistent history of boots
+// each boot's phase timings and per-service timings, outcomes, and resource usage are appended to a fixed-size ring file, overwriting the oldest boots once it's full
+//
+// the ring file is crash-safe:
+//  - a record is only written out in full (and synced) before the header pointing to it is updated
+//  - there are two copies of the header, written alternately, so that a torn header write still leaves the previous one intact
+//  - each record and header is checksummed, and records link back to the previous one, so partially overwritten records are never read back
+
+#define HISTORY_PATH "/var/db/init/history"
+#define HISTORY_SIZE (4 * 1024 * 1024)
+
+typedef enum {
+	HISTORY_PHASE_DISCOVER, // reading and parsing services
+	HISTORY_PHASE_RESOLVE,  // building, checking, and reducing the dependency graph
+	HISTORY_PHASE_SELECT,   // selecting services to start
+	HISTORY_PHASE_RUN,      // starting services and waiting for them to complete
+	HISTORY_PHASE_COUNT,
+} history_phase_t;
+
+extern char const* history_phase_names[HISTORY_PHASE_COUNT];
+
+typedef struct {
+	char const* name;
+
+	float start; // relative to the start of the run phase
+	float duration;
+	uint8_t state; // 'service_state_t'
+	usage_t usage; // all zeros for boots recorded before resource usage was
+} history_service_t;
+
+typedef struct {
+	int64_t time; // wall clock time the boot was recorded at
+	uint64_t seq;
+
+	float phases[HISTORY_PHASE_COUNT];
+
+	size_t services_len;
+	history_service_t* services;
+
+	void* buf; // serialised record, which service names point into
+} history_boot_t;
+
+// records not yet written out to the ring file
+// early in the boot, the filesystem the ring file is on may well not be writable yet, so records are kept here until it is
+
+typedef struct history_pending_t history_pending_t;
+
+struct history_pending_t {
+	history_pending_t* next;
+
+	size_t len;
+	char buf[];
+};
+
+typedef struct {
+	char const* path;
+	history_pending_t* pending;
+} history_t;
+
+void history_init(history_t* history, char const* path);
+void history_free(history_t* history); // any records still pending are lost
+
+// record a boot run by 'sched' (only services which were actually started are recorded)
+// 'phases' is how long each phase of the boot took, in seconds, and 'run_start' is when the run phase started (cf. '__get_time')
+
+void history_record(history_t* history, sched_t const* sched, long double const* phases, long double run_start);
+
+// try writing out pending records to the ring file, in the order they were recorded
+// returns -1 (with 'errno' set) if the ring file can't be written to yet, in which case the remaining records are kept around for next time
+
+int history_flush(history_t* history);
+
+// read back up to 'max' of the latest boots from a ring file, latest first
+// returns the number of boots read, or -1 if the ring file couldn't be opened (in which case 'errno' is set)
+
+ssize_t history_read(char const* path, size_t max, history_boot_t** boots);
+void history_boots_free(size_t boots_len, history_boot_t* boots);
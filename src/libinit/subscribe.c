@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "subscribe.h"
+
+// send the subscription request over an already connected socket, and wait for init to acknowledge it
+
+static int subscribe(int fd, size_t names_len, char const* const names[], uint16_t mask, bool replay) {
+	proto_req_msg_t req;
+	memset(&req, 0, sizeof req);
+
+	req.header = (proto_req_t) {
+		.magic = PROTO_MAGIC,
+		.version = PROTO_VERSION,
+		.cmd = PROTO_CMD_SUBSCRIBE,
+		.count = names_len,
+		.flags = (mask & PROTO_SUB_TYPES) | (replay ? PROTO_SUB_REPLAY : 0),
+	};
+
+	for (size_t i = 0; i < names_len; i++) {
+		strncpy(req.names[i], names[i], PROTO_NAME_LEN - 1);
+	}
+
+	if (send(fd, &req, sizeof req.header + names_len * PROTO_NAME_LEN, MSG_EOR) < 0) {
+		return -1;
+	}
+
+	proto_res_t res;
+	ssize_t len = recv(fd, &res, sizeof res, 0);
+
+	if (len < 0) {
+		return -1;
+	}
+
+	if ((size_t) len < sizeof res || res.magic != PROTO_MAGIC || res.cmd != PROTO_CMD_SUBSCRIBE || res.err) {
+		errno = (size_t) len == sizeof res && res.err == PROTO_ERR_UNKNOWN_SERVICE ? ENOENT : EPROTO;
+		return -1;
+	}
+
+	return 0;
+}
+
+int subscription_open(subscription_t* sub, size_t names_len, char const* const names[], uint16_t mask, bool replay) {
+	sub->fd = -1;
+
+	if (names_len > PROTO_MAX_NAMES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, PROTO_SOCK_PATH, sizeof addr.sun_path - 1);
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr*) &addr, sizeof addr) < 0 || subscribe(fd, names_len, names, mask, replay) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+
+		return -1;
+	}
+
+	sub->fd = fd;
+	return 0;
+}
+
+void subscription_close(subscription_t* sub) {
+	if (sub->fd >= 0) {
+		close(sub->fd);
+	}
+
+	sub->fd = -1;
+}
+
+ssize_t subscription_read(subscription_t* sub, proto_event_t events[PROTO_MAX_EVENTS]) {
+	for (;;) {
+		proto_res_msg_t res;
+		ssize_t len = recv(sub->fd, &res, sizeof res, 0);
+
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (len < 0) {
+			return -1;
+		}
+
+		if (!len) {
+			errno = ECONNRESET;
+			return -1;
+		}
+
+		// anything other than events (which we never asked for) is ignored
+
+		if ((size_t) len < sizeof res.header || res.header.magic != PROTO_MAGIC || res.header.cmd != PROTO_CMD_EVENTS) {
+			continue;
+		}
+
+		size_t count = res.header.count;
+
+		if (count > PROTO_MAX_EVENTS || (size_t) len < sizeof res.header + count * sizeof *res.events) {
+			errno = EPROTO;
+			return -1;
+		}
+
+		memcpy(events, res.events, count * sizeof *events);
+		return count;
+	}
+}
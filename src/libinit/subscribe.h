@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "../proto.h"
+
+// subscription to the lifecycle events of services, pushed by init over its control socket as they happen (cf. 'PROTO_CMD_SUBSCRIBE')
+
+typedef struct {
+	int fd;
+} subscription_t;
+
+// subscribe to the events of the services named (all of them if 'names_len' is 0, up to 'PROTO_MAX_NAMES' otherwise), of the types in 'mask' ('1 << type', all of them if 0)
+// with 'replay', all past events init still remembers are sent first
+// returns -1 and sets 'errno' if init couldn't be reached, or refused the subscription ('ENOENT' for unknown services, 'EPROTO' for anything else)
+
+int subscription_open(subscription_t* sub, size_t names_len, char const* const names[], uint16_t mask, bool replay);
+void subscription_close(subscription_t* sub);
+
+// wait for the next batch of events
+// returns the number of events written to 'events', or -1 and sets 'errno' if the connection to init was lost
+
+ssize_t subscription_read(subscription_t* sub, proto_event_t events[PROTO_MAX_EVENTS]);
+
+// file descriptor which is readable when there are events waiting, for use with 'poll' & co.
+
+static inline int subscription_fd(subscription_t const* sub) {
+	return sub->fd;
+}
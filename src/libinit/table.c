@@ -0,0 +1,114 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "table.h"
+
+int table_view_open(table_view_t* view) {
+	memset(view, 0, sizeof *view);
+
+	int fd = shm_open(TABLE_SHM_NAME, O_RDONLY, 0);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat sb;
+
+	if (fstat(fd, &sb) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	if ((size_t) sb.st_size < sizeof(table_header_t)) {
+		close(fd);
+
+		errno = EPROTO;
+		return -1;
+	}
+
+	void* map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	table_header_t const* header = map;
+
+	if (
+		header->magic != TABLE_MAGIC ||
+		header->version != TABLE_VERSION ||
+		header->entry_size != sizeof(table_entry_t) ||
+		table_size(header->services_len) > (size_t) sb.st_size
+	) {
+		munmap(map, sb.st_size);
+
+		errno = EPROTO;
+		return -1;
+	}
+
+	view->size = sb.st_size;
+	view->header = header;
+	view->entries = (table_entry_t const*) (header + 1);
+
+	return 0;
+}
+
+void table_view_close(table_view_t* view) {
+	if (view->header) {
+		munmap((void*) view->header, view->size);
+	}
+
+	memset(view, 0, sizeof *view);
+}
+
+ssize_t table_view_search(table_view_t const* view, char const* name) {
+	for (size_t i = 0; i < view->header->services_len; i++) {
+		if (!strncmp(view->entries[i].name, name, TABLE_NAME_LEN)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void table_view_read(table_view_t const* view, size_t index, table_service_t* service) {
+	table_entry_t const* entry = &view->entries[index];
+
+	for (;;) {
+		uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+
+		if (seq & 1) {
+			continue; // init is in the middle of writing this entry
+		}
+
+		memcpy(service, (void const*) &entry->service, sizeof *service);
+		atomic_thread_fence(memory_order_acquire);
+
+		if (atomic_load_explicit(&entry->seq, memory_order_relaxed) == seq) {
+			return;
+		}
+	}
+}
+
+uint32_t table_view_snapshot(table_view_t const* view, table_service_t* services) {
+	table_header_t const* header = view->header;
+
+	for (;;) {
+		uint32_t generation = atomic_load_explicit(&header->generation, memory_order_acquire);
+
+		for (size_t i = 0; i < header->services_len; i++) {
+			table_view_read(view, i, &services[i]);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+
+		if (atomic_load_explicit(&header->generation, memory_order_relaxed) == generation) {
+			return generation;
+		}
+	}
+}
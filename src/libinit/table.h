@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// read-only table of the status of every service, published by init in POSIX shared memory
+// anyone can map it and read the status of services without any syscall or IPC to init
+//
+// the table is a header followed by an entry per service, in the same order as init's dependency graph
+// each entry is guarded by its own sequence lock: init makes its sequence number odd while writing the entry, and even again once done
+// readers retry until they've read an entry with the same even sequence number before and after
+// the header also has a generation counter which is bumped after every change to any entry, so that a consistent snapshot of the whole table can be read (and pollers can tell nothing has changed without reading any entries)
+
+#define TABLE_SHM_NAME "/init.status"
+
+#define TABLE_MAGIC 0x54415453 // "STAT"
+#define TABLE_VERSION 2
+
+#define TABLE_NAME_LEN 64 // including the null terminator
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size; // 'sizeof(table_entry_t)', so readers can check they agree on the layout
+	uint32_t services_len;
+	int32_t init_pid; // if this changes between two reads, init was restarted and the table has to be opened again
+	_Atomic uint32_t generation;
+	uint32_t pad;
+} table_header_t;
+
+typedef struct {
+	uint8_t state; // 'service_state_t'
+	uint8_t pad[3];
+	int32_t pid; // 0 if not running
+	int32_t exit_code; // of the last time the service exited (-1 if it was killed by a signal)
+	uint32_t restarts; // number of times the service was started again after the first
+	double start_time; // seconds on 'CLOCK_MONOTONIC' the service was last started (0 if never)
+	double exit_time; // seconds on 'CLOCK_MONOTONIC' the service last exited (0 if never, or if it's running again since)
+
+	// resources used by all the processes of the service reaped so far, over all its runs, including daemons it forked off (cf. getrusage(2))
+
+	double utime; // seconds of user CPU time
+	double stime; // seconds of system CPU time
+	uint64_t maxrss; // largest resident set size of any one of its processes, in kilobytes
+	uint64_t inblock; // block input operations
+	uint64_t oublock; // block output operations
+	uint64_t nvcsw; // voluntary context switches
+	uint64_t nivcsw; // involuntary context switches
+} table_service_t;
+
+typedef struct {
+	_Atomic uint32_t seq;
+	uint32_t pad;
+	table_service_t service;
+	char name[TABLE_NAME_LEN]; // never changes, so not guarded by the sequence lock
+} table_entry_t;
+
+_Static_assert(sizeof(table_header_t) == 24, "table header must stay fixed-size");
+_Static_assert(sizeof(table_service_t) == 88, "table entries must stay fixed-size");
+_Static_assert(sizeof(table_entry_t) == 160, "table entries must stay fixed-size");
+
+static inline size_t table_size(size_t services_len) {
+	return sizeof(table_header_t) + services_len * sizeof(table_entry_t);
+}
+
+static inline table_entry_t* table_entries(table_header_t* header) {
+	return (table_entry_t*) (header + 1);
+}
+
+// reading side (libinit)
+
+typedef struct {
+	size_t size;
+	table_header_t const* header;
+	table_entry_t const* entries;
+} table_view_t;
+
+// map the table read-only
+// returns -1 and sets 'errno' if init isn't publishing one, or if it's laid out differently than we expect ('EPROTO')
+
+int table_view_open(table_view_t* view);
+void table_view_close(table_view_t* view);
+
+// index of the service with the given name, or -1 if there is none
+
+ssize_t table_view_search(table_view_t const* view, char const* name);
+
+// read a consistent copy of a single service's entry
+
+void table_view_read(table_view_t const* view, size_t index, table_service_t* service);
+
+// read a consistent copy of every service's entry at once (into 'services', which must have room for 'header->services_len' of them)
+// returns the generation the snapshot is of
+
+uint32_t table_view_snapshot(table_view_t const* view, table_service_t* services);
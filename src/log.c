@@ -0,0 +1,679 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+// the ring is a bounded queue where each slot carries a sequence number telling producers and the consumer whose turn it is (cf. Dmitry Vyukov's bounded MPMC queue)
+//  - a slot whose sequence number equals the producer position is free to be claimed
+//  - a slot whose sequence number is one past the consumer position holds a record ready to be written
+// producers only ever contend on the position they're claiming, and never wait on the consumer
+
+#define RING_MASK (LOG_RING_SLOTS - 1)
+
+// how often the writer retries opening the log file while it can't
+
+#define OPEN_RETRY_INTERVAL 1
+
+typedef struct {
+	_Atomic size_t seq;
+
+	umber_lvl_t lvl;
+	bool event;
+	char const* component;
+	char const* path;
+	char const* func;
+	uint32_t line;
+
+	struct timespec time;
+
+	char const* fmt;
+	size_t args_len;
+	char args[LOG_ARGS_SIZE];
+} slot_t;
+
+static slot_t ring[LOG_RING_SLOTS];
+
+static _Atomic size_t head; // next position producers claim
+static _Atomic size_t consumed; // everything before this position has been written
+static size_t tail; // next position the writer consumes (only ever touched by the writer)
+
+static _Atomic size_t dropped;
+
+static bool initialised;
+static pid_t owner; // forked children don't have a writer thread
+
+static _Atomic bool waiting; // whether the writer is (about to be) asleep
+static sem_t wake;
+static pthread_t writer;
+
+// only ever contended when writing out fatal errors synchronously
+
+static pthread_mutex_t emit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic bool quiet_events;
+static bool status_shown; // whether there's a status line on the console which needs clearing (protected by 'emit_lock')
+
+static char const* file_path;
+static int fd = -1;
+static time_t last_open_try;
+
+static size_t early_len;
+static char early[LOG_EARLY_SIZE];
+static size_t early_dropped;
+
+static char const* lvl_names[] = {
+	[UMBER_LVL_FATAL]   = "FATAL",
+	[UMBER_LVL_ERROR]   = "ERROR",
+	[UMBER_LVL_WARN]    = "WARN",
+	[UMBER_LVL_SUCCESS] = "SUCCESS",
+	[UMBER_LVL_INFO]    = "INFO",
+	[UMBER_LVL_VERBOSE] = "VERBOSE",
+};
+
+static void write_all(char const* buf, size_t len) {
+	while (len) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (written <= 0) {
+			return;
+		}
+
+		buf += written;
+		len -= written;
+	}
+}
+
+static void clear_status(void) {
+	if (status_shown) {
+		(void) !write(STDERR_FILENO, "\r\033[K", 4);
+		status_shown = false;
+	}
+}
+
+// deferred formatting
+// the arguments of a record are captured by walking its format string the way printf would, so that exactly what it names is copied
+// strings are copied in full, as whatever they point to may well be gone by the time the writer gets to them
+// anything which doesn't fit in the argument blob (or conversions we don't know, like '%n') cuts the message short there
+
+typedef enum {
+	ARG_NONE, // '%%'
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_INTMAX,
+	ARG_SIZE,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_STR,
+	ARG_PTR,
+	ARG_INVALID,
+} arg_kind_t;
+
+typedef struct {
+	char const* start; // the '%'
+	char const* end; // just past the conversion specifier
+
+	arg_kind_t kind;
+
+	unsigned stars; // each '*' width or precision takes an extra 'int' argument before the value itself
+	bool star_precision;
+	int precision; // -1 if none (or if given as a '*')
+} spec_t;
+
+static void parse_spec(char const* p, spec_t* spec) {
+	spec->start = p++;
+	spec->stars = 0;
+	spec->star_precision = false;
+	spec->precision = -1;
+
+	p += strspn(p, "-+ #0'");
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	}
+
+	else {
+		p += strspn(p, "0123456789");
+	}
+
+	if (*p == '.') {
+		p++;
+
+		if (*p == '*') {
+			spec->stars++;
+			spec->star_precision = true;
+			p++;
+		}
+
+		else {
+			spec->precision = atoi(p);
+			p += strspn(p, "0123456789");
+		}
+	}
+
+	// length modifiers ('hh' and 'h' are promoted to 'int' anyway)
+
+	arg_kind_t integer = ARG_INT;
+	bool is_long_double = false;
+
+	if (*p == 'h') {
+		p += p[1] == 'h' ? 2 : 1;
+	}
+
+	else if (*p == 'l') {
+		integer = p[1] == 'l' ? ARG_LLONG : ARG_LONG;
+		p += p[1] == 'l' ? 2 : 1;
+	}
+
+	else if (*p == 'j' || *p == 'z' || *p == 't' || *p == 'L') {
+		integer = *p == 'j' ? ARG_INTMAX : *p == 'z' ? ARG_SIZE : *p == 't' ? ARG_PTRDIFF : ARG_INT;
+		is_long_double = *p == 'L';
+		p++;
+	}
+
+	char conv = *p;
+	spec->end = conv ? p + 1 : p;
+
+	spec->kind =
+		conv == '%' ? ARG_NONE :
+		conv && strchr("diouxXc", conv) ? integer :
+		conv && strchr("fFeEgGaA", conv) ? (is_long_double ? ARG_LDOUBLE : ARG_DOUBLE) :
+		conv == 's' ? ARG_STR :
+		conv == 'p' ? ARG_PTR :
+		ARG_INVALID;
+}
+
+// copy the arguments 'fmt' names into 'args', returning how many bytes of it were used
+
+static size_t capture(char* args, char const* fmt, va_list ap) {
+	size_t len = 0;
+
+	#define PUT(type, promoted) { \
+		type val = va_arg(ap, promoted); \
+		\
+		if (len + sizeof val > LOG_ARGS_SIZE) { \
+			return len; \
+		} \
+		\
+		memcpy(args + len, &val, sizeof val); \
+		len += sizeof val; \
+	}
+
+	spec_t spec;
+
+	for (char const* p = fmt; (p = strchr(p, '%')); p = spec.end) {
+		parse_spec(p, &spec);
+
+		if (spec.kind == ARG_INVALID) {
+			break;
+		}
+
+		int precision = spec.precision;
+
+		for (unsigned i = 0; i < spec.stars; i++) {
+			int star = va_arg(ap, int);
+
+			if (len + sizeof star > LOG_ARGS_SIZE) {
+				return len;
+			}
+
+			memcpy(args + len, &star, sizeof star);
+			len += sizeof star;
+
+			precision = spec.star_precision ? star : precision;
+		}
+
+		if (spec.kind == ARG_INT) PUT(int, int)
+		else if (spec.kind == ARG_LONG) PUT(long, long)
+		else if (spec.kind == ARG_LLONG) PUT(long long, long long)
+		else if (spec.kind == ARG_INTMAX) PUT(intmax_t, intmax_t)
+		else if (spec.kind == ARG_SIZE) PUT(size_t, size_t)
+		else if (spec.kind == ARG_PTRDIFF) PUT(ptrdiff_t, ptrdiff_t)
+		else if (spec.kind == ARG_DOUBLE) PUT(double, double)
+		else if (spec.kind == ARG_LDOUBLE) PUT(long double, long double)
+		else if (spec.kind == ARG_PTR) PUT(void*, void*)
+
+		else if (spec.kind == ARG_STR) {
+			char const* str = va_arg(ap, char const*);
+			str = str ? str : "(null)";
+
+			// strings are stored NUL-terminated, cut short to whatever room is left (and never read past an explicit precision)
+
+			if (len >= LOG_ARGS_SIZE) {
+				return len;
+			}
+
+			size_t max = LOG_ARGS_SIZE - len - 1;
+
+			if (precision >= 0 && (size_t) precision < max) {
+				max = precision;
+			}
+
+			size_t str_len = strnlen(str, max);
+
+			memcpy(args + len, str, str_len);
+			args[len + str_len] = '\0';
+			len += str_len + 1;
+		}
+	}
+
+	#undef PUT
+
+	return len;
+}
+
+// format a captured record into 'msg' (of size 'LOG_MSG_SIZE')
+
+static void render(slot_t const* slot, char* msg) {
+	char const* args = slot->args;
+	size_t pos = 0;
+
+	size_t off = 0;
+	size_t const size = LOG_MSG_SIZE;
+
+	bool cut = false; // whether we ran out of captured arguments
+
+	#define APPEND(len) { \
+		int _len = (len); \
+		off += _len < 0 ? 0 : (size_t) _len < size - off ? (size_t) _len : size - off - 1; \
+	}
+
+	#define GET(type, var) \
+		type var; \
+		\
+		if (pos + sizeof var > slot->args_len) { \
+			cut = true; \
+			break; \
+		} \
+		\
+		memcpy(&var, args + pos, sizeof var); \
+		pos += sizeof var;
+
+	spec_t spec;
+	char const* p = slot->fmt;
+
+	for (char const* next; off < size - 1 && (next = strchr(p, '%')); p = spec.end) {
+		APPEND(snprintf(msg + off, size - off, "%.*s", (int) (next - p), p))
+		parse_spec(next, &spec);
+
+		if (spec.kind == ARG_INVALID) {
+			p = next; // written out as is
+			break;
+		}
+
+		if (spec.kind == ARG_NONE) {
+			APPEND(snprintf(msg + off, size - off, "%%"))
+			continue;
+		}
+
+		// rebuild the conversion specification with its '*'s substituted, so that it only ever takes the value itself
+
+		char conv[64];
+		size_t conv_len = 0;
+
+		for (char const* c = spec.start; c < spec.end && !cut; c++) {
+			if (conv_len + 16 >= sizeof conv) {
+				cut = true;
+			}
+
+			else if (*c != '*') {
+				conv[conv_len++] = *c;
+			}
+
+			else {
+				GET(int, star)
+				conv_len += snprintf(conv + conv_len, sizeof conv - conv_len, "%d", star);
+			}
+		}
+
+		if (cut) {
+			break;
+		}
+
+		conv[conv_len] = '\0';
+
+		if (spec.kind == ARG_INT) { GET(int, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_LONG) { GET(long, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_LLONG) { GET(long long, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_INTMAX) { GET(intmax_t, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_SIZE) { GET(size_t, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_PTRDIFF) { GET(ptrdiff_t, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_DOUBLE) { GET(double, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_LDOUBLE) { GET(long double, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+		else if (spec.kind == ARG_PTR) { GET(void*, val) APPEND(snprintf(msg + off, size - off, conv, val)) }
+
+		else if (spec.kind == ARG_STR) {
+			if (pos >= slot->args_len) {
+				cut = true;
+				break;
+			}
+
+			char const* str = args + pos;
+			pos += strlen(str) + 1;
+
+			APPEND(snprintf(msg + off, size - off, conv, str))
+		}
+	}
+
+	// whatever's left after the last conversion
+
+	if (!cut && off < size - 1) {
+		APPEND(snprintf(msg + off, size - off, "%s", p))
+	}
+
+	#undef APPEND
+	#undef GET
+
+	msg[off] = '\0';
+}
+
+// hand a record off to umber, and write it to the log file (or the early buffer if it's not open yet)
+
+static void emit(slot_t const* slot, char const* msg) {
+	pthread_mutex_lock(&emit_lock);
+
+	if (!slot->event || !atomic_load_explicit(&quiet_events, memory_order_relaxed)) {
+		clear_status();
+		umber_log(slot->lvl, slot->component, slot->path, slot->func, slot->line, msg);
+	}
+
+	struct tm tm;
+	localtime_r(&slot->time.tv_sec, &tm);
+
+	char date[32];
+	strftime(date, sizeof date, "%Y-%m-%d %H:%M:%S", &tm);
+
+	char line[LOG_MSG_SIZE + 128];
+	int len = snprintf(line, sizeof line, "%s.%03ld %s %s: %s\n", date, slot->time.tv_nsec / 1000000, lvl_names[slot->lvl], slot->component, msg);
+
+	if (len > (int) sizeof line - 1) {
+		len = sizeof line - 1;
+	}
+
+	if (fd >= 0) {
+		write_all(line, len);
+	}
+
+	else if (early_len + len <= sizeof early) {
+		memcpy(early + early_len, line, len);
+		early_len += len;
+	}
+
+	else {
+		early_dropped++;
+	}
+
+	pthread_mutex_unlock(&emit_lock);
+}
+
+static void try_open(void) {
+	time_t now = time(NULL);
+
+	if (now - last_open_try < OPEN_RETRY_INTERVAL) {
+		return;
+	}
+
+	last_open_try = now;
+	int new_fd = open(file_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+	if (new_fd < 0) {
+		return;
+	}
+
+	// write out everything buffered up until now
+
+	pthread_mutex_lock(&emit_lock);
+
+	fd = new_fd;
+	write_all(early, early_len);
+
+	if (early_dropped) {
+		char line[128];
+		int len = snprintf(line, sizeof line, "(%zu records dropped before the log file could be opened)\n", early_dropped);
+
+		write_all(line, len);
+	}
+
+	early_len = 0;
+	early_dropped = 0;
+
+	pthread_mutex_unlock(&emit_lock);
+}
+
+static bool ready(void) {
+	return atomic_load_explicit(&ring[tail & RING_MASK].seq, memory_order_acquire) == tail + 1;
+}
+
+static void* writer_thread(void* arg) {
+	(void) arg;
+
+	for (;;) {
+		while (ready()) {
+			slot_t* slot = &ring[tail & RING_MASK];
+
+			char msg[LOG_MSG_SIZE];
+			render(slot, msg);
+
+			emit(slot, msg);
+
+			// give the slot back to producers
+
+			atomic_store_explicit(&slot->seq, tail + LOG_RING_SLOTS, memory_order_release);
+			atomic_store_explicit(&consumed, ++tail, memory_order_release);
+		}
+
+		size_t lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+
+		if (lost) {
+			slot_t slot = {
+				.lvl = UMBER_LVL_WARN,
+				.component = "LOG",
+				.path = __FILE__,
+				.func = __func__,
+				.line = __LINE__,
+			};
+
+			clock_gettime(CLOCK_REALTIME, &slot.time);
+
+			char msg[LOG_MSG_SIZE];
+			snprintf(msg, sizeof msg, "Dropped %zu log records (ring buffer full)", lost);
+
+			emit(&slot, msg);
+		}
+
+		if (fd < 0) {
+			try_open();
+		}
+
+		// go to sleep until woken up by a producer
+		// we still wake up every so often while the log file isn't open, to try opening it again
+
+		atomic_store_explicit(&waiting, true, memory_order_seq_cst);
+
+		if (ready()) {
+			atomic_store_explicit(&waiting, false, memory_order_relaxed);
+			continue;
+		}
+
+		if (fd < 0) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += OPEN_RETRY_INTERVAL;
+
+			sem_timedwait(&wake, &deadline);
+		}
+
+		else {
+			sem_wait(&wake);
+		}
+	}
+
+	return NULL;
+}
+
+void log_init(char const* path) {
+	file_path = path;
+
+	for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+		atomic_init(&ring[i].seq, i);
+	}
+
+	sem_init(&wake, 0, 0);
+
+	if (pthread_create(&writer, NULL, writer_thread, NULL)) {
+		return; // everything is just logged synchronously then
+	}
+
+	pthread_detach(writer);
+
+	owner = getpid();
+	initialised = true;
+
+	atexit(log_flush);
+}
+
+void log_flush(void) {
+	if (!initialised || getpid() != owner) {
+		return;
+	}
+
+	size_t target = atomic_load_explicit(&head, memory_order_acquire);
+
+	atomic_store_explicit(&waiting, false, memory_order_relaxed);
+	sem_post(&wake);
+
+	while (atomic_load_explicit(&consumed, memory_order_acquire) < target) {
+		struct timespec ts = { .tv_nsec = 1000000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+void log_quiet_events(bool quiet) {
+	atomic_store_explicit(&quiet_events, quiet, memory_order_relaxed);
+}
+
+void log_status(char const* status) {
+	pthread_mutex_lock(&emit_lock);
+	clear_status();
+
+	if (status) {
+		// on terminals, the status line is refreshed in place, and otherwise, it's just written out as a line like any other
+
+		bool tty = isatty(STDERR_FILENO);
+
+		char line[512];
+		int len = snprintf(line, sizeof line, "%s%s", status, tty ? "" : "\n");
+
+		if (len > (int) sizeof line - 1) {
+			len = sizeof line - 1;
+		}
+
+		(void) !write(STDERR_FILENO, line, len);
+		status_shown = tty;
+	}
+
+	pthread_mutex_unlock(&emit_lock);
+}
+
+void log_push(umber_lvl_t lvl, bool event, char const* component, char const* path, char const* func, uint32_t line, char const* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+
+	// log synchronously if there's no writer to hand the record off to, or if it's a fatal error
+
+	if (!initialised || getpid() != owner || lvl == UMBER_LVL_FATAL) {
+		slot_t slot = {
+			.lvl = lvl,
+			.event = event,
+			.component = component,
+			.path = path,
+			.func = func,
+			.line = line,
+		};
+
+		clock_gettime(CLOCK_REALTIME, &slot.time);
+
+		char msg[LOG_MSG_SIZE];
+		vsnprintf(msg, sizeof msg, fmt, args);
+
+		log_flush();
+		emit(&slot, msg);
+
+		va_end(args);
+		return;
+	}
+
+	// claim a slot
+
+	size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+	slot_t* slot;
+
+	for (;;) {
+		slot = &ring[pos & RING_MASK];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+		if (!diff) {
+			if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+
+		else if (diff < 0) {
+			// ring is full, drop the record instead of waiting on the writer
+
+			atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+
+			va_end(args);
+			return;
+		}
+
+		else {
+			pos = atomic_load_explicit(&head, memory_order_relaxed);
+		}
+	}
+
+	// fill it in and publish it
+
+	slot->lvl = lvl;
+	slot->event = event;
+	slot->component = component;
+	slot->path = path;
+	slot->func = func;
+	slot->line = line;
+
+	// only the arguments are copied here, the message is formatted by the writer
+
+	clock_gettime(CLOCK_REALTIME, &slot->time);
+
+	slot->fmt = fmt;
+	slot->args_len = capture(slot->args, fmt, args);
+
+	va_end(args);
+
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+	// wake the writer up if it's asleep
+
+	if (atomic_exchange_explicit(&waiting, false, memory_order_seq_cst)) {
+		sem_post(&wake);
+	}
+}
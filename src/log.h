@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <umber.h>
+
+// asynchronous logging in front of umber
+// log records are captured into a lock-free ring buffer (multiple producers, single consumer) from whichever thread logs them, and handed off to umber and written to the log file by a dedicated writer thread
+// this way, a slow console never holds up scheduling services
+// logging threads don't format anything either: they only copy the arguments the format string names (strings included), and the writer formats the message from those
+// format strings must therefore outlive the record, which they do as the macros below are only ever passed literals
+//
+// before the log file can be opened (i.e. before '/var' is mounted read-write), records destined for it are buffered in memory, and written out as soon as it can be
+// if the ring is full, records are dropped and counted rather than waited on
+
+#define LOG_PATH "/var/log/init.log"
+
+#define LOG_RING_SLOTS 1024 // must be a power of two
+#define LOG_MSG_SIZE 256 // longer messages are truncated
+#define LOG_ARGS_SIZE 256 // arguments which don't fit (e.g. very long strings) truncate the message there
+#define LOG_EARLY_SIZE (1024 * 1024) // how much to buffer before the log file can be opened
+
+void log_init(char const* path);
+void log_flush(void); // wait for all records logged so far to be written
+
+// 'event' records are routine per-service events (e.g. a service starting or completing), which only go to the log file while events are quiet
+
+void log_push(umber_lvl_t lvl, bool event, char const* component, char const* path, char const* func, uint32_t line, char const* fmt, ...) __attribute__((format(printf, 7, 8)));
+
+// keep event records off the console, e.g. while a status summary is being shown there instead
+
+void log_quiet_events(bool quiet);
+
+// show a status line on the console, which is refreshed in place on terminals (and cleared before anything else is written to the console)
+// NULL clears it
+
+void log_status(char const* status);
+
+// replace umber's logging macros, so that everything including this header goes through the ring
+// fatal errors are the exception, which are written out synchronously (after everything before them), as we're most likely about to exit
+
+#undef LOG_FATAL
+#undef LOG_ERROR
+#undef LOG_WARN
+#undef LOG_SUCCESS
+#undef LOG_INFO
+#undef LOG_VERBOSE
+
+#define __LOG(lvl, event, ...) { log_push((lvl), (event), UMBER_COMPONENT, __FILE__, __func__, __LINE__, __VA_ARGS__); }
+
+#define LOG_FATAL(...)   __LOG(UMBER_LVL_FATAL,   false, __VA_ARGS__)
+#define LOG_ERROR(...)   __LOG(UMBER_LVL_ERROR,   false, __VA_ARGS__)
+#define LOG_WARN(...)    __LOG(UMBER_LVL_WARN,    false, __VA_ARGS__)
+#define LOG_SUCCESS(...) __LOG(UMBER_LVL_SUCCESS, false, __VA_ARGS__)
+#define LOG_INFO(...)    __LOG(UMBER_LVL_INFO,    false, __VA_ARGS__)
+#define LOG_VERBOSE(...) __LOG(UMBER_LVL_VERBOSE, false, __VA_ARGS__)
+
+#define LOG_EVENT_INFO(...)    __LOG(UMBER_LVL_INFO,    true, __VA_ARGS__)
+#define LOG_EVENT_SUCCESS(...) __LOG(UMBER_LVL_SUCCESS, true, __VA_ARGS__)
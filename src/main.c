@@ -1,7 +1,6 @@
 // TODO:
 //  - rename this to whichever name I decide to land on (don't forget to do a quick ':%s/init/whatever/g')
 //  - support booting the system diskless (cf. '/etc/rc.initdiskless')
-//  - perhaps a hashmap system for resolving dependencies in a better time complexity (similar to what rcorder(8) does on NetBSD)
 //  - record timing, which can I guess either be written to a log at some point or queried with some command
 
 #include <errno.h>
@@ -12,866 +11,704 @@
 #include <time.h>
 #include <unistd.h>
 
-#include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>
-#include <pthread.h>
 #include <signal.h>
-#include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <sys/wait.h>
 
 #include <grp.h>
-#include <mqueue.h>
-#include <libutil.h>
 
 #include <umber.h>
 #define UMBER_COMPONENT "GAIA"
 
+#include "arena.h"
+#include "bitset.h"
+#include "control.h"
+#include "discover.h"
+#include "events.h"
+#include "graph.h"
+#include "history.h"
+#include "log.h"
+#include "memo.h"
+#include "output.h"
+#include "proctree.h"
+#include "proto.h"
+#include "readahead.h"
+#include "sampler.h"
+#include "sched.h"
+#include "service.h"
+#include "sim.h"
+#include "status.h"
+#include "strtab.h"
+#include "table.h"
+#include "timer.h"
+#include "timing.h"
+
 #define FATAL_ERROR(...) \
 	LOG_FATAL(__VA_ARGS__); \
 	exit(EXIT_FAILURE);
 
 // defines
 
-#define MQ_NAME "/init"
+#define SOCK_PATH PROTO_SOCK_PATH
 #define SERVICE_GROUP "service" // TODO find a more creative name
 
-#define MAX_MESSAGES 10 // not yet sure what this signifies
-#define MESSAGE_SIZE 256
+#define LISTEN_RETRY_INTERVAL 1000 // milliseconds between attempts at listening on the control socket while its filesystem isn't writable
 
 #define INIT_ROOT "conf/init/"
 #define MOD_DIR INIT_ROOT "mods/"
 
-// types
-
-typedef enum {
-	SERVICE_KIND_GENERIC,
-	SERVICE_KIND_RESEARCH, // for research UNIX-style runcom scripts
-	SERVICE_KIND_AQUABSD,
-} service_kind_t;
-
-typedef struct {
-	size_t provides_len;
-	char** provides;
-} service_research_t;
-
-typedef int (*aquabsd_start_func_t) (void);
-
-typedef struct {
-	void* lib;
-	aquabsd_start_func_t start;
-} service_aquabsd_t;
-
-typedef struct service_t service_t;
-
-struct service_t {
-	service_kind_t kind;
-
-	char* name;
-	char* path;
-
-	size_t deps_len;
-
-	char** dep_names;
-	service_t** deps;
-
-	bool check_circular_passed;
-
-	// service flags (these are what NetBSD would call "keywords")
-
-	bool on_start;
-	bool on_stop;
-	bool on_resume;
-
-	bool first_boot;
-
-	bool disable_in_jail;
-	bool disable_in_vnet;
-
-	// actual service stuff
-	// unfortunately, the C11 standard doesn't seem to support condition values/mutices, which basically makes it useless
-	// TODO the above comment *seems* to be false? Documentation is lacking, but I might aswell switch back to C11 threads if I can
-
-	bool thread_created;
-	pthread_t thread;
-	pthread_mutex_t mutex;
-	pid_t pid;
-
-	// timing stuff
+#define PARSE_ARENA_BLOCK_SIZE (64 * 1024)
 
-	long double start_time;
-	long double total_time;
-
-	// kind-specific members
-
-	union {
-		service_research_t research;
-		service_aquabsd_t aquabsd;
-	};
-};
+#define MILESTONE "LOGIN" // target whose critical path is boosted and which deferred services wait on, unless given other milestones or booting to specific targets
+#define BOOST_HISTORY 5 // past boots whose service durations the critical path is worked out from
 
 // global variables (🤮)
 
 static bool in_jail;
 static bool in_vnet;
 
+static graph_t graph;
+static arena_t parse_arena; // everything which is only needed until the boot plan is built
+static sched_t sched;
+static history_t history;
+static output_t output;
+static status_t status;
+static control_t control;
+static table_t table;
+static events_t events;
+static timers_t timers;
+static memo_t memo;
+static proctree_t tree;
+static readahead_t boot_readahead; // not just 'readahead', which clashes with readahead(2) on Linux
+static sampler_t sampler;
+
+static int reap_pipe[2]; // self-pipe written to on 'SIGCHLD', so that the control loop wakes up to reap
+
 // functions
 
-static inline long double __get_time(void) {
-	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
+static void sigchld_handler(int sig) {
+	(void) sig;
 
-	return (long double) now.tv_sec + 1.e-9 * (long double) now.tv_nsec;
+	int err = errno;
+	write(reap_pipe[1], "", 1);
+	errno = err;
 }
 
-static service_t* new_service(const char* name) {
-	service_t* service = calloc(1, sizeof *service);
-
-	service->kind = SERVICE_KIND_GENERIC;
-	service->name = strdup(name);
-
-	// set defaults for service flags
-	// by default, a service is launched on start (on regular systems and any jails)
-
-	service->on_start        = true;
-	service->on_stop         = false;
-	service->on_resume       = false;
+static void del_service(service_t* service) {
+	// everything else about the service (names, dependencies, &c) is owned by the graph
 
-	service->first_boot      = false;
+	if (service->kind == SERVICE_KIND_AQUABSD) {
+		dlclose(service->aquabsd.lib);
+	}
+}
 
-	service->disable_in_jail = false;
-	service->disable_in_vnet = false;
+static int cmp_float(void const* _a, void const* _b) {
+	float a = *(float const*) _a;
+	float b = *(float const*) _b;
 
-	return service;
+	return (a > b) - (a < b);
 }
 
-static int fill_research_service(service_t* service) {
-	// yeah, this function really isn't pretty, but I'd rather make is as compact as possible with ugly macros as I don't really want this to be the focus of this source file
+// expected duration of each service, as the median of its durations on the last few boots
+// services which never ran on any of them (or everything, if there's no history yet) are left at 'SCHED_BOOST_ESTIMATE'
 
-	service->kind = SERVICE_KIND_RESEARCH;
+static float* estimate_durations(graph_t const* graph) {
+	size_t services_len = graph->services_len;
+	size_t alloc_len = services_len ? services_len : 1;
 
-	// read the service script, similar to what rcorder(8) does on NetBSD
-	// a lot of this code is actually even stolen from NetBSD's 'sbin/rcorder/rcorder.c'
+	float* estimates = malloc(alloc_len * sizeof *estimates);
 
-	FILE* fp = fopen(service->path, "r");
-
-	if (!fp) {
-		return -1;
+	for (size_t i = 0; i < services_len; i++) {
+		estimates[i] = SCHED_BOOST_ESTIMATE;
 	}
 
-	char* buf;
+	history_boot_t* boots;
+	ssize_t boots_len = history_read(HISTORY_PATH, BOOST_HISTORY, &boots);
 
-	// now that's what I call a BIG GRAYSON
-	// TODO little note, and probably something to fix in both FreeBSD & NetBSD, the 'REQUIRES', 'PROVIDES', & 'KEYWORDS' directives are useless (it's pretty obvious how when looking at the code)
-
-	char* require = NULL;
-	char* provide = NULL;
-	char* before  = NULL;
-	char* keyword = NULL;
+	if (boots_len <= 0) {
+		return estimates;
+	}
 
-	enum { BEFORE_PARSING, PARSING, PARSING_DONE } state;
+	uint8_t* lens = calloc(alloc_len, sizeof *lens);
+	float* samples = malloc(alloc_len * BOOST_HISTORY * sizeof *samples);
 
-	for (
-		state = BEFORE_PARSING;
-		state != PARSING_DONE && (buf = fparseln(fp, NULL, NULL, "\\\\", 0));
-		free(buf)
-	) {
-		#define DIRECTIVE(lower, upper) \
-			else if (strncmp("# " #upper ":", buf, sizeof(#upper) - 1) == 0) { \
-				lower = strdup(buf + sizeof(#upper) + 3); \
-			}
+	for (ssize_t i = 0; i < boots_len; i++) {
+		history_boot_t* boot = &boots[i];
 
-		if (0) {}
+		for (size_t j = 0; j < boot->services_len; j++) {
+			history_service_t* service = &boot->services[j];
+			uint32_t index = graph_search(graph, service->name);
 
-		DIRECTIVE(require, REQUIRE)
-		DIRECTIVE(provide, PROVIDE)
-		DIRECTIVE(before,  BEFORE )
-		DIRECTIVE(keyword, KEYWORD)
+			// only the service itself counts, not whichever one happens to provide its name now (which may well be another service altogether, or appear several times in the same boot)
 
-		else {
-			if (state == PARSING) {
-				state = PARSING_DONE;
+			if (index == GRAPH_NONE || strcmp(graph_name(graph, index), service->name)) {
+				continue;
 			}
 
-			continue;
+			if (service->state >= SERVICE_STATE_DONE && lens[index] < BOOST_HISTORY) {
+				samples[index * BOOST_HISTORY + lens[index]++] = service->duration;
+			}
 		}
-
-		#undef DIRECTIVE
-
-		state = PARSING;
 	}
 
-	// parse 'require' as service dependency names
-
-	char* str;
-
-	while ((str = strsep(&require, " \t\n"))) {
-		if (!*str) {
-			continue;
+	for (size_t i = 0; i < services_len; i++) {
+		if (lens[i]) {
+			qsort(&samples[i * BOOST_HISTORY], lens[i], sizeof *samples, cmp_float);
+			estimates[i] = samples[i * BOOST_HISTORY + lens[i] / 2];
 		}
-
-		service->dep_names = realloc(service->dep_names, ++service->deps_len * sizeof *service->dep_names);
-		service->dep_names[service->deps_len - 1] = strdup(str);
 	}
 
-	// parse 'provide' as, well, provide
+	free(lens);
+	free(samples);
+	history_boots_free(boots_len, boots);
 
-	while ((str = strsep(&provide, " \t\n"))) {
-		if (!*str) {
-			continue;
-		}
+	return estimates;
+}
 
-		service->research.provides = realloc(service->research.provides, ++service->research.provides_len * sizeof *service->research.provides);
-		service->research.provides[service->research.provides_len - 1] = strdup(str);
-	}
+int main(int argc, char* argv[]) {
+	// get logging going first, so that nothing logged from here on out holds anything up
 
-	// parse 'keyword' as service flags
-	// default were already set when creating the service object
+	log_init(LOG_PATH);
 
-	while ((str = strsep(&keyword, " \t\n"))) {
-		if (!*str) {
-			continue;
-		}
+	// parse arguments
 
-		#define KEYWORD(keyword, member, val) \
-			else if (strcmp(str, (keyword)) == 0) { \
-				service->member = (val); \
-			}
+	size_t target_names_len = 0;
+	char** target_names = NULL;
 
-		if (0) {}
+	bool export_graph = false;
+	bool report_redundant = false;
 
-		KEYWORD("nostart",    on_start,        false)
-		KEYWORD("shutdown",   on_stop,         true )
-		KEYWORD("resume",     on_resume,       true )
+	char const* sim_policy_name = NULL;
+	size_t sim_concurrency = 0;
+	char const* profile_path = NULL;
+	char const* record_path = NULL;
+	bool record_readahead = false;
+	long double sample_interval = SAMPLER_INTERVAL;
+	bool boost = true;
+	size_t milestone_names_len = 0;
+	char** milestone_names = NULL;
+	size_t deferred_concurrency = SCHED_DEFERRED_CONCURRENCY;
 
-		KEYWORD("firstboot",  first_boot,      true )
+	int c;
 
-		KEYWORD("nojail",     disable_in_jail, true )
-		KEYWORD("nojailvnet", disable_in_vnet, true )
+	while ((c = getopt(argc, argv, "BD:gj:m:p:P:rRs:S:t:")) != -1) {
+		if (c == 'B') {
+			// don't boost the services holding up the boot milestone, just run everything at the priority of its class
 
-		else {
-			LOG_WARN("Unknown research UNIX-style service keyword '%s'", str)
+			boost = false;
 		}
 
-		#undef KEYWORD
-	}
-
-	// free everything
+		else if (c == 'D') {
+			// maximum number of deferred services to run at once after they've been released
 
-	fclose(fp);
-
-	#define FREE(thing) \
-		if ((thing)) { \
-			free((thing)); \
+			deferred_concurrency = strtoul(optarg, NULL, 10);
 		}
 
-	FREE(require)
-	FREE(provide)
-	FREE(before )
-	FREE(keyword)
-
-	#undef FREE
-
-	LOG_VERBOSE("Filled research UNIX-style service %s", service->name)
-
-	return 0;
-}
-
-typedef size_t (*get_deps_len_func_t)  (void);
-typedef char** (*get_dep_names_func_t) (void);
+		else if (c == 'g') {
+			// export the dependency graph in GraphViz format to stdout instead of booting
 
-static int fill_aquabsd_service(service_t* service) {
-	service->kind = SERVICE_KIND_AQUABSD;
-
-	// we're using 'RTLD_NOW' here instead of 'RTLD_LAZY' as would normally be preferred
-	// since we only have a small number of functions that we know we'll eventually use, it's better to resolve all external symbols straight away
-
-	service->aquabsd.lib = dlopen(service->path, RTLD_NOW);
-
-	if (!service->aquabsd.lib) {
-		LOG_WARN("dlopen: failed to load %s: %s", service->path, dlerror())
-		return -1;
-	}
-
-	dlerror(); // clear last error
+			export_graph = true;
+		}
 
-	// get start function, duh
+		else if (c == 's') {
+			// simulate booting with the given scheduling policy instead of actually booting
 
-	service->aquabsd.start = dlsym(service->aquabsd.lib, "start");
+			sim_policy_name = optarg;
+		}
 
-	if (!service->aquabsd.start) {
-		LOG_WARN("aquaBSD services must have start symbol")
+		else if (c == 'j') {
+			// maximum number of services to run at once when simulating
 
-		dlclose(service->aquabsd.lib);
-		return -1;
-	}
+			sim_concurrency = strtoul(optarg, NULL, 10);
+		}
 
-	// get dependencies
+		else if (c == 'm') {
+			// boot milestone to boost the critical path of and hold deferred services back until (may be passed multiple times)
 
-	get_deps_len_func_t  get_deps_len  = dlsym(service->aquabsd.lib, "get_deps_len" );
-	get_dep_names_func_t get_dep_names = dlsym(service->aquabsd.lib, "get_dep_names");
+			milestone_names = realloc(milestone_names, ++milestone_names_len * sizeof *milestone_names);
+			milestone_names[milestone_names_len - 1] = optarg;
+		}
 
-	if (!get_deps_len || !get_dep_names) {
-		LOG_WARN("aquaBSD services must have get_deps_len & get_dep_names symbols")
+		else if (c == 'p') {
+			// profile of service durations to simulate with
 
-		dlclose(service->aquabsd.lib);
-		return -1;
-	}
-
-	service->deps_len  = get_deps_len ();
-	service->dep_names = get_dep_names();
+			profile_path = optarg;
+		}
 
-	// get service flags
+		else if (c == 'P') {
+			// record a profile of service durations after booting, for later simulation
 
-	#define FLAG(flag) \
-		if (dlsym(service->aquabsd.lib, #flag)) { \
-			service->flag = true; \
+			record_path = optarg;
 		}
 
-	FLAG(on_start       )
-	FLAG(on_stop        )
-	FLAG(on_resume      )
+		else if (c == 'r') {
+			// report all the redundant dependencies removed from the graph
 
-	FLAG(first_boot     )
-
-	FLAG(disable_in_jail)
-	FLAG(disable_in_vnet)
+			report_redundant = true;
+		}
 
-	LOG_VERBOSE("Filled aquaBSD service %s", service->name)
+		else if (c == 'R') {
+			// record a new readahead profile on this boot, even if there's one already
 
-	return 0;
-}
+			record_readahead = true;
+		}
 
-static void del_service(service_t* service) {
-	if (!service) {
-		return;
-	}
+		else if (c == 'S') {
+			// interval at which to sample the CPU and memory use of services for 'service top', in seconds (0 to not sample at all)
 
-	#define FREE(thing) \
-		if ((thing)) { \
-			free((thing)); \
+			sample_interval = strtold(optarg, NULL);
 		}
 
-	for (size_t i = 0; i < service->deps_len; i++) {
-		FREE(service->dep_names[i])
-	}
+		else if (c == 't') {
+			// boot only up to the given target (may be passed multiple times)
 
-	if (service->deps) {
-		FREE(service->deps)
-	}
-
-	if (service->kind == SERVICE_KIND_RESEARCH) {
-		for (size_t i = 0; i < service->research.provides_len; i++) {
-			FREE(service->research.provides[i])
+			target_names = realloc(target_names, ++target_names_len * sizeof *target_names);
+			target_names[target_names_len - 1] = optarg;
 		}
 
-		if (service->research.provides) {
-			FREE(service->research.provides)
+		else {
+			LOG_ERROR("Unknown option (-%c)", optopt)
 		}
 	}
 
-	else if (service->kind == SERVICE_KIND_AQUABSD) {
-		dlclose(service->aquabsd.lib);
-	}
-
-	FREE(service->name)
-	FREE(service->path)
-
-	#undef FREE
-	free(service);
-}
-
-static inline int __wait_for_process(pid_t pid) {
-	// TODO this is really a function that seems like it should be native to aquaBSD
-	//      also, using a spinlock is probably not the best of ideas either
+	// make sure we're root
 
-	int status = 0;
-	while (waitpid(pid, &status, 0) > 0);
+	uid_t uid = getuid();
 
-	if (WIFSIGNALED(status)) {
-		return -1;
+	if (uid) {
+		FATAL_ERROR("Must be run as root user 😢 (UID = 0, current UID = %d)", uid)
 	}
 
-	if (WIFEXITED(status)) {
-		return WEXITSTATUS(status);
-	}
+	// make sure the $SERVICE_GROUP group exists, and error if not
 
-	return 0;
-}
+	struct group* service_group = getgrnam(SERVICE_GROUP);
 
-static void* service_thread(void* _service) {
-	service_t* service = _service;
+	if (!service_group) {
+		FATAL_ERROR("Couldn't find \"" SERVICE_GROUP "\" group");
+	}
 
-	// TODO what if a dependant process somehow manages to lock the mutex before us?
+	gid_t service_gid = service_group->gr_gid;
+	endgrent();
 
-	pthread_mutex_lock(&service->mutex);
-	LOG_VERBOSE("%s waiting for dependencies to complete", service->name)
+	// make sure nothing is already serving requests on $SOCK_PATH to ensure only one instance of init is running at a time
+	// the socket itself is only created once we're done booting, as its filesystem might well not be writable before then
 
-	// wait for dependencies to complete
+	if (control_running(SOCK_PATH)) {
+		FATAL_ERROR("Only one instance of init may be running at a time 😢")
+	}
 
-	for (size_t i = 0; i < service->deps_len; i++) {
-		service_t* dep = service->deps[i];
+	// check if we're in a jail or VNET jail
 
-		if (!dep) {
-			continue;
-		}
+	size_t len = sizeof(int);
 
-		// wait for mutex to be unlocked by attempting to lock it and then instantly unlocking it
+	if (sysctlbyname("security.jail.jailed", &in_jail, &len, NULL, 0) < 0) {
+		FATAL_ERROR("sysctlbyname(\"security.jail.jailed\"): %s", strerror(errno));
+	}
 
-		if (!dep->mutex) {
-			continue;
-		}
+	len = sizeof(int);
 
-		pthread_mutex_lock(&dep->mutex);
-		pthread_mutex_unlock(&dep->mutex);
+	if (sysctlbyname("security.jail.vnet", &in_vnet, &len, NULL, 0) < 0) {
+		FATAL_ERROR("sysctlbyname(\"security.jail.vnet\"): %s", strerror(errno));
 	}
 
-	// record start time
+	// actually start launching processes
 
-	LOG_INFO("Starting %s", service->name)
-	service->start_time = __get_time();
+	LOG_INFO("Launch service processes")
 
-	// create new process for service in question
+	// NOTES (cf. rc.d(8)):
+	//  - autoboot=yes/rc_fast=yes for skipping checks and speeding stuff up
+	//  - skip everything with the 'nostart' keyword (and 'firstboot' if it's the first time the system is booting after installation - this is for services such as 'growfs' for resizing the root filesystem if it wasn't already done by the installer)
+	//  - execute services until $early_late_divider is reached ('early_late_divider=FILESYSTEMS', ensure root & "critical" filesystems are mounted basically)
+	//  - check the firstboot again (incase we've moved to a different fs)
+	//  - delete $firstboot_sentinel (& $firstboot_sentinel"-reboot" if that exists, in which case reboot)
 
-	service->pid = fork();
+	// keep track of how long each phase of the boot takes, for the boot history
 
-	if (!service->pid) {
-		if (service->kind == SERVICE_KIND_RESEARCH) {
-			// we don't care about freeing this
+	long double phases[HISTORY_PHASE_COUNT] = { 0 };
+	long double phase_start = __get_time();
 
-			char* call;
-			asprintf(&call, ". /etc/rc.subr && run_rc_script %s faststart", service->path);
+	// start reading the files the boot will need into the page cache (or record which those are)
+	// this is done first thing, as even discovering services means reading files in
 
-			execlp("sh", "sh", "-c", call, NULL);
-		}
+	readahead_init(&boot_readahead, READAHEAD_PATH, record_readahead);
 
-		else if (service->kind == SERVICE_KIND_AQUABSD) {
-			_exit(service->aquabsd.start());
-		}
+	arena_init(&parse_arena, PARSE_ARENA_BLOCK_SIZE);
+	graph_init(&graph, &parse_arena);
 
-		else {
-			// TODO
-		}
+	// read all the aquaBSD services in '/etc/init/services'
 
-		_exit(EXIT_FAILURE);
+	if (discover_aquabsd(&graph, &parse_arena, "/etc/init/services") < 0) {
+		FATAL_ERROR("opendir(\"/etc/init/services\"): %s", strerror(errno))
 	}
 
-	// wait for process to finish up
-
-	int rv = __wait_for_process(service->pid);
+	// read all the legacy research UNIX-style services in '/etc/rc.d'
 
-	if (rv) {
-		LOG_WARN("Something went wrong running the %s service at '%s'", service->name, service->path)
+	if (discover_research(&graph, &parse_arena, "/etc/rc.d") < 0) {
+		FATAL_ERROR("opendir(\"/etc/rc.d\"): %s", strerror(errno))
 	}
 
-	pthread_mutex_unlock(&service->mutex);
-	LOG_SUCCESS("Completed %s", service->name)
+	phases[HISTORY_PHASE_DISCOVER] = __get_time() - phase_start;
+	phase_start = __get_time();
 
-	// compute total time service took
+	// resolve service dependencies (this is where we build the dependency graph)
 
-	long double now = __get_time();
-	service->total_time = now - service->start_time;
+	graph_resolve(&graph);
+	arena_free(&parse_arena);
 
-	return (void*) (uint64_t) rv;
-}
+	// check for circular dependencies
 
-static void start_on_start_services(size_t services_len, service_t** services) {
-	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
+	if (graph_check_circular(&graph)) {
+		FATAL_ERROR("Found circular dependency")
+	}
 
-		if (!service) {
-			continue;
-		}
+	phases[HISTORY_PHASE_RESOLVE] = __get_time() - phase_start;
 
-		if (!service->on_start || service->first_boot) {
-			continue;
-		}
+	// if we were asked to only boot up to certain targets, only start the services in their dependency closure
+	// the rest can still be started later on request
 
-		if (in_jail && service->disable_in_jail) {
-			continue;
-		}
+	size_t services_len = graph.services_len;
 
-		if (in_vnet && service->disable_in_vnet) {
-			continue;
-		}
+	size_t targets_len = 0;
+	uint32_t* targets = malloc(target_names_len * sizeof *targets);
 
-		if (service->thread_created) {
+	for (size_t i = 0; i < target_names_len; i++) {
+		char* name = target_names[i];
+		uint32_t target = graph_search(&graph, name);
+
+		if (target == GRAPH_NONE) {
+			LOG_ERROR("Couldn't find target %s", name)
 			continue;
 		}
 
-		service->thread_created = true;
-
-		// go as far down the tree as we can before actually starting services
-		// this is so that we can join the threads of dependencies in 'service_thread' while waiting for them
-
-		start_on_start_services(service->deps_len, service->deps);
-
-		pthread_mutex_init(&service->mutex, NULL);
-		pthread_create(&service->thread, NULL, service_thread, service);
-
-		LOG_VERBOSE("Thread created for %s: %p", service->name, service->thread)
+		targets[targets_len++] = target;
 	}
-}
 
-static void join_services(size_t services_len, service_t** services) {
-	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
+	if (target_names_len && !targets_len) {
+		FATAL_ERROR("None of the requested targets exist")
+	}
 
-		if (!service) {
-			continue;
-		}
+	bitset_word_t* closure = NULL;
 
-		if (!service->thread_created) {
-			continue;
-		}
+	if (targets_len) {
+		closure = bitset_new(services_len);
+		graph_closure(&graph, targets_len, targets, closure);
 
-		__attribute__((unused)) void* rv = NULL;
-		pthread_join(service->thread, &rv);
+		LOG_INFO("Booting to %zu target(s), which need %zu out of %zu services", targets_len, bitset_count(closure, services_len), services_len)
 	}
-}
 
-static bool research_service_provides(service_t* service, const char* name) {
-	if (service->kind != SERVICE_KIND_RESEARCH) {
-		return false;
-	}
+	// select each service we need on startup ('SERVICE_FLAG_ON_START')
 
-	for (size_t i = 0; i < service->research.provides_len; i++) {
-		char* provide = service->research.provides[i];
+	phase_start = __get_time();
 
-		if (strcmp(provide, name) == 0) {
-			return true;
-		}
-	}
-
-	return false;
-}
+	sched_init(&sched, &graph);
+	size_t scheduled = sched_select(&sched, in_jail, in_vnet, closure);
 
-static service_t* search_services(size_t services_len, service_t** services, const char* name) {
-	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
+	LOG_VERBOSE("Scheduled %zu services to start", scheduled)
 
-		if (strcmp(service->name, name) == 0) {
-			return service;
-		}
+	phases[HISTORY_PHASE_SELECT] = __get_time() - phase_start;
 
-		if (research_service_provides(service, name)) {
-			return service;
-		}
+	if (closure) {
+		free(closure);
 	}
 
-	// couldn't find service!
-
-	return NULL;
-}
+	// remove redundant dependencies between the services we're going to start, so there's less to wait on when scheduling
+	// this still counts as resolving
 
-static bool check_circular(service_t* service) {
-	// returns true if circular dependencies found
-	// returns false otherwise
+	phase_start = __get_time();
+	size_t redundant = sched_reduce(&sched, report_redundant);
 
-	if (!service) {
-		return false;
+	if (redundant) {
+		LOG_INFO("Removed %zu redundant dependencies%s", redundant, report_redundant ? "" : " (pass -r to list them)")
 	}
 
-	if (service->check_circular_passed) {
-		return true;
-	}
+	phases[HISTORY_PHASE_RESOLVE] += __get_time() - phase_start;
 
-	service->check_circular_passed = true;
+	// if we were just asked to export the graph, do that and stop here
 
-	for (size_t i = 0; i < service->deps_len; i++) {
-		service_t* dep = service->deps[i];
+	if (export_graph) {
+		graph_export(&graph, stdout);
 
-		if (check_circular(dep)) {
-			return true;
-		}
+		exit(EXIT_SUCCESS);
 	}
 
-	service->check_circular_passed = false;
+	// if we were asked to simulate the boot, do that with the profile we were given and stop here
 
-	return false;
-}
+	if (sim_policy_name) {
+		sim_policy_t policy = sim_policy(sim_policy_name);
 
-int main(int argc, char* argv[]) {
-	// parse arguments
-	// TODO should this be done with 'getopt' like the other aquaBSD programs instead?
-
-	for (int i = 1; i < argc; i++) {
-		char* option = argv[i];
-		LOG_ERROR("Unknown option (%s)", option)
-	}
-
-	// make sure we're root
+		if (policy == SIM_POLICY_COUNT) {
+			FATAL_ERROR("Unknown scheduling policy '%s' (expected order, critical, longest, shortest, or fanout)", sim_policy_name)
+		}
 
-	uid_t uid = getuid();
+		sim_t sim;
+		sim_init(&sim, &sched, policy, sim_concurrency);
 
-	if (uid) {
-		FATAL_ERROR("Must be run as root user 😢 (UID = 0, current UID = %d)", uid)
-	}
+		if (profile_path && sim_load_profile(&sim, profile_path) < 0) {
+			FATAL_ERROR("fopen(\"%s\"): %s", profile_path, strerror(errno))
+		}
 
-	// make sure the $SERVICE_GROUP group exists, and error if not
+		sim_run(&sim);
+		sim_report(&sim, stdout);
 
-	struct group* service_group = getgrnam(SERVICE_GROUP);
+		sim_free(&sim);
 
-	if (!service_group) {
-		FATAL_ERROR("Couldn't find \"" SERVICE_GROUP "\" group");
+		exit(EXIT_SUCCESS);
 	}
 
-	gid_t service_gid = service_group->gr_gid;
-	endgrent();
+	// capture the output of services, so that they don't all interleave on the console (and wait on it)
 
-	// make sure a message queue named $MQ_NAME doesn't already exist to ensure only one instance of init is running at a time
+	output_init(&output, &graph, OUTPUT_DIR);
+	sched.output = &output;
 
-	mode_t permissions = 0420; // owner ("root") can only read, group ($SERVICE_GROUP) can only write, and others can do neither
+	// publish the status of services in shared memory, so that they can be queried without having to go through us
 
-	if (mq_open(MQ_NAME, O_CREAT | O_EXCL, permissions, NULL /* defaults are probably fine */) < 0 && errno == EEXIST) {
-		FATAL_ERROR("Only one instance of init may be running at a time 😢")
+	if (table_init(&table, &graph, sched.states) < 0) {
+		LOG_WARN("Couldn't create status table '" TABLE_SHM_NAME "': %s", strerror(errno))
 	}
 
-	// create message queue
+	sched.table = &table;
 
-	mqd_t mq = mq_open(MQ_NAME, O_CREAT | O_RDWR, permissions, NULL);
+	// keep the latest lifecycle events of services around, for clients subscribing to them (even after the fact)
 
-	if (mq < 0) {
-		FATAL_ERROR("mq_open(\"" MQ_NAME "\"): %s", strerror(errno))
-	}
+	events_init(&events);
+	sched.events = &events;
 
-	// set group ownership to the $SERVICE_GROUP group
+	// supervised services which keep crashing are restarted after a delay, which is kept track of here
 
-	// if (fchown(mq, uid /* most likely gonna be root */, service_gid) < 0) {
-	// 	FATAL_ERROR("fchown: %s", strerror(errno))
-	// }
+	timers_init(&timers, __get_time());
+	sched.timers = &timers;
 
-	// check if we're in a jail or VNET jail
+	// keep track of every process of each service, including the ones which daemonise themselves and leave the process we started behind
+	// this has to be done before starting anything, so that nothing they fork is missed
 
-	size_t len = sizeof(int);
+	proctree_init(&tree, graph.services_len);
+	sched.tree = &tree;
 
-	if (sysctlbyname("security.jail.jailed", &in_jail, &len, NULL, 0) < 0) {
-		FATAL_ERROR("sysctlbyname(\"security.jail.jailed\"): %s", strerror(errno));
-	}
-
-	len = sizeof(int);
+	// skip one-shot services which would just do the same as last time
 
-	if (sysctlbyname("security.jail.vnet", &in_vnet, &len, NULL, 0) < 0) {
-		FATAL_ERROR("sysctlbyname(\"security.jail.vnet\"): %s", strerror(errno));
-	}
+	memo_init(&memo, &graph, MEMO_PATH);
+	sched.memo = &memo;
 
-	// actually start launching processes
+	// prefetch the files of services which are about to start before anyone else's
 
-	LOG_INFO("Launch service processes")
+	readahead_resolve(&boot_readahead, &graph);
+	sched.readahead = &boot_readahead;
 
-	// NOTES (cf. rc.d(8)):
-	//  - autoboot=yes/rc_fast=yes for skipping checks and speeding stuff up
-	//  - skip everything with the 'nostart' keyword (and 'firstboot' if it's the first time the system is booting after installation - this is for services such as 'growfs' for resizing the root filesystem if it wasn't already done by the installer)
-	//  - execute services until $early_late_divider is reached ('early_late_divider=FILESYSTEMS', ensure root & "critical" filesystems are mounted basically)
-	//  - check the firstboot again (incase we've moved to a different fs)
-	//  - delete $firstboot_sentinel (& $firstboot_sentinel"-reboot" if that exists, in which case reboot)
+	// work out the milestones of the boot: the ones we were given, or else the targets, or else the login prompt
 
-	size_t services_len = 0;
-	service_t** services = NULL;
+	size_t milestones_len = 0;
+	uint32_t* milestones = malloc((milestone_names_len + targets_len + 1) * sizeof *milestones);
 
-	// read all the aquaBSD services in '/etc/init/services'
+	for (size_t i = 0; i < milestone_names_len; i++) {
+		char* name = milestone_names[i];
+		uint32_t milestone = graph_search(&graph, name);
 
-	DIR* dp = opendir("/etc/init/services");
+		if (milestone == GRAPH_NONE) {
+			LOG_ERROR("Couldn't find milestone %s", name)
+			continue;
+		}
 
-	if (!dp) {
-		FATAL_ERROR("opendir(\"/etc/init/services\"): %s", strerror(errno))
+		milestones[milestones_len++] = milestone;
 	}
 
-	struct dirent* ent;
+	if (!milestone_names_len) {
+		memcpy(milestones, targets, targets_len * sizeof *targets);
+		milestones_len = targets_len;
+	}
 
-	while ((ent = readdir(dp))) {
-		if (ent->d_type != DT_REG) {
-			continue; // anything other than a regular file is invalid
-		}
+	uint32_t login = graph_search(&graph, MILESTONE);
 
-		if (*ent->d_name == '.') {
-			continue; // don't care about '.', '..', & other entries starting with a dot
-		}
+	if (!milestones_len && login != GRAPH_NONE) {
+		milestones[milestones_len++] = login;
+	}
 
-		char* path;
-		asprintf(&path, "/etc/init/services/%s", ent->d_name);
+	// boost whatever is holding up the milestones, so that background services don't slow them down
 
-		// okay! add the service
+	if (boost && milestones_len) {
+		float* estimates = estimate_durations(&graph);
+		sched_boost(&sched, milestones_len, milestones, estimates);
+		free(estimates);
+	}
 
-		service_t* service = new_service(ent->d_name);
-		service->path = path;
+	// hold back deferred services until the milestones are reached, so that they don't slow them down either
 
-		if (fill_aquabsd_service(service) < 0) {
-			continue;
-		}
+	size_t deferred = sched_defer(&sched, milestones_len, milestones, deferred_concurrency);
 
-		services = realloc(services, ++services_len * sizeof *services);
-		services[services_len - 1] = service;
+	if (deferred) {
+		LOG_INFO("Deferring %zu services until the boot milestone is reached", deferred)
 	}
 
-	closedir(dp);
+	free(milestones);
 
-	// read all the legacy research UNIX-style services in '/etc/rc.d'
+	if (milestone_names) {
+		free(milestone_names);
+	}
 
-	/* DIR* */ dp = opendir("/etc/rc.d");
+	// 'SIGCHLD' is turned into a write on a self-pipe, which is polled on while booting and then alongside the control socket (whichever thread the signal happens to be delivered to)
+	// this is set up before starting anything, so that the boot waits on timers (e.g. delayed restarts of crashing services) and process events just as it does once booted
 
-	if (!dp) {
-		FATAL_ERROR("opendir(\"/etc/rc.d\"): %s", strerror(errno))
+	if (pipe(reap_pipe) < 0) {
+		FATAL_ERROR("pipe: %s", strerror(errno))
 	}
 
-	while ((ent = readdir(dp))) {
-		if (ent->d_type != DT_REG) {
-			continue; // anything other than a regular file is invalid
-		}
+	fcntl(reap_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(reap_pipe[1], F_SETFL, O_NONBLOCK);
 
-		if (*ent->d_name == '.') {
-			continue; // don't care about '.', '..', & other entries starting with a dot
-		}
+	fcntl(reap_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(reap_pipe[1], F_SETFD, FD_CLOEXEC);
 
-		char* path;
-		asprintf(&path, "/etc/rc.d/%s", ent->d_name);
+	struct sigaction sa = {
+		.sa_handler = sigchld_handler,
+		.sa_flags = SA_RESTART | SA_NOCLDSTOP,
+	};
 
-		struct stat sb;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
 
-		if (stat(path, &sb) < 0) {
-			free(path);
-			FATAL_ERROR("stat(\"%s\"): %s", path, strerror(errno))
-		}
+	sched.wake_fd = reap_pipe[0];
 
-		mode_t permissions = sb.st_flags & 0777;
+	// launch them all and wait for them to complete
 
-		if (permissions == 0555) {
-			free(path);
-			FATAL_ERROR("\"%s\" doesn't have the right permissions ('0%o', needs '0555')", ent->d_name, permissions)
-		}
+	// show a summary of the boot's progress on the console rather than a line for each service starting and completing
+	// deferred services run in the background, so they aren't part of it
 
-		// okay! add the service
+	status_start(&status, &graph, scheduled - deferred);
+	sched.status = &status;
 
-		service_t* service = new_service(ent->d_name);
-		service->path = path;
+	long double start_time = __get_time();
+	sched_run(&sched);
 
-		if (fill_research_service(service) < 0) {
-			continue;
-		}
+	status_stop(&status);
+	sched.status = NULL;
 
-		services = realloc(services, ++services_len * sizeof *services);
-		services[services_len - 1] = service;
-	}
+	// print out timing information and exit
 
-	closedir(dp);
+	long double now = __get_time();
+	LOG_INFO("Took %Lf seconds", now - start_time)
 
-	// resolve service dependencies (this is where we build the dependency graph)
-	// yeah, this code has a pretty horrid time complexity  O(n^2), can absolutely do better (O(n) ideally assuming no hashmap collisions)
+	phases[HISTORY_PHASE_RUN] = now - start_time;
 
-	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
+	// record this boot in the boot history
+	// if the filesystem it's on isn't writable yet, the record is kept in memory and written out later
 
-		service->deps = malloc(service->deps_len * sizeof *service->deps);
+	history_init(&history, HISTORY_PATH);
+	history_record(&history, &sched, phases, start_time);
 
-		for (size_t j = 0; j < service->deps_len; j++) {
-			char* name = service->dep_names[j];
-			service->deps[j] = search_services(services_len, services, name);
-		}
+	if (history_flush(&history) < 0) {
+		LOG_WARN("Couldn't write boot history to '" HISTORY_PATH "' yet (%s), will try again later", strerror(errno))
 	}
 
-	// check for circular dependencies
-
-	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
+	if (memo_flush(&memo) < 0) {
+		LOG_WARN("Couldn't write memo store to '" MEMO_PATH "' yet (%s), will try again later", strerror(errno))
+	}
 
-		if (check_circular(service)) {
-			FATAL_ERROR("Found circular dependency")
-		}
+	if (readahead_save(&boot_readahead) < 0) {
+		LOG_WARN("Couldn't write readahead profile to '" READAHEAD_PATH "' yet (%s), will try again later", strerror(errno))
 	}
 
-	// launch each service we need on startup ('service_t.on_start == true')
+	if (record_path && sim_save_profile(&sched, record_path) < 0) {
+		LOG_WARN("Couldn't record profile to '%s': %s", record_path, strerror(errno))
+	}
 
-	long double start_time = __get_time();
-	start_on_start_services(services_len, services);
+	for (size_t i = 0; i < targets_len; i++) {
+		uint32_t target = targets[i];
+		char const* name = graph_name(&graph, target);
 
-	// join all services to exit out of init
+		if (sched.states[target] < SERVICE_STATE_DONE) {
+			LOG_WARN("Target %s was never started (is it disabled?)", name)
+			continue;
+		}
 
-	join_services(services_len, services);
+		LOG_SUCCESS("Reached target %s after %Lf seconds", name, sched.start_times[target] + sched.total_times[target] - start_time)
+	}
 
-	// print out timing information and exit
+	free(targets);
 
-	long double now = __get_time();
-	LOG_INFO("Took %Lf seconds", now - start_time)
+	if (target_names) {
+		free(target_names);
+	}
 
-	char* longest_name = "unknown";
+	char const* longest_name = "unknown";
 	long double longest_time = 0.0;
 
 	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
-
-		if (!service) {
-			continue;
-		}
-
-		if (service->total_time < longest_time) {
+		if (sched.total_times[i] < longest_time) {
 			continue;
 		}
 
-		longest_name = service->name;
-		longest_time = service->total_time;
+		longest_name = graph_name(&graph, i);
+		longest_time = sched.total_times[i];
 	}
 
 	LOG_INFO("Longest service to complete was %s, at %Lf seconds", longest_name, longest_time)
 
-	exit(0);
-
-	// setup message queue notification signal
-	// thanks @qookie 😄
+	// from here on out, serve requests on the control socket, and reap services as they exit
+	// only members of the $SERVICE_GROUP group (and root) may act on services, anyone may query them
 
-	sigset_t set;
+	control_init(&control, &sched, &output, SOCK_PATH, service_gid);
+	bool listening = false;
 
-	sigemptyset(&set);
-	sigaddset(&set, SIGUSR1);
+	if (sample_interval > 0) {
+		sampler_init(&sampler, &sched, &timers, sample_interval);
+		control.sampler = &sampler;
+	}
 
-	sigprocmask(SIG_BLOCK, &set, NULL);
+	while (1) {
+		// the socket's filesystem might not be writable yet, in which case we keep trying every so often
 
-	// block while waiting for messages on the message queue
+		if (!listening && control_listen(&control) == 0) {
+			LOG_VERBOSE("Listening for requests on '" SOCK_PATH "'")
+			listening = true;
+		}
 
-	while (1) {
-		siginfo_t info;
-		sigwaitinfo(&set, &info);
+		// sleep until the next timer is due at the latest
 
-		// received a message, run a bunch of sanity checks on it
-		// TODO getting some weird warning saying I can't compare info.si_mqd (int) and mq (mqd_t)
+		int timeout = timers_timeout(&timers, __get_time());
 
-		if (info.si_mqd != mq) {
-			continue;
+		if (!listening && (timeout < 0 || timeout > LISTEN_RETRY_INTERVAL)) {
+			timeout = LISTEN_RETRY_INTERVAL;
 		}
 
-		uid_t uid = info.si_uid;
-
-		// read message data & process it
+		int const wakes[] = { reap_pipe[0], tree.fd };
+		unsigned woken = control_poll(&control, sizeof wakes / sizeof *wakes, wakes, timeout);
 
-		char buf[256]; // TODO this will end up being some kind of command structure
-		__attribute__((unused)) unsigned priority; // we don't care about priority
+		if (woken & 1 << 0) {
+			char buf[64];
+			while (read(reap_pipe[0], buf, sizeof buf) > 0);
 
-	retry: {} // fight me, this is more readable than a loop
+			sched_reap(&sched);
+		}
 
-		ssize_t len = mq_receive(mq, buf, sizeof buf, &priority);
+		// follow services forking and exiting, even when nothing else is happening, so that events don't pile up
+		// this comes after reaping, so that there's no need to hang onto the services of processes which have already been reaped (cf. 'proctree_reaped')
 
-		if (errno == EAGAIN) {
-			goto retry;
+		if (woken & 1 << 1) {
+			proctree_process(&tree);
 		}
 
-		if (errno == ETIMEDOUT) {
-			LOG_WARN("Receiving on the message queue timed out")
-			continue;
+		timers_run(&timers, __get_time());
+
+		// try writing out any boot history we couldn't before
+
+		if (history.pending && history_flush(&history) == 0) {
+			LOG_VERBOSE("Wrote out pending boot history")
 		}
 
-		if (len < 0) {
-			LOG_WARN("mq_receive: %s", strerror(errno))
+		if (memo.dirty && memo_flush(&memo) == 0) {
+			LOG_VERBOSE("Wrote out memo store")
 		}
 
-		// TODO process command somehow
+		if (boot_readahead.unsaved && readahead_save(&boot_readahead) == 0) {
+			LOG_VERBOSE("Wrote out readahead profile")
+		}
 	}
 
-	// launch each service we need on shutdown ('service_t.on_stop == true')
+	// launch each service we need on shutdown ('SERVICE_FLAG_ON_STOP')
 
 	for (size_t i = 0; i < services_len; i++) {
-		service_t* service = services[i];
-
-		if (!service->on_stop) {
+		if (!(sched.flags[i] & SERVICE_FLAG_ON_STOP)) {
 			continue;
 		}
 
@@ -881,17 +718,26 @@ int main(int argc, char* argv[]) {
 	// free services
 
 	for (size_t i = 0; i < services_len; i++) {
-		del_service(services[i]);
+		del_service(&graph.services[i]);
 	}
 
-	if (services) {
-		free(services);
+	history_free(&history);
+	memo_free(&memo);
+	proctree_free(&tree);
+	readahead_free(&boot_readahead);
+
+	if (control.sampler) {
+		sampler_free(&sampler);
 	}
 
-	// remove the message queue completely (this most likely indicated a shutdown/reboot, so it doesn't matter all that much what happens here)
+	table_free(&table);
+	sched_free(&sched);
+	timers_free(&timers);
+	graph_free(&graph);
+
+	// remove the control socket (this most likely indicated a shutdown/reboot, so it doesn't matter all that much what happens here)
 
-	mq_close(mq); // not sure if this is completely necessary, doesn't matter
-	mq_unlink(MQ_NAME);
+	control_free(&control);
 
 	return EXIT_SUCCESS;
 }
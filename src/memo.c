@@ -0,0 +1,328 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#endif
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "memo.h"
+
+#define MAGIC 0x4f4d454d // "MEMO"
+#define VERSION 1
+
+#define NAME_LEN 64
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t pad;
+	uint32_t count;
+} header_t;
+
+typedef struct {
+	char name[NAME_LEN];
+	uint64_t inputs;
+	uint64_t outputs;
+} record_t;
+
+void memo_init(memo_t* memo, graph_t const* graph, char const* path) {
+	memo->graph = graph;
+	memo->path = path;
+	memo->dirty = false;
+
+	size_t alloc_len = graph->services_len ? graph->services_len : 1;
+
+	memo->entries = calloc(alloc_len, sizeof *memo->entries);
+	memo->started = calloc(alloc_len, sizeof *memo->started);
+
+	// read the store back in
+
+	FILE* fp = fopen(path, "r");
+
+	if (!fp) {
+		return;
+	}
+
+	header_t header;
+
+	if (fread(&header, sizeof header, 1, fp) != 1 || header.magic != MAGIC || header.version != VERSION) {
+		LOG_WARN("Ignoring invalid memo store '%s'", path)
+		fclose(fp);
+
+		return;
+	}
+
+	record_t record;
+
+	for (uint32_t i = 0; i < header.count && fread(&record, sizeof record, 1, fp) == 1; i++) {
+		record.name[NAME_LEN - 1] = '\0';
+		uint32_t service = graph_search(graph, record.name);
+
+		// services which don't exist anymore are just forgotten next time the store is written out
+
+		if (service == GRAPH_NONE || strcmp(graph_name(graph, service), record.name)) {
+			continue;
+		}
+
+		memo->entries[service] = (memo_entry_t) {
+			.inputs = record.inputs,
+			.outputs = record.outputs,
+		};
+	}
+
+	fclose(fp);
+}
+
+void memo_free(memo_t* memo) {
+	free(memo->entries);
+	free(memo->started);
+}
+
+// fingerprints are 64-bit FNV-1a hashes of everything about the inputs or outputs we look at
+
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+static uint64_t hash(uint64_t h, void const* data, size_t len) {
+	uint8_t const* bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ bytes[i]) * FNV_PRIME;
+	}
+
+	return h;
+}
+
+static uint64_t hash_file(uint64_t h, char const* path, bool* missing) {
+	struct stat sb;
+
+	if (stat(path, &sb) < 0) {
+		*missing = true;
+		return hash(h, "", 1);
+	}
+
+	uint64_t const fields[] = {
+		sb.st_dev, sb.st_ino, sb.st_size, sb.st_mode,
+		sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec,
+	};
+
+	return hash(h, fields, sizeof fields);
+}
+
+static uint64_t hash_sysctl(uint64_t h, char const* oid, bool* missing) {
+	char buf[4096];
+	size_t len = sizeof buf;
+
+#if defined(__linux__)
+	// Linux has no 'sysctlbyname', but its sysctls are all in procfs with slashes instead of dots
+
+	char path[256] = "/proc/sys/";
+	strncat(path, oid, sizeof path - strlen(path) - 1);
+
+	for (char* c = path + strlen("/proc/sys/"); *c; c++) {
+		*c = *c == '.' ? '/' : *c;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	ssize_t rv = fd < 0 ? -1 : read(fd, buf, len);
+
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	if (rv < 0) {
+		*missing = true;
+		return hash(h, "", 1);
+	}
+
+	len = rv;
+#else
+	// values longer than the buffer are fingerprinted by what fits in it
+
+	if (sysctlbyname(oid, buf, &len, NULL, 0) < 0 && errno != ENOMEM) {
+		*missing = true;
+		return hash(h, "", 1);
+	}
+#endif
+
+	return hash(h, buf, len);
+}
+
+// fingerprint a whitespace-separated list of files and sysctl OIDs, noting if any of them are missing
+
+static uint64_t fingerprint(uint64_t h, char const* list, bool* missing) {
+	char* copy = strdup(list);
+	char* rest = copy;
+	char* item;
+
+	while ((item = strsep(&rest, " \t\n"))) {
+		if (!*item) {
+			continue;
+		}
+
+		h = hash(h, item, strlen(item) + 1);
+
+		if (!strncmp(item, "sysctl:", strlen("sysctl:"))) {
+			h = hash_sysctl(h, item + strlen("sysctl:"), missing);
+		}
+
+		else {
+			h = hash_file(h, item, missing);
+		}
+	}
+
+	free(copy);
+	return h;
+}
+
+bool memo_fresh(memo_t* memo, uint32_t index) {
+	graph_t const* graph = memo->graph;
+	service_t const* service = &graph->services[index];
+
+	memo->started[index] = 0;
+
+	if (service->inputs == STRTAB_NONE) {
+		return false;
+	}
+
+	// the service itself is always one of its inputs
+	// missing inputs are fingerprinted too (services may well create them), so 'missing' doesn't matter for these
+
+	bool missing = false;
+
+	uint64_t inputs = hash_file(FNV_OFFSET, graph_str(graph, service->path), &missing);
+	inputs = fingerprint(inputs, graph_str(graph, service->inputs), &missing);
+	inputs += !inputs; // 0 means there's no record
+
+	memo->started[index] = inputs;
+
+	memo_entry_t const* entry = &memo->entries[index];
+
+	if (entry->inputs != inputs) {
+		return false;
+	}
+
+	// the outputs of the last run must all still be there, untouched
+
+	if (service->outputs == STRTAB_NONE) {
+		return true;
+	}
+
+	missing = false;
+	uint64_t outputs = fingerprint(FNV_OFFSET, graph_str(graph, service->outputs), &missing);
+
+	return !missing && entry->outputs == outputs;
+}
+
+void memo_completed(memo_t* memo, uint32_t index, int rv) {
+	graph_t const* graph = memo->graph;
+	service_t const* service = &graph->services[index];
+
+	if (service->inputs == STRTAB_NONE) {
+		return;
+	}
+
+	memo_entry_t* entry = &memo->entries[index];
+	memo_entry_t prev = *entry;
+
+	// a failed run invalidates the last successful one, as whatever it did may well have been undone
+
+	if (rv || !memo->started[index]) {
+		*entry = (memo_entry_t) { 0 };
+	}
+
+	else {
+		bool missing = false;
+
+		entry->inputs = memo->started[index];
+		entry->outputs = service->outputs == STRTAB_NONE ? 0 : fingerprint(FNV_OFFSET, graph_str(graph, service->outputs), &missing);
+
+		// a service which didn't produce all its outputs will have to run again next time
+
+		if (missing) {
+			LOG_WARN("%s completed successfully, but didn't produce all its outputs", graph_str(graph, service->name))
+			*entry = (memo_entry_t) { 0 };
+		}
+	}
+
+	memo->dirty |= memcmp(&prev, entry, sizeof prev) != 0;
+}
+
+int memo_flush(memo_t* memo) {
+	if (!memo->dirty) {
+		return 0;
+	}
+
+	graph_t const* graph = memo->graph;
+
+	// write the new store next to the old one and swap them, so that there's always a whole store there
+
+	char tmp_path[256];
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", memo->path);
+
+	FILE* fp = fopen(tmp_path, "we");
+
+	if (!fp) {
+		return -1;
+	}
+
+	header_t header = {
+		.magic = MAGIC,
+		.version = VERSION,
+	};
+
+	for (size_t i = 0; i < graph->services_len; i++) {
+		header.count += memo->entries[i].inputs != 0;
+	}
+
+	fwrite(&header, sizeof header, 1, fp);
+
+	for (size_t i = 0; i < graph->services_len; i++) {
+		memo_entry_t const* entry = &memo->entries[i];
+
+		if (!entry->inputs) {
+			continue;
+		}
+
+		record_t record = {
+			.inputs = entry->inputs,
+			.outputs = entry->outputs,
+		};
+
+		strncpy(record.name, graph_name(graph, i), NAME_LEN - 1);
+		fwrite(&record, sizeof record, 1, fp);
+	}
+
+	if (fflush(fp) || fsync(fileno(fp)) < 0 || ferror(fp)) {
+		int err = errno;
+
+		fclose(fp);
+		unlink(tmp_path);
+
+		errno = err;
+		return -1;
+	}
+
+	fclose(fp);
+
+	if (rename(tmp_path, memo->path) < 0) {
+		int err = errno;
+		unlink(tmp_path);
+
+		errno = err;
+		return -1;
+	}
+
+	memo->dirty = false;
+	return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// memoisation of one-shot services, i.e. not running them again on boot if nothing they depend on has changed since they last ran successfully
+// services declare their inputs and outputs (cf. 'service_t.inputs' and 'service_t.outputs'), which are fingerprinted:
+//  - files (and directories) by their metadata (device, inode, size, mode, and modification time), as make(1) would, rather than by their contents
+//  - sysctl OIDs (written 'sysctl:kern.osrelease') by their value
+// the service's own script or library is always an input too, and a service is only skipped if all its outputs still exist and haven't changed either
+//
+// the fingerprints of the last successful run of each service are kept in a small store file, which is only ever replaced as a whole (so it's never read back half-written)
+
+#define MEMO_PATH "/var/db/init/memo"
+
+typedef struct {
+	uint64_t inputs; // fingerprint of the service's inputs on its last successful run, 0 if there's none
+	uint64_t outputs; // fingerprint of its outputs after that run
+} memo_entry_t;
+
+typedef struct {
+	graph_t const* graph;
+	char const* path;
+
+	memo_entry_t* entries;
+	uint64_t* started; // fingerprint of each service's inputs when it was last started, to be recorded once it completes
+	bool dirty; // whether entries changed since the store was last written out
+} memo_t;
+
+// load the store at 'path', if there's one (a missing or invalid store just means that every memoised service runs)
+
+void memo_init(memo_t* memo, graph_t const* graph, char const* path);
+void memo_free(memo_t* memo);
+
+// to be called as a service is started
+// returns true if the service is memoised, and its inputs and outputs are the same as after its last successful run (i.e. there's no point in running it)
+
+bool memo_fresh(memo_t* memo, uint32_t service);
+
+// to be called once a service has completed, to record (or forget, if 'rv' is non-zero) its run
+
+void memo_completed(memo_t* memo, uint32_t service, int rv);
+
+// write the store out, if anything changed
+// returns -1 (with 'errno' set) if it can't be written to yet, in which case it'll be written out on the next call
+
+int memo_flush(memo_t* memo);
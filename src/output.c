@@ -0,0 +1,384 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "output.h"
+
+#define RING_MASK (OUTPUT_RING_SIZE - 1)
+#define SPLICE_CHUNK (64 * 1024)
+
+// how often the output thread retries opening the log directory while it can't
+
+#define OPEN_RETRY_INTERVAL 1
+
+static void log_path(output_t const* output, uint32_t service, char* path, size_t len) {
+	snprintf(path, len, "%s/%s.log", output->dir, graph_name(output->graph, service));
+}
+
+// write out everything in the ring which hasn't been yet to the service's log file (opening it if need be)
+
+static void persist(output_t* output, uint32_t service) {
+	output_ring_t* ring = &output->rings[service];
+
+	if (!ring->buf || ring->persisted == ring->total) {
+		return;
+	}
+
+	if (ring->log_fd < 0) {
+		char path[4096];
+		log_path(output, service, path, sizeof path);
+
+		// not opened with 'O_APPEND', as 'splice(2)' refuses to write to files opened that way
+		// we're the only ones writing to it, so just start from the end once instead
+
+		ring->log_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+
+		if (ring->log_fd < 0) {
+			return;
+		}
+
+		// service output may well contain secrets, so only root gets to read it (even from log files left by older versions)
+
+		fchmod(ring->log_fd, 0600);
+
+		lseek(ring->log_fd, 0, SEEK_END);
+	}
+
+	// anything older than the size of the ring has been overwritten already
+
+	if (ring->total - ring->persisted > OUTPUT_RING_SIZE) {
+		ring->dropped += ring->total - ring->persisted - OUTPUT_RING_SIZE;
+		ring->persisted = ring->total - OUTPUT_RING_SIZE;
+	}
+
+	while (ring->persisted < ring->total) {
+		size_t off = ring->persisted & RING_MASK;
+		size_t len = ring->total - ring->persisted;
+
+		if (len > OUTPUT_RING_SIZE - off) {
+			len = OUTPUT_RING_SIZE - off;
+		}
+
+		ssize_t written = write(ring->log_fd, ring->buf + off, len);
+
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (written <= 0) {
+			break;
+		}
+
+		ring->persisted += written;
+	}
+}
+
+static void try_open(output_t* output) {
+	time_t now = time(NULL);
+
+	if (now - output->last_open_try < OPEN_RETRY_INTERVAL) {
+		return;
+	}
+
+	output->last_open_try = now;
+
+	if (mkdir(output->dir, 0755) < 0 && errno != EEXIST) {
+		return;
+	}
+
+	if (access(output->dir, W_OK) < 0) {
+		return;
+	}
+
+	output->writable = true;
+
+	// write out the output of all services so far, including those which have already completed
+
+	for (uint32_t i = 0; i < output->services_len; i++) {
+		persist(output, i);
+
+		if (output->rings[i].fd < 0 && output->rings[i].log_fd >= 0) {
+			close(output->rings[i].log_fd);
+			output->rings[i].log_fd = -1;
+		}
+	}
+}
+
+// drain whatever is available on a service's pipe
+// returns false once the pipe has been closed on the service's end
+
+static bool drain(output_t* output, uint32_t service) {
+	output_ring_t* ring = &output->rings[service];
+
+#if defined(__linux__)
+	// once the ring has been fully written out, move data straight from the pipe to the log file
+
+	if (ring->log_fd >= 0 && ring->persisted == ring->total && !ring->no_splice) {
+		for (;;) {
+			ssize_t moved = splice(ring->fd, NULL, ring->log_fd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+			if (moved > 0) {
+				ring->spliced = true;
+				continue;
+			}
+
+			if (moved < 0 && errno == EINTR) {
+				continue;
+			}
+
+			if (moved < 0 && errno == EAGAIN) {
+				return true;
+			}
+
+			if (moved < 0 && errno == EINVAL) {
+				ring->no_splice = true; // splicing not supported on this filesystem, fall back to reading into the ring from now on
+				break;
+			}
+
+			return false;
+		}
+	}
+#endif
+
+	if (!ring->buf) {
+		ring->buf = malloc(OUTPUT_RING_SIZE);
+	}
+
+	for (;;) {
+		// read straight into the ring, in two parts if we're wrapping around
+
+		size_t off = ring->total & RING_MASK;
+
+		struct iovec iov[2] = {
+			{ .iov_base = ring->buf + off, .iov_len = OUTPUT_RING_SIZE - off },
+			{ .iov_base = ring->buf, .iov_len = off },
+		};
+
+		ssize_t len = readv(ring->fd, iov, off ? 2 : 1);
+
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (len < 0 && errno == EAGAIN) {
+			return true;
+		}
+
+		if (len <= 0) {
+			return false;
+		}
+
+		ring->total += len;
+
+		if (output->writable) {
+			persist(output, service);
+		}
+	}
+}
+
+static void* output_thread(void* arg) {
+	output_t* output = arg;
+
+	size_t fds_len = 0;
+	struct pollfd* fds = NULL;
+	uint32_t* services = NULL;
+
+	for (;;) {
+		// gather up all the pipes still open
+
+		pthread_mutex_lock(&output->lock);
+
+		if (!output->writable) {
+			try_open(output);
+		}
+
+		size_t open = 1;
+
+		for (uint32_t i = 0; i < output->services_len; i++) {
+			open += output->rings[i].fd >= 0;
+		}
+
+		if (open > fds_len) {
+			fds_len = open;
+			fds = realloc(fds, fds_len * sizeof *fds);
+			services = realloc(services, fds_len * sizeof *services);
+		}
+
+		fds[0] = (struct pollfd) { .fd = output->wake[0], .events = POLLIN };
+		open = 1;
+
+		for (uint32_t i = 0; i < output->services_len; i++) {
+			if (output->rings[i].fd < 0) {
+				continue;
+			}
+
+			fds[open] = (struct pollfd) { .fd = output->rings[i].fd, .events = POLLIN };
+			services[open++] = i;
+		}
+
+		pthread_mutex_unlock(&output->lock);
+
+		// wait for something to happen
+		// we still wake up every so often while the log directory isn't writable, to try opening it again
+
+		if (poll(fds, open, output->writable ? -1 : OPEN_RETRY_INTERVAL * 1000) < 0) {
+			continue;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			char buf[64];
+			while (read(output->wake[0], buf, sizeof buf) > 0);
+		}
+
+		pthread_mutex_lock(&output->lock);
+
+		for (size_t i = 1; i < open; i++) {
+			if (!fds[i].revents) {
+				continue;
+			}
+
+			uint32_t service = services[i];
+			output_ring_t* ring = &output->rings[service];
+
+			if (drain(output, service)) {
+				continue;
+			}
+
+			// service closed its end of the pipe, so we're done with it
+
+			close(ring->fd);
+			ring->fd = -1;
+
+			if (ring->log_fd >= 0) {
+				close(ring->log_fd);
+				ring->log_fd = -1;
+			}
+		}
+
+		pthread_mutex_unlock(&output->lock);
+	}
+
+	return NULL;
+}
+
+void output_init(output_t* output, graph_t const* graph, char const* dir) {
+	output->graph = graph;
+	output->services_len = graph->services_len;
+
+	output->dir = dir;
+	output->writable = false;
+	output->last_open_try = 0;
+
+	pthread_mutex_init(&output->lock, NULL);
+	output->rings = calloc(output->services_len ? output->services_len : 1, sizeof *output->rings);
+
+	for (size_t i = 0; i < output->services_len; i++) {
+		output->rings[i].fd = -1;
+		output->rings[i].log_fd = -1;
+	}
+
+	if (pipe(output->wake) < 0) {
+		LOG_FATAL("pipe: %s", strerror(errno))
+		exit(EXIT_FAILURE);
+	}
+
+	fcntl(output->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(output->wake[0], F_SETFD, FD_CLOEXEC);
+	fcntl(output->wake[1], F_SETFL, O_NONBLOCK);
+	fcntl(output->wake[1], F_SETFD, FD_CLOEXEC);
+
+	if (pthread_create(&output->thread, NULL, output_thread, output)) {
+		LOG_FATAL("pthread_create: %s", strerror(errno))
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_detach(output->thread);
+}
+
+int output_pipe(output_t* output, uint32_t service) {
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		LOG_WARN("pipe: %s", strerror(errno))
+		return -1;
+	}
+
+	// neither end should leak into other services (the service gets its end through 'dup2', which clears this flag)
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	pthread_mutex_lock(&output->lock);
+
+	output_ring_t* ring = &output->rings[service];
+
+	if (ring->fd >= 0) {
+		close(ring->fd); // service restarted before its previous instance closed its output
+	}
+
+	ring->fd = fds[0];
+
+	pthread_mutex_unlock(&output->lock);
+
+	// wake the output thread up so it starts polling the new pipe
+
+	(void) !write(output->wake[1], "", 1);
+
+	return fds[1];
+}
+
+size_t output_tail(output_t* output, uint32_t service, char* buf, size_t len) {
+	pthread_mutex_lock(&output->lock);
+	output_ring_t* ring = &output->rings[service];
+
+	// if some output went straight to the log file, the ring isn't up to date, so read the tail of the log file instead
+
+	if (ring->spliced) {
+		pthread_mutex_unlock(&output->lock);
+
+		char path[4096];
+		log_path(output, service, path, sizeof path);
+
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0) {
+			return 0;
+		}
+
+		off_t size = lseek(fd, 0, SEEK_END);
+		off_t off = size > (off_t) len ? size - (off_t) len : 0;
+
+		ssize_t got = pread(fd, buf, size - off, off);
+		close(fd);
+
+		return got < 0 ? 0 : got;
+	}
+
+	size_t avail = ring->total < OUTPUT_RING_SIZE ? ring->total : OUTPUT_RING_SIZE;
+
+	if (len > avail) {
+		len = avail;
+	}
+
+	// copy out in two parts if the tail wraps around the end of the ring
+
+	size_t off = (ring->total - len) & RING_MASK;
+	size_t first = len < OUTPUT_RING_SIZE - off ? len : OUTPUT_RING_SIZE - off;
+
+	memcpy(buf, ring->buf + off, first);
+	memcpy(buf + first, ring->buf, len - first);
+
+	pthread_mutex_unlock(&output->lock);
+	return len;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "graph.h"
+
+// capture of each service's stdout and stderr
+// services write to a pipe instead of init's own stdout/stderr, which a dedicated thread drains into a bounded ring buffer per service
+// this way, services don't interleave their output on the console, and never wait on it either
+//
+// once the log directory is writable, each service's output is also streamed to its own log file in there
+// on Linux, this is done with 'splice(2)' straight from the pipe to the file once the ring has been written out, so the data is never copied through userspace
+
+#define OUTPUT_DIR "/var/log/init"
+#define OUTPUT_RING_SIZE (16 * 1024) // must be a power of two
+
+typedef struct {
+	char* buf; // allocated on the service's first output, so that quiet services cost nothing
+	uint64_t total; // total number of bytes ever written to the ring (i.e. the write position)
+
+	int fd; // read end of the service's pipe, or -1 once closed
+	int log_fd; // service's log file, or -1 if not opened
+
+	uint64_t persisted; // how much of the ring has been written out to the log file
+	uint64_t dropped; // bytes which were overwritten before they could be written out to the log file
+
+	bool spliced; // if some output went straight to the log file, and so never made it to the ring
+	bool no_splice; // if the log file can't be spliced to, so that we don't keep on trying
+} output_ring_t;
+
+typedef struct {
+	graph_t const* graph;
+	size_t services_len;
+
+	char const* dir;
+	bool writable; // whether the log directory could be opened yet
+	time_t last_open_try;
+
+	pthread_mutex_t lock; // protects the rings, as they are queried from other threads
+	output_ring_t* rings;
+
+	pthread_t thread;
+	int wake[2]; // self-pipe for waking the output thread up when there's a new pipe to drain
+} output_t;
+
+void output_init(output_t* output, graph_t const* graph, char const* dir);
+
+// create a pipe for a service about to be started, and start draining it
+// returns the write end for the service's stdout and stderr (to be closed by the caller once the service has been started), or -1 if the pipe couldn't be created
+
+int output_pipe(output_t* output, uint32_t service);
+
+// copy the last (at most) 'len' bytes of output from a service to 'buf'
+// returns the number of bytes copied
+
+size_t output_tail(output_t* output, uint32_t service, char* buf, size_t len);
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pidmap.h"
+
+static size_t hash(pid_t pid) {
+	return (uint32_t) pid * 2654435761u; // Knuth's multiplicative hash
+}
+
+void pidmap_init(pidmap_t* map, size_t expected) {
+	map->len = 0;
+	map->buckets_len = 16;
+
+	while (map->buckets_len < expected * 2) {
+		map->buckets_len *= 2;
+	}
+
+	map->buckets = calloc(map->buckets_len, sizeof *map->buckets);
+}
+
+void pidmap_free(pidmap_t* map) {
+	free(map->buckets);
+}
+
+static void grow(pidmap_t* map) {
+	pidmap_bucket_t* old = map->buckets;
+	size_t old_len = map->buckets_len;
+
+	map->len = 0;
+	map->buckets_len *= 2;
+	map->buckets = calloc(map->buckets_len, sizeof *map->buckets);
+
+	for (size_t i = 0; i < old_len; i++) {
+		if (old[i].pid) {
+			pidmap_insert(map, old[i].pid, old[i].service);
+		}
+	}
+
+	free(old);
+}
+
+void pidmap_insert(pidmap_t* map, pid_t pid, uint32_t service) {
+	if ((map->len + 1) * 2 > map->buckets_len) {
+		grow(map);
+	}
+
+	size_t mask = map->buckets_len - 1;
+	size_t i = hash(pid) & mask;
+
+	while (map->buckets[i].pid && map->buckets[i].pid != pid) {
+		i = (i + 1) & mask;
+	}
+
+	if (!map->buckets[i].pid) {
+		map->len++;
+	}
+
+	map->buckets[i].pid = pid;
+	map->buckets[i].service = service;
+}
+
+static size_t find_bucket(pidmap_t const* map, pid_t pid) {
+	size_t mask = map->buckets_len - 1;
+
+	for (size_t i = hash(pid) & mask;; i = (i + 1) & mask) {
+		if (!map->buckets[i].pid || map->buckets[i].pid == pid) {
+			return i;
+		}
+	}
+}
+
+uint32_t pidmap_find(pidmap_t const* map, pid_t pid) {
+	pidmap_bucket_t* bucket = &map->buckets[find_bucket(map, pid)];
+	return bucket->pid ? bucket->service : PIDMAP_NONE;
+}
+
+uint32_t pidmap_remove(pidmap_t* map, pid_t pid) {
+	size_t mask = map->buckets_len - 1;
+	size_t i = find_bucket(map, pid);
+
+	if (!map->buckets[i].pid) {
+		return PIDMAP_NONE;
+	}
+
+	uint32_t service = map->buckets[i].service;
+	map->len--;
+
+	// shift back any following entries which would otherwise become unreachable
+
+	for (size_t j = (i + 1) & mask; map->buckets[j].pid; j = (j + 1) & mask) {
+		size_t home = hash(map->buckets[j].pid) & mask;
+
+		// can the entry at 'j' be moved to the hole at 'i'? only if its home bucket isn't cyclically in '(i, j]'
+
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			map->buckets[i] = map->buckets[j];
+			i = j;
+		}
+	}
+
+	map->buckets[i].pid = 0;
+
+	return service;
+}
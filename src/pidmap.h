@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// hash map from PIDs to service indices
+// open addressing with linear probing, and backward shift deletion so that there are never any tombstones to clean up
+
+#define PIDMAP_NONE UINT32_MAX
+
+typedef struct {
+	pid_t pid; // 0 for empty buckets
+	uint32_t service;
+} pidmap_bucket_t;
+
+typedef struct {
+	size_t len;
+	size_t buckets_len; // always a power of two
+	pidmap_bucket_t* buckets;
+} pidmap_t;
+
+void pidmap_init(pidmap_t* map, size_t expected);
+void pidmap_free(pidmap_t* map);
+
+void pidmap_insert(pidmap_t* map, pid_t pid, uint32_t service);
+uint32_t pidmap_find(pidmap_t const* map, pid_t pid);
+uint32_t pidmap_remove(pidmap_t* map, pid_t pid); // returns the service the PID belonged to
@@ -0,0 +1,60 @@
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "prio.h"
+
+// nice value of each level (the lower, the more CPU time)
+
+static int const nices[PRIO_LEVEL_COUNT] = {
+	[PRIO_LEVEL_LOW]    = 10,
+	[PRIO_LEVEL_NORMAL] = 0,
+	[PRIO_LEVEL_HIGH]   = -5,
+	[PRIO_LEVEL_BOOST]  = -10,
+};
+
+#if defined(__linux__)
+// glibc has no wrapper for 'ioprio_set', so these come from the kernel's 'linux/ioprio.h'
+// best-effort priorities go from 0 (highest) to 7 (lowest), 4 being what processes get by default with a nice value of 0
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+
+static int const ioprios[PRIO_LEVEL_COUNT] = {
+	[PRIO_LEVEL_LOW]    = 7,
+	[PRIO_LEVEL_NORMAL] = 4,
+	[PRIO_LEVEL_HIGH]   = 2,
+	[PRIO_LEVEL_BOOST]  = 0,
+};
+
+static int set_io(pid_t pid, bool group, prio_level_t level) {
+	int ioprio = IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | ioprios[level];
+	return syscall(SYS_ioprio_set, group ? IOPRIO_WHO_PGRP : IOPRIO_WHO_PROCESS, pid, ioprio);
+}
+#else
+static int set_io(pid_t pid, bool group, prio_level_t level) {
+	(void) pid;
+	(void) group;
+	(void) level;
+
+	return 0;
+}
+#endif
+
+int prio_set(pid_t pid, bool group, prio_level_t level) {
+	int rv = setpriority(group ? PRIO_PGRP : PRIO_PROCESS, pid, nices[level]);
+
+	if (set_io(pid, group, level) < 0) {
+		rv = -1;
+	}
+
+	return rv;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "service.h"
+
+// CPU and I/O priorities services run at
+// each service runs at the level of its priority class (cf. 'service_priority_t'), unless it's boosted while booting (cf. 'sched_boost'):
+//  - on FreeBSD, only the nice value is set, as there's no such thing as a per-process I/O priority
+//  - on Linux, the I/O priority (within the best-effort class) is set along with it, as done by ionice(1)
+// processes inherit both from their parent, so setting them for the process group a service starts in covers whatever it forks too
+
+typedef enum {
+	PRIO_LEVEL_LOW,
+	PRIO_LEVEL_NORMAL,
+	PRIO_LEVEL_HIGH,
+	PRIO_LEVEL_BOOST, // services holding up the boot target
+	PRIO_LEVEL_COUNT,
+} prio_level_t;
+
+static inline prio_level_t prio_class_level(service_priority_t priority) {
+	return
+		priority == SERVICE_PRIORITY_HIGH ? PRIO_LEVEL_HIGH :
+		priority == SERVICE_PRIORITY_LOW  ? PRIO_LEVEL_LOW :
+		PRIO_LEVEL_NORMAL;
+}
+
+// set the priority of a process, or of every process in a process group if 'group' is set
+// returns -1 with 'errno' set if either priority couldn't be set (e.g. 'ESRCH' if the process is already gone)
+
+int prio_set(pid_t pid, bool group, prio_level_t level);
@@ -0,0 +1,363 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#if defined(__FreeBSD__)
+#include <sys/event.h>
+#include <sys/procctl.h>
+#elif defined(__linux__)
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/prctl.h>
+#endif
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "proctree.h"
+
+#define RCVBUF_SIZE (4 * 1024 * 1024)
+
+static void insert(proctree_t* tree, uint32_t service, pid_t pid) {
+	if (pidmap_find(&tree->pidmap, pid) != PIDMAP_NONE) {
+		return;
+	}
+
+	pidmap_insert(&tree->pidmap, pid, service);
+
+	if (tree->lens[service] == tree->caps[service]) {
+		tree->caps[service] = tree->caps[service] ? tree->caps[service] * 2 : 4;
+		tree->pids[service] = realloc(tree->pids[service], tree->caps[service] * sizeof *tree->pids[service]);
+	}
+
+	tree->pids[service][tree->lens[service]++] = pid;
+}
+
+static void forget(proctree_t* tree, pid_t pid) {
+	uint32_t service = pidmap_remove(&tree->pidmap, pid);
+
+	if (service == PIDMAP_NONE) {
+		return;
+	}
+
+	// services hardly ever have more than a handful of processes, so just look for it and swap the last one into its place
+
+	pid_t* pids = tree->pids[service];
+	uint32_t len = tree->lens[service];
+
+	for (uint32_t i = 0; i < len; i++) {
+		if (pids[i] == pid) {
+			pids[i] = pids[--tree->lens[service]];
+			break;
+		}
+	}
+
+	if (pid == tree->reaping) {
+		tree->reaped = service;
+		return;
+	}
+
+	// exit events are often handled before the process is reaped, so hang onto which service our own children belonged to until they are
+	// 'WNOWAIT' leaves the process to be reaped as usual, and anything which isn't our child (i.e. which its parent reaps) fails with 'ECHILD'
+
+	siginfo_t info;
+
+	if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+		pidmap_insert(&tree->exited, pid, service);
+	}
+}
+
+static void forked(proctree_t* tree, pid_t parent, pid_t child) {
+	uint32_t service = pidmap_find(&tree->pidmap, parent);
+
+	if (service != PIDMAP_NONE) {
+		insert(tree, service, child);
+	}
+}
+
+// platform-specific event sources
+
+#if defined(__FreeBSD__)
+static int listen_events(proctree_t* tree) {
+	// we're the default reaper if we're PID 1 already, in which case this fails with 'EBUSY'
+
+	if (procctl(P_PID, getpid(), PROC_REAP_ACQUIRE, NULL) < 0 && errno != EBUSY) {
+		LOG_WARN("procctl(PROC_REAP_ACQUIRE): %s", strerror(errno))
+	}
+
+	tree->fd = kqueue();
+
+	if (tree->fd < 0) {
+		return -1;
+	}
+
+	// track ourselves, so that every process we fork is tracked from the moment it exists (rather than from when we get around to adding it)
+
+	struct kevent ev;
+	EV_SET(&ev, getpid(), EVFILT_PROC, EV_ADD, NOTE_FORK | NOTE_EXIT | NOTE_TRACK, 0, NULL);
+
+	if (kevent(tree->fd, &ev, 1, NULL, 0, NULL) < 0) {
+		int err = errno;
+		close(tree->fd);
+
+		tree->fd = -1;
+		errno = err;
+
+		return -1;
+	}
+
+	tree->tracking = true;
+	return 0;
+}
+
+static size_t read_events(proctree_t* tree) {
+	struct timespec const zero = { 0 };
+	struct kevent evs[64];
+
+	size_t handled = 0;
+	int len;
+
+	while ((len = kevent(tree->fd, NULL, 0, evs, sizeof evs / sizeof *evs, &zero)) > 0) {
+		for (int i = 0; i < len; i++) {
+			struct kevent* ev = &evs[i];
+
+			// a child may well have exited by the time we hear of it, in which case both flags are set
+
+			if (ev->fflags & NOTE_CHILD) {
+				forked(tree, ev->data, ev->ident);
+			}
+
+			if (ev->fflags & NOTE_TRACKERR) {
+				LOG_WARN("Couldn't track a child of process %d", (pid_t) ev->ident)
+			}
+
+			if (ev->fflags & NOTE_EXIT) {
+				forget(tree, ev->ident);
+			}
+		}
+
+		handled += len;
+	}
+
+	return handled;
+}
+#elif defined(__linux__)
+typedef struct __attribute__((packed)) {
+	struct nlmsghdr hdr;
+	struct cn_msg msg;
+	enum proc_cn_mcast_op op;
+} listen_msg_t;
+
+static int listen_events(proctree_t* tree) {
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
+		LOG_WARN("prctl(PR_SET_CHILD_SUBREAPER): %s", strerror(errno))
+	}
+
+	tree->fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+
+	if (tree->fd < 0) {
+		return -1;
+	}
+
+	// events for every process on the system come in here, and are only read in between everything else, so give them some room
+
+	int rcvbuf = RCVBUF_SIZE;
+	setsockopt(tree->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof rcvbuf);
+
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = CN_IDX_PROC,
+	};
+
+	listen_msg_t msg = {
+		.hdr = {
+			.nlmsg_len = sizeof msg,
+			.nlmsg_type = NLMSG_DONE,
+		},
+		.msg = {
+			.id = { .idx = CN_IDX_PROC, .val = CN_VAL_PROC },
+			.len = sizeof msg.op,
+		},
+		.op = PROC_CN_MCAST_LISTEN,
+	};
+
+	if (bind(tree->fd, (struct sockaddr*) &addr, sizeof addr) < 0 || send(tree->fd, &msg, sizeof msg, 0) < 0) {
+		int err = errno;
+		close(tree->fd);
+
+		tree->fd = -1;
+		errno = err;
+
+		return -1;
+	}
+
+	// 'tracking' is only set once the request is acknowledged, as it's silently ignored outside of the initial PID namespace
+
+	return 0;
+}
+
+static size_t read_events(proctree_t* tree) {
+	_Alignas(struct nlmsghdr) char buf[16 * 1024];
+
+	size_t handled = 0;
+	ssize_t len;
+
+	while ((len = recv(tree->fd, buf, sizeof buf, 0)) != 0) {
+		if (len < 0 && errno == ENOBUFS) {
+			LOG_WARN("Missed some process events, some processes of services may have been lost track of")
+			continue;
+		}
+
+		if (len < 0) {
+			break;
+		}
+
+		for (struct nlmsghdr* hdr = (void*) buf; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+			struct cn_msg* msg = NLMSG_DATA(hdr);
+
+			if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) {
+				continue;
+			}
+
+			// the event isn't aligned in the message, so copy it out before looking at it
+
+			struct proc_event event = { 0 };
+			memcpy(&event, msg->data, msg->len < sizeof event ? msg->len : sizeof event);
+
+			handled++;
+
+			// threads come and go as forks and exits too, but only processes are of interest here
+
+			if (event.what == PROC_EVENT_NONE) {
+				tree->tracking = true;
+			}
+
+			else if (event.what == PROC_EVENT_FORK && event.event_data.fork.child_pid == event.event_data.fork.child_tgid) {
+				forked(tree, event.event_data.fork.parent_tgid, event.event_data.fork.child_tgid);
+			}
+
+			else if (event.what == PROC_EVENT_EXIT && event.event_data.exit.process_pid == event.event_data.exit.process_tgid) {
+				forget(tree, event.event_data.exit.process_tgid);
+			}
+		}
+	}
+
+	return handled;
+}
+#else
+static int listen_events(proctree_t* tree) {
+	(void) tree;
+
+	errno = ENOTSUP;
+	return -1;
+}
+
+static size_t read_events(proctree_t* tree) {
+	(void) tree;
+	return 0;
+}
+#endif
+
+void proctree_init(proctree_t* tree, size_t services_len) {
+	memset(tree, 0, sizeof *tree);
+
+	tree->services_len = services_len;
+	tree->fd = -1;
+
+	size_t alloc_len = services_len ? services_len : 1;
+
+	pidmap_init(&tree->pidmap, services_len);
+	pidmap_init(&tree->exited, 0);
+	tree->pgids = calloc(alloc_len, sizeof *tree->pgids);
+
+	tree->lens = calloc(alloc_len, sizeof *tree->lens);
+	tree->caps = calloc(alloc_len, sizeof *tree->caps);
+	tree->pids = calloc(alloc_len, sizeof *tree->pids);
+
+	if (listen_events(tree) < 0) {
+		LOG_WARN("Can't follow the processes services fork (%s), only their process groups will be", strerror(errno))
+	}
+}
+
+void proctree_free(proctree_t* tree) {
+	if (tree->fd >= 0) {
+		close(tree->fd);
+	}
+
+	for (size_t i = 0; i < tree->services_len; i++) {
+		free(tree->pids[i]);
+	}
+
+	pidmap_free(&tree->pidmap);
+	pidmap_free(&tree->exited);
+	free(tree->pgids);
+
+	free(tree->lens);
+	free(tree->caps);
+	free(tree->pids);
+}
+
+void proctree_add(proctree_t* tree, uint32_t service, pid_t pid) {
+	insert(tree, service, pid);
+	tree->pgids[service] = pid;
+}
+
+size_t proctree_process(proctree_t* tree) {
+	if (tree->fd < 0) {
+		return 0;
+	}
+
+	return read_events(tree);
+}
+
+uint32_t proctree_reaped(proctree_t* tree, pid_t pid) {
+	// a process can't exit without its exit event having been sent, so we'll have forgotten about it one way or another once all events are handled
+	// its PID can't be reused until it's been reaped either, so there's no mistaking it for another process in the meantime
+
+	tree->reaping = pid;
+	tree->reaped = PIDMAP_NONE;
+
+	proctree_process(tree);
+	forget(tree, pid);
+
+	tree->reaping = 0;
+
+	if (tree->reaped == PIDMAP_NONE) {
+		tree->reaped = pidmap_remove(&tree->exited, pid);
+	}
+
+	return tree->reaped;
+}
+
+int proctree_kill(proctree_t* tree, uint32_t service, int sig) {
+	proctree_process(tree);
+
+	bool found = false;
+
+	for (uint32_t i = 0; i < tree->lens[service]; i++) {
+		found |= kill(tree->pids[service][i], sig) == 0;
+	}
+
+	// without fork events, all we have to go on is the process group
+	// this is only done then, as once it's empty, nothing stops its ID from being reused by something else entirely
+
+	pid_t pgid = tree->pgids[service];
+
+	if (!tree->tracking && pgid) {
+		found |= killpg(pgid, sig) == 0;
+	}
+
+	if (!found) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	return 0;
+}
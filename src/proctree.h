@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "pidmap.h"
+
+// tracking of all the processes of each service, not just the one init started itself
+// research UNIX-style services typically fork off their daemon (which forks again and calls 'setsid') and exit, which would leave init with no idea of the processes actually providing the service
+//
+// to keep track of them, init makes itself a subreaper (so that orphaned descendants of services are reparented to it, whatever PID it runs as), starts each service in its own process group, and follows every fork and exit:
+//  - on FreeBSD, with an 'EVFILT_PROC' kevent on init's own process, which the kernel carries over to each child as it's forked ('NOTE_TRACK')
+//  - on Linux, with the process events connector (which is only available in the initial PID namespace)
+// any process forked by a process of a service is then part of that service too, whatever it does to its process group or session
+// where fork events aren't available, the processes of a service are only the ones init started and whatever is left in their process group
+
+typedef struct {
+	size_t services_len;
+
+	int fd; // where fork and exit events come in, or -1 if there are none
+	bool tracking; // whether fork and exit events are actually coming in (the Linux connector only says so once it's acknowledged our request)
+
+	pidmap_t pidmap; // every live process known to belong to a service, to that service
+	pidmap_t exited; // processes of services which have exited but are still ours to reap, to that service
+	pid_t* pgids; // process group of the last process init started for each service, or 0
+
+	pid_t reaping; // process being reaped, whose exit event may well be handled before we get to it
+	uint32_t reaped; // service it belonged to
+
+	// processes of each service, so that going through all of them is O(processes) rather than O(all processes on the system)
+
+	uint32_t* lens;
+	uint32_t* caps;
+	pid_t** pids;
+} proctree_t;
+
+void proctree_init(proctree_t* tree, size_t services_len);
+void proctree_free(proctree_t* tree);
+
+// add a process init just started for a service, in its own process group
+
+void proctree_add(proctree_t* tree, uint32_t service, pid_t pid);
+
+// handle all the pending fork and exit events (to be called whenever 'tree->fd' is readable)
+// returns the number of events handled
+
+size_t proctree_process(proctree_t* tree);
+
+// forget about a process init has just reaped
+// pending events are handled first, so that whatever it forked before exiting isn't missed
+// processes whose exit was handled before they were reaped (e.g. orphaned daemons exiting while something else is being reaped) are still traced back to their service
+// returns the service it belonged to, or 'PIDMAP_NONE'
+
+uint32_t proctree_reaped(proctree_t* tree, pid_t pid);
+
+// send a signal to all the processes of a service
+// returns -1 with 'errno' set to 'ESRCH' if it has none left
+
+int proctree_kill(proctree_t* tree, uint32_t service, int sig);
+
+static inline size_t proctree_len(proctree_t const* tree, uint32_t service) {
+	return tree->lens[service];
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+
+// binary protocol spoken over init's control socket
+// every message is a fixed-layout header followed by a payload, all in native byte order (the socket never leaves the machine)
+//
+// the socket is a 'SOCK_SEQPACKET' one, so each message is a single record which is never split up or merged with others
+// requests may each act on a batch of services at once, and responses carry an entry per service, in the same order as in the request
+// payloads too large for a single message (e.g. graph exports) are streamed back as a sequence of responses, all but the last of which have 'PROTO_RES_MORE' set
+//
+// clients may also subscribe to service lifecycle events, after which init pushes 'PROTO_CMD_EVENTS' messages to them as services change state, interleaved with responses to any other requests
+
+#define PROTO_SOCK_PATH "/var/run/init.sock"
+
+#define PROTO_MAGIC 0x54494e49 // "INIT"
+#define PROTO_VERSION 2
+
+#define PROTO_MSG_SIZE 4096
+#define PROTO_NAME_LEN 64 // including the null terminator
+
+typedef enum {
+	PROTO_CMD_START = 1,
+	PROTO_CMD_STOP,
+	PROTO_CMD_RESTART,
+	PROTO_CMD_STATUS,
+	PROTO_CMD_RUN_CMD, // run one of a service's custom commands (the first name is the service, the second is the command)
+	PROTO_CMD_OUTPUT, // latest output of a service (streamed)
+	PROTO_CMD_EXPORT, // dependency graph in GraphViz format (streamed)
+	PROTO_CMD_SUBSCRIBE, // subscribe to events of the services named (all of them if none are), of the types in 'flags' (cf. 'PROTO_SUB_*')
+	PROTO_CMD_EVENTS, // pushed by init to subscribers, never sent by clients
+	PROTO_CMD_TOP, // latest CPU and memory use of the services named (all of them if none are), as many records per response as fit, all but the last of which have 'PROTO_RES_MORE' set
+} proto_cmd_t;
+
+typedef enum {
+	PROTO_OK = 0,
+	PROTO_ERR_BAD_REQUEST,
+	PROTO_ERR_VERSION,
+	PROTO_ERR_UNKNOWN_SERVICE,
+	PROTO_ERR_RUNNING,
+	PROTO_ERR_NOT_RUNNING,
+	PROTO_ERR_UNSUPPORTED,
+	PROTO_ERR_FAILED,
+	PROTO_ERR_PERM, // client isn't root or in the service group, and asked to act on services (or read their output) rather than just query them
+} proto_err_t;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t cmd; // 'proto_cmd_t'
+	uint32_t id; // echoed back in the response, so clients can match them up
+	uint16_t count; // number of names following the header
+	uint16_t flags; // command-specific (cf. 'PROTO_SUB_*'), must be 0 otherwise
+} proto_req_t;
+
+#define PROTO_MAX_NAMES ((PROTO_MSG_SIZE - sizeof(proto_req_t)) / PROTO_NAME_LEN)
+
+typedef struct {
+	proto_req_t header;
+	char names[PROTO_MAX_NAMES][PROTO_NAME_LEN];
+} proto_req_msg_t;
+
+#define PROTO_RES_MORE 0x1 // more responses follow for the same request
+
+// service lifecycle events subscribers can be sent
+
+typedef enum {
+	PROTO_EVENT_STARTED, // service was started for the first time
+	PROTO_EVENT_RESTARTED, // service was started again after having completed
+	PROTO_EVENT_READY, // service completed successfully, and services depending on it may start
+	PROTO_EVENT_FAILED, // service completed unsuccessfully
+	PROTO_EVENT_EXITED, // service exited after having been stopped or restarted on request
+	PROTO_EVENT_UNHEALTHY, // service failed too many health probes in a row
+	PROTO_EVENT_COUNT,
+} proto_event_type_t;
+
+// request flags for 'PROTO_CMD_SUBSCRIBE'
+// the low bits are a mask of the event types to subscribe to ('1 << type', all of them if none are set)
+
+#define PROTO_SUB_TYPES ((1 << PROTO_EVENT_COUNT) - 1)
+#define PROTO_SUB_REPLAY 0x8000 // also send all past events init still remembers, rather than just new ones
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t cmd;
+	uint32_t id;
+	uint16_t count; // number of entries or records following the header (or bytes of payload, for streamed commands)
+	uint8_t err; // 'proto_err_t' for the request as a whole
+	uint8_t flags;
+} proto_res_t;
+
+typedef struct {
+	int32_t err; // 'proto_err_t'
+	uint8_t state; // 'service_state_t'
+	uint8_t pad[3];
+	int32_t pid; // 0 if not running
+	float age; // seconds since the service was last started
+	float duration; // seconds it took to complete (or has been running for)
+} proto_entry_t;
+
+// events are numbered in the order they happened, across all services
+// gaps in the numbering mean the subscriber fell so far behind that init had to drop the events in between (or that they were filtered out)
+
+typedef struct {
+	uint64_t seq;
+	double time; // seconds on 'CLOCK_MONOTONIC'
+	uint8_t type; // 'proto_event_type_t'
+	uint8_t pad[3];
+	int32_t pid; // process started or exited
+	int32_t exit_code; // for completions (-1 if the service was killed by a signal)
+	uint32_t pad2;
+	char name[PROTO_NAME_LEN];
+} proto_event_t;
+
+// CPU and memory use of a service, sampled periodically by init (cf. 'sampler.h')
+// CPU use is a share of a single core, and memory use is the resident set size of all the service's processes, in kilobytes
+
+typedef struct {
+	uint8_t state; // 'service_state_t'
+	uint8_t pad[3];
+	uint32_t procs; // number of processes
+	float cpu; // over the last sampling interval
+	float cpu_avg; // over the last 'SAMPLER_WINDOW' intervals
+	float cpu_max;
+	uint32_t pad2;
+	uint64_t rss;
+	uint64_t rss_max; // over the last 'SAMPLER_WINDOW' intervals
+	char name[PROTO_NAME_LEN];
+} proto_top_t;
+
+#define PROTO_MAX_ENTRIES ((PROTO_MSG_SIZE - sizeof(proto_res_t)) / sizeof(proto_entry_t))
+#define PROTO_MAX_PAYLOAD (PROTO_MSG_SIZE - sizeof(proto_res_t))
+#define PROTO_MAX_EVENTS (PROTO_MAX_PAYLOAD / sizeof(proto_event_t))
+#define PROTO_MAX_TOPS (PROTO_MAX_PAYLOAD / sizeof(proto_top_t))
+
+typedef struct {
+	proto_res_t header;
+
+	union {
+		proto_entry_t entries[PROTO_MAX_ENTRIES];
+		char payload[PROTO_MAX_PAYLOAD];
+		proto_event_t events[PROTO_MAX_EVENTS];
+		proto_top_t tops[PROTO_MAX_TOPS];
+	};
+} proto_res_msg_t;
+
+_Static_assert(sizeof(proto_req_t) == 16, "request header must stay fixed-size");
+_Static_assert(sizeof(proto_res_t) == 16, "response header must stay fixed-size");
+_Static_assert(sizeof(proto_entry_t) == 20, "response entries must stay fixed-size");
+_Static_assert(sizeof(proto_event_t) == 96, "events must stay fixed-size");
+_Static_assert(sizeof(proto_top_t) == 104, "top records must stay fixed-size");
+_Static_assert(sizeof(proto_req_msg_t) <= PROTO_MSG_SIZE && sizeof(proto_res_msg_t) <= PROTO_MSG_SIZE, "messages must fit in a single record");
+_Static_assert(PROTO_MAX_ENTRIES >= PROTO_MAX_NAMES, "every name in a request must get an entry in the response");
@@ -0,0 +1,558 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/fanotify.h>
+#endif
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "readahead.h"
+
+// profile loading
+
+static int load(readahead_t* ra) {
+	FILE* fp = fopen(ra->path, "r");
+
+	if (!fp) {
+		return -1;
+	}
+
+	struct stat sb;
+
+	if (fstat(fileno(fp), &sb) < 0) {
+		fclose(fp);
+		return -1;
+	}
+
+	ra->buf = malloc(sb.st_size + 1);
+	size_t len = fread(ra->buf, 1, sb.st_size, fp);
+	ra->buf[len] = '\0';
+
+	fclose(fp);
+
+	// first pass, to split lines up and count how many files there are in each group
+
+	size_t lines_len = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		lines_len += ra->buf[i] == '\n';
+	}
+
+	uint32_t* line_groups = malloc((lines_len + 1) * sizeof *line_groups);
+	char const** line_files = malloc((lines_len + 1) * sizeof *line_files);
+	size_t files_len = 0;
+
+	char* rest = ra->buf;
+	char* line;
+
+	while ((line = strsep(&rest, "\n"))) {
+		char* name = strsep(&line, "\t");
+
+		if (!line || !*name || *line != '/') {
+			continue; // blank or invalid line
+		}
+
+		line_groups[files_len] = strtab_intern(&ra->names, name);
+		line_files[files_len++] = line;
+	}
+
+	ra->groups_len = ra->names.len;
+	ra->groups = calloc(ra->groups_len ? ra->groups_len : 1, sizeof *ra->groups);
+	ra->files = malloc((files_len ? files_len : 1) * sizeof *ra->files);
+
+	for (size_t i = 0; i < files_len; i++) {
+		ra->groups[line_groups[i]].files_len++;
+	}
+
+	// second pass, to put the files of each group together (keeping them in order within each group)
+
+	size_t off = 0;
+
+	for (size_t i = 0; i < ra->groups_len; i++) {
+		ra->groups[i].service = GRAPH_NONE;
+		ra->groups[i].files_off = off;
+
+		off += ra->groups[i].files_len;
+		ra->groups[i].files_len = 0;
+	}
+
+	for (size_t i = 0; i < files_len; i++) {
+		readahead_group_t* group = &ra->groups[line_groups[i]];
+		ra->files[group->files_off + group->files_len++] = line_files[i];
+	}
+
+	free(line_groups);
+	free(line_files);
+
+	LOG_VERBOSE("Loaded readahead profile '%s' (%zu files over %zu services)", ra->path, files_len, ra->groups_len)
+
+	return 0;
+}
+
+// prefetching
+
+static void prefetch(char const* path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+
+	if (fd < 0) {
+		return; // files which don't exist anymore aren't worth complaining about
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
+
+static void* prefetch_thread(void* arg) {
+	readahead_t* ra = arg;
+
+	for (;;) {
+		// urgent groups first, and then the rest in order
+
+		pthread_mutex_lock(&ra->lock);
+
+		// wait for a group to be hinted at, or for the boot to get close enough to the next group in order
+
+		while (!ra->stopping && !ra->urgent_len && ra->next < ra->groups_len && ra->next >= ra->horizon + READAHEAD_AHEAD) {
+			pthread_cond_wait(&ra->cond, &ra->lock);
+		}
+
+		uint32_t group = GRAPH_NONE;
+
+		if (ra->stopping) {
+			pthread_mutex_unlock(&ra->lock);
+			break;
+		}
+
+		else if (ra->urgent_len) {
+			group = ra->urgent[--ra->urgent_len];
+		}
+
+		else if (ra->next < ra->groups_len) {
+			group = ra->next++;
+		}
+
+		pthread_mutex_unlock(&ra->lock);
+
+		if (group == GRAPH_NONE) {
+			break;
+		}
+
+		readahead_group_t* ra_group = &ra->groups[group];
+
+		if (atomic_exchange(&ra_group->claimed, true)) {
+			continue;
+		}
+
+		for (size_t i = 0; i < ra_group->files_len; i++) {
+			prefetch(ra->files[ra_group->files_off + i]);
+		}
+	}
+
+	return NULL;
+}
+
+void readahead_resolve(readahead_t* ra, graph_t const* graph) {
+	ra->graph = graph;
+	ra->services_len = graph->services_len;
+	ra->service_groups = malloc((graph->services_len ? graph->services_len : 1) * sizeof *ra->service_groups);
+
+	for (size_t i = 0; i < graph->services_len; i++) {
+		ra->service_groups[i] = GRAPH_NONE;
+	}
+
+	for (size_t i = 0; i < ra->groups_len; i++) {
+		uint32_t service = graph_search(graph, strtab_str(&ra->names, i));
+
+		if (service != GRAPH_NONE && !strcmp(graph_name(graph, service), strtab_str(&ra->names, i))) {
+			ra->groups[i].service = service;
+			ra->service_groups[service] = i;
+		}
+	}
+
+	if (ra->recording) {
+		pidmap_init(&ra->pids, graph->services_len);
+	}
+}
+
+void readahead_hint(readahead_t* ra, uint32_t service) {
+	if (!ra->service_groups || ra->service_groups[service] == GRAPH_NONE) {
+		return;
+	}
+
+	uint32_t group = ra->service_groups[service];
+	readahead_group_t* ra_group = &ra->groups[group];
+
+	if (ra_group->queued || atomic_load(&ra_group->claimed)) {
+		return;
+	}
+
+	pthread_mutex_lock(&ra->lock);
+
+	ra_group->queued = true;
+	ra->urgent[ra->urgent_len++] = group;
+
+	pthread_cond_signal(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+}
+
+void readahead_started(readahead_t* ra, uint32_t service, pid_t pid) {
+	readahead_hint(ra, service);
+
+	// the boot has gotten at least this far, so let the prefetching in order move along with it
+
+	if (ra->service_groups && ra->service_groups[service] != GRAPH_NONE) {
+		pthread_mutex_lock(&ra->lock);
+
+		if (ra->horizon <= ra->service_groups[service]) {
+			ra->horizon = ra->service_groups[service] + 1;
+			pthread_cond_broadcast(&ra->cond);
+		}
+
+		pthread_mutex_unlock(&ra->lock);
+	}
+
+	if (ra->recording && ra->graph) {
+		pidmap_insert(&ra->pids, pid, service);
+	}
+}
+
+// recording
+
+#if defined(__linux__)
+// find the process directly started by us which 'pid' descends from, or 0 if it's us or it can't be found (e.g. it already exited)
+
+static pid_t root_pid(pid_t pid) {
+	pid_t self = getpid();
+
+	for (size_t depth = 0; pid > 1 && pid != self && depth < 64; depth++) {
+		char path[64];
+		snprintf(path, sizeof path, "/proc/%d/stat", pid);
+
+		FILE* fp = fopen(path, "re");
+
+		if (!fp) {
+			return 0;
+		}
+
+		// the process name may contain spaces and parentheses, so look for the parent PID after the last closing parenthesis
+
+		char buf[512];
+		size_t len = fread(buf, 1, sizeof buf - 1, fp);
+		buf[len] = '\0';
+
+		fclose(fp);
+
+		char* end = strrchr(buf, ')');
+		pid_t ppid;
+
+		if (!end || sscanf(end + 1, " %*c %d", &ppid) != 1) {
+			return 0;
+		}
+
+		if (ppid == self) {
+			return pid;
+		}
+
+		pid = ppid;
+	}
+
+	return 0;
+}
+
+static void record(readahead_t* ra, struct fanotify_event_metadata const* event) {
+	char link[64];
+	char path[PATH_MAX];
+
+	snprintf(link, sizeof link, "/proc/self/fd/%d", event->fd);
+	ssize_t len = readlink(link, path, sizeof path - 1);
+
+	if (len <= 0 || *path != '/') {
+		return;
+	}
+
+	path[len] = '\0';
+
+	// only the first time a file is opened matters, and files which were deleted since are of no use
+
+	if (strtab_find(&ra->seen, path) != STRTAB_NONE || strstr(path, " (deleted)")) {
+		return;
+	}
+
+	uint32_t id = strtab_intern(&ra->seen, path);
+
+	if (ra->records_len == ra->records_cap) {
+		ra->records_cap = ra->records_cap ? ra->records_cap * 2 : 256;
+		ra->records = realloc(ra->records, ra->records_cap * sizeof *ra->records);
+	}
+
+	ra->records[ra->records_len].pid = root_pid(event->pid);
+	ra->records[ra->records_len++].path = id;
+}
+
+static void* record_thread(void* arg) {
+	readahead_t* ra = arg;
+
+	struct pollfd fds[2] = {
+		{ .fd = ra->fan_fd, .events = POLLIN },
+		{ .fd = ra->wake[0], .events = POLLIN },
+	};
+
+	char buf[16 * 1024] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+			LOG_WARN("poll: %s", strerror(errno))
+			break;
+		}
+
+		// drain everything there is before checking if we're to stop, so that nothing opened before then is missed
+
+		ssize_t len;
+
+		while ((len = read(ra->fan_fd, buf, sizeof buf)) > 0) {
+			struct fanotify_event_metadata const* event = (void*) buf;
+
+			for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+				if (event->fd < 0) {
+					continue;
+				}
+
+				if (event->vers == FANOTIFY_METADATA_VERSION) {
+					record(ra, event);
+				}
+
+				// the process which opened the file is held up until we've let the open through, i.e. until we're done tracing it back to its service
+
+				if (event->mask & (FAN_OPEN_PERM | FAN_OPEN_EXEC_PERM)) {
+					struct fanotify_response response = {
+						.fd = event->fd,
+						.response = FAN_ALLOW,
+					};
+
+					(void) !write(ra->fan_fd, &response, sizeof response);
+				}
+
+				close(event->fd);
+			}
+		}
+
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+static int record_start(readahead_t* ra) {
+#if defined(__linux__)
+	// only files on the root filesystem are recorded, as the rest are most likely not mounted yet anyway
+	// permission events hold up the processes opening files until they're recorded (cf. 'record_thread'), but the kernel may well not support them, in which case fall back to plain notifications
+
+	unsigned const classes[] = { FAN_CLASS_CONTENT, FAN_CLASS_NOTIF };
+	uint64_t const masks[] = { FAN_OPEN_PERM | FAN_OPEN_EXEC_PERM, FAN_OPEN | FAN_OPEN_EXEC };
+
+	bool ok = false;
+
+	for (size_t i = 0; !ok && i < sizeof classes / sizeof *classes; i++) {
+		ra->fan_fd = fanotify_init(classes[i] | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC | O_NOATIME);
+
+		if (ra->fan_fd < 0) {
+			continue;
+		}
+
+		ok = fanotify_mark(ra->fan_fd, FAN_MARK_ADD | FAN_MARK_MOUNT, masks[i], AT_FDCWD, "/") == 0;
+
+		if (!ok) {
+			int err = errno;
+			close(ra->fan_fd);
+
+			ra->fan_fd = -1;
+			errno = err;
+		}
+	}
+
+	if (!ok) {
+		return -1;
+	}
+
+	ok = pipe(ra->wake) == 0;
+
+	if (ok && (errno = pthread_create(&ra->recorder, NULL, record_thread, ra))) {
+		close(ra->wake[0]);
+		close(ra->wake[1]);
+
+		ok = false;
+	}
+
+	if (ok) {
+		ra->recording = true;
+		ra->unsaved = true;
+
+		return 0;
+	}
+
+	int err = errno;
+	close(ra->fan_fd);
+
+	ra->fan_fd = -1;
+	errno = err;
+
+	return -1;
+#else
+	(void) ra;
+
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+void readahead_init(readahead_t* ra, char const* path, bool record) {
+	memset(ra, 0, sizeof *ra);
+
+	ra->path = path;
+	ra->fan_fd = -1;
+
+	strtab_init(&ra->names);
+	strtab_init(&ra->seen);
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+
+	// the files we'd prefetch would be recorded as being opened by us, so we only ever do one or the other
+
+	if (!record && load(ra) < 0) {
+		if (errno != ENOENT) {
+			LOG_WARN("Couldn't load readahead profile '%s': %s", path, strerror(errno))
+		}
+
+		record = true;
+	}
+
+	if (record) {
+		if (record_start(ra) < 0 && errno != ENOTSUP) {
+			LOG_WARN("Couldn't record readahead profile: %s", strerror(errno))
+		}
+
+		return;
+	}
+
+	ra->urgent = malloc((ra->groups_len ? ra->groups_len : 1) * sizeof *ra->urgent);
+
+	for (size_t i = 0; i < READAHEAD_THREADS && i < ra->groups_len; i++) {
+		int err = pthread_create(&ra->threads[i], NULL, prefetch_thread, ra);
+
+		if (err) {
+			LOG_WARN("pthread_create: %s", strerror(err))
+			break;
+		}
+
+		ra->threads_len++;
+	}
+}
+
+static void stop_recording(readahead_t* ra) {
+	if (ra->fan_fd < 0) {
+		return;
+	}
+
+	(void) !write(ra->wake[1], "", 1);
+	pthread_join(ra->recorder, NULL);
+
+	close(ra->fan_fd);
+	close(ra->wake[0]);
+	close(ra->wake[1]);
+
+	ra->fan_fd = -1;
+}
+
+int readahead_save(readahead_t* ra) {
+	if (!ra->unsaved) {
+		return 0;
+	}
+
+	stop_recording(ra);
+
+	// write the new profile next to the old one and swap them
+
+	char tmp_path[256];
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", ra->path);
+
+	FILE* fp = fopen(tmp_path, "we");
+
+	if (!fp) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < ra->records_len; i++) {
+		uint32_t service = ra->graph && ra->records[i].pid ? pidmap_find(&ra->pids, ra->records[i].pid) : PIDMAP_NONE;
+		char const* name = service == PIDMAP_NONE ? "-" : graph_name(ra->graph, service);
+
+		fprintf(fp, "%s\t%s\n", name, strtab_str(&ra->seen, ra->records[i].path));
+	}
+
+	if (fflush(fp) || fsync(fileno(fp)) < 0 || ferror(fp)) {
+		int err = errno;
+
+		fclose(fp);
+		unlink(tmp_path);
+
+		errno = err;
+		return -1;
+	}
+
+	fclose(fp);
+
+	if (rename(tmp_path, ra->path) < 0) {
+		int err = errno;
+		unlink(tmp_path);
+
+		errno = err;
+		return -1;
+	}
+
+	LOG_VERBOSE("Saved readahead profile '%s' (%zu files)", ra->path, ra->records_len)
+
+	ra->unsaved = false;
+	return 0;
+}
+
+void readahead_free(readahead_t* ra) {
+	stop_recording(ra);
+
+	pthread_mutex_lock(&ra->lock);
+	ra->stopping = true;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+
+	for (size_t i = 0; i < ra->threads_len; i++) {
+		pthread_join(ra->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&ra->lock);
+	pthread_cond_destroy(&ra->cond);
+
+	free(ra->buf);
+	free(ra->groups);
+	free(ra->files);
+	free(ra->urgent);
+	free(ra->service_groups);
+	free(ra->records);
+
+	strtab_free(&ra->names);
+	strtab_free(&ra->seen);
+
+	if (ra->recording && ra->graph) {
+		pidmap_free(&ra->pids);
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "graph.h"
+#include "pidmap.h"
+#include "strtab.h"
+
+// boot-time readahead
+// on a recording boot, every file opened during the boot is logged along with the service which opened it (or init itself), in the order they were first opened, and saved as a profile
+// on later boots, the files in the profile are prefetched into the page cache by a few threads, service by service in the order they started in when recorded (which is a dependency order)
+// this is kept at most 'READAHEAD_AHEAD' services ahead of the furthest one (in that order) which has started, so that files aren't read in long before they're needed and evicted again in the meantime
+// services which are about to start (i.e. which are only waiting on one last dependency) jump the queue, so that their files are read in just ahead of them
+// this way, reading files in from a cold cache overlaps with everything else going on, instead of each service waiting on its own reads
+//
+// recording is done with fanotify(7) on Linux, and isn't supported elsewhere yet (profiles recorded elsewhere or written by hand can still be replayed)
+// files are traced back to the service whose process opened them through '/proc', which is done with permission events where the kernel supports them, so that the process is held up until then
+// otherwise, processes which have already exited by the time we get to their events (e.g. short-lived commands run by scripts) can't be traced back, and their files are credited to init
+// prefetching is 'posix_fadvise(POSIX_FADV_WILLNEED)' on each file
+//
+// profiles are text files with a line per file, the name of the service which opened it and its path separated by a tab ('-' for files opened by init itself)
+
+#define READAHEAD_PATH "/var/db/init/readahead"
+#define READAHEAD_THREADS 4
+#define READAHEAD_AHEAD 8
+
+typedef struct {
+	uint32_t service; // once resolved, 'GRAPH_NONE' for init itself and services which don't exist anymore
+
+	size_t files_off; // into 'readahead_t.files'
+	size_t files_len;
+
+	atomic_bool claimed; // whether a thread has started prefetching this group
+	bool queued; // whether the group is in the urgent queue
+} readahead_group_t;
+
+typedef struct {
+	char const* path;
+
+	// profile being replayed
+	// groups of files are per service, and are numbered by their name's ID in 'names' (which is the order they appear in in the profile)
+
+	char* buf; // contents of the profile, which everything points into
+	strtab_t names;
+
+	size_t groups_len;
+	readahead_group_t* groups;
+	char const** files;
+
+	uint32_t* service_groups; // group of each service, or 'GRAPH_NONE'
+	size_t services_len;
+
+	pthread_mutex_t lock; // protects everything below
+	pthread_cond_t cond; // signalled whenever there may be more for the threads to prefetch, or they're to stop
+	size_t next; // next group to prefetch, in order
+	size_t horizon; // one past the furthest group (in order) whose service has started
+	size_t urgent_len;
+	uint32_t* urgent; // groups to prefetch before any others, latest first
+	bool stopping;
+
+	size_t threads_len;
+	pthread_t threads[READAHEAD_THREADS];
+
+	// recording
+
+	bool recording;
+	bool unsaved; // whether the recording still has to be saved
+
+	int fan_fd;
+	int wake[2];
+	pthread_t recorder;
+
+	strtab_t seen; // paths of the files opened so far
+
+	size_t records_len;
+	size_t records_cap;
+
+	struct {
+		pid_t pid; // process started by init which the file was opened under, or 0 for init itself
+		uint32_t path;
+	}* records;
+
+	graph_t const* graph;
+	pidmap_t pids; // processes started by init, to services
+} readahead_t;
+
+// load the profile at 'path' and start prefetching straight away (before the graph even exists, as it's read from files too)
+// if there's no profile yet, or 'record' is set, a new one is recorded instead (if the platform supports it), to be saved once the boot is done
+
+void readahead_init(readahead_t* ra, char const* path, bool record);
+void readahead_free(readahead_t* ra);
+
+// match the services in the profile to those in the graph, once it's been built
+
+void readahead_resolve(readahead_t* ra, graph_t const* graph);
+
+// hint that a service is about to be started, so that its files are prefetched before anything else's
+
+void readahead_hint(readahead_t* ra, uint32_t service);
+
+// to be called once a service has been started, for files opened by its processes to be attributed to it when recording
+
+void readahead_started(readahead_t* ra, uint32_t service, pid_t pid);
+
+// stop recording, and save the profile
+// returns -1 (with 'errno' set) if the profile can't be written yet, in which case it's kept around for the next call
+
+int readahead_save(readahead_t* ra);
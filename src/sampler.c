@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#endif
+
+#include "sampler.h"
+#include "timing.h"
+
+static void sample_timer(void* data, uint32_t arg) {
+	(void) arg;
+
+	sampler_t* sampler = data;
+	sampler_sample(sampler);
+
+	sampler->timer = timers_add(sampler->timers, __get_time() + sampler->interval, sample_timer, sampler, 0);
+}
+
+void sampler_init(sampler_t* sampler, sched_t const* sched, timers_t* timers, long double interval) {
+	memset(sampler, 0, sizeof *sampler);
+
+	sampler->sched = sched;
+	sampler->timers = timers;
+	sampler->interval = interval;
+
+	size_t alloc_len = sched->services_len ? sched->services_len : 1;
+
+	sampler->cpu_times = calloc(alloc_len, sizeof *sampler->cpu_times);
+	sampler->procs = calloc(alloc_len, sizeof *sampler->procs);
+
+	sampler->cpu = calloc(alloc_len * SAMPLER_WINDOW, sizeof *sampler->cpu);
+	sampler->rss = calloc(alloc_len * SAMPLER_WINDOW, sizeof *sampler->rss);
+
+	sampler->cpu_now = calloc(alloc_len, sizeof *sampler->cpu_now);
+
+	// the first sample is just a starting point for the next one to compare against
+
+	sampler_sample(sampler);
+	sampler->timer = timers_add(timers, __get_time() + interval, sample_timer, sampler, 0);
+}
+
+void sampler_free(sampler_t* sampler) {
+	free(sampler->cpu_times);
+	free(sampler->procs);
+
+	free(sampler->cpu);
+	free(sampler->rss);
+
+	free(sampler->buf);
+	free(sampler->cpu_now);
+}
+
+// read the counters of every process of every service, adding them to 'cpu_now' (in microseconds), 'procs', and the RSS ring at 'slot' (in kilobytes)
+
+#if defined(__FreeBSD__)
+static void read_counters(sampler_t* sampler, size_t slot) {
+	proctree_t const* tree = sampler->sched->tree;
+	int mib[] = { CTL_KERN, KERN_PROC, KERN_PROC_PROC };
+
+	// the buffer is kept around and only grown when there are more processes than ever before
+
+	size_t len;
+
+	for (;;) {
+		len = sampler->buf_len;
+
+		if (len && sysctl(mib, 3, sampler->buf, &len, NULL, 0) == 0) {
+			break;
+		}
+
+		if (len && errno != ENOMEM) {
+			return;
+		}
+
+		if (sysctl(mib, 3, NULL, &len, NULL, 0) < 0) {
+			return;
+		}
+
+		sampler->buf_len = len + len / 4;
+		sampler->buf = realloc(sampler->buf, sampler->buf_len);
+	}
+
+	struct kinfo_proc const* procs = sampler->buf;
+	size_t procs_len = len / sizeof *procs;
+
+	static long page_kb = 0;
+
+	if (!page_kb) {
+		page_kb = getpagesize() / 1024;
+	}
+
+	for (size_t i = 0; i < procs_len; i++) {
+		struct kinfo_proc const* proc = &procs[i];
+		uint32_t service = pidmap_find(&tree->pidmap, proc->ki_pid);
+
+		if (service == PIDMAP_NONE) {
+			continue;
+		}
+
+		uint64_t children =
+			proc->ki_childutime.tv_sec * 1000000 + proc->ki_childutime.tv_usec +
+			proc->ki_childstime.tv_sec * 1000000 + proc->ki_childstime.tv_usec;
+
+		sampler->cpu_now[service] += proc->ki_runtime + children;
+		sampler->procs[service]++;
+		sampler->rss[service * SAMPLER_WINDOW + slot] += proc->ki_rssize * page_kb;
+	}
+}
+#else
+// skip over 'n' space-separated fields
+
+static char const* skip(char const* p, size_t n) {
+	for (; n && *p; p++) {
+		n -= *p == ' ';
+	}
+
+	return p;
+}
+
+static void read_counters(sampler_t* sampler, size_t slot) {
+	proctree_t const* tree = sampler->sched->tree;
+
+	static long tick_us = 0;
+	static long page_kb = 0;
+
+	if (!tick_us) {
+		tick_us = 1000000 / sysconf(_SC_CLK_TCK);
+		page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	}
+
+	char path[32];
+	char buf[512];
+
+	for (uint32_t service = 0; service < tree->services_len; service++) {
+		for (uint32_t i = 0; i < tree->lens[service]; i++) {
+			snprintf(path, sizeof path, "/proc/%d/stat", tree->pids[service][i]);
+
+			int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0) {
+				continue; // exited since, we'll hear of it soon enough
+			}
+
+			ssize_t len = read(fd, buf, sizeof buf - 1);
+			close(fd);
+
+			if (len <= 0) {
+				continue;
+			}
+
+			buf[len] = '\0';
+
+			// the process name may contain spaces and parentheses, so start counting fields after the last closing parenthesis
+			// fields 14 to 17 are utime, stime, cutime, and cstime (in clock ticks), and field 24 is the RSS (in pages)
+
+			char const* p = strrchr(buf, ')');
+
+			if (!p) {
+				continue;
+			}
+
+			p = skip(p, 12);
+
+			char* end;
+			uint64_t ticks = 0;
+
+			for (size_t j = 0; j < 4; j++) {
+				ticks += strtoull(p, &end, 10);
+				p = end + 1;
+			}
+
+			uint64_t rss = strtoull(skip(p, 6), NULL, 10);
+
+			sampler->cpu_now[service] += ticks * tick_us;
+			sampler->procs[service]++;
+			sampler->rss[service * SAMPLER_WINDOW + slot] += rss * page_kb;
+		}
+	}
+}
+#endif
+
+void sampler_sample(sampler_t* sampler) {
+	sched_t const* sched = sampler->sched;
+	size_t services_len = sched->services_len;
+
+	long double now = __get_time();
+	size_t slot = sampler->samples_len % SAMPLER_WINDOW;
+
+	// start from what init reaped itself, which live processes don't account for anymore
+
+	for (size_t i = 0; i < services_len; i++) {
+		usage_t const* usage = &sched->usage[i];
+
+		sampler->cpu_now[i] = (usage->utime + usage->stime) * 1000000;
+		sampler->procs[i] = 0;
+		sampler->rss[i * SAMPLER_WINDOW + slot] = 0;
+	}
+
+	if (sched->tree) {
+		read_counters(sampler, slot);
+	}
+
+	// CPU time can still go backwards a bit (e.g. when a process exits before its parent reaps it), so never count that as negative use
+
+	long double elapsed = (now - sampler->last_time) * 1000000;
+
+	for (size_t i = 0; i < services_len; i++) {
+		uint64_t prev = sampler->cpu_times[i];
+		uint64_t cur = sampler->cpu_now[i];
+
+		bool valid = sampler->samples_len && elapsed > 0 && cur > prev;
+		sampler->cpu[i * SAMPLER_WINDOW + slot] = valid ? (cur - prev) / elapsed : 0;
+	}
+
+	// the counters just read in become the ones to compare the next sample against
+
+	uint64_t* swap = sampler->cpu_times;
+	sampler->cpu_times = sampler->cpu_now;
+	sampler->cpu_now = swap;
+
+	sampler->last_time = now;
+	sampler->samples_len++;
+}
+
+bool sampler_stats(sampler_t const* sampler, uint32_t service, sampler_stats_t* stats) {
+	size_t samples_len = sampler->samples_len;
+
+	if (samples_len < 2) {
+		return false;
+	}
+
+	// the very first sample has no CPU use to speak of, as there was nothing to compare it against
+
+	size_t cpu_len = samples_len - 1 < SAMPLER_WINDOW ? samples_len - 1 : SAMPLER_WINDOW;
+	size_t rss_len = samples_len < SAMPLER_WINDOW ? samples_len : SAMPLER_WINDOW;
+
+	float const* cpu = &sampler->cpu[service * SAMPLER_WINDOW];
+	uint64_t const* rss = &sampler->rss[service * SAMPLER_WINDOW];
+
+	size_t latest = (samples_len - 1) % SAMPLER_WINDOW;
+
+	*stats = (sampler_stats_t) {
+		.procs = sampler->procs[service],
+		.cpu = cpu[latest],
+		.rss = rss[latest],
+	};
+
+	for (size_t i = 0; i < rss_len; i++) {
+		size_t slot = (samples_len - 1 - i) % SAMPLER_WINDOW;
+
+		if (i < cpu_len) {
+			stats->cpu_avg += cpu[slot] / cpu_len;
+			stats->cpu_max = cpu[slot] > stats->cpu_max ? cpu[slot] : stats->cpu_max;
+		}
+
+		stats->rss_max = rss[slot] > stats->rss_max ? rss[slot] : stats->rss_max;
+	}
+
+	return true;
+}
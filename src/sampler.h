@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sched.h"
+#include "timer.h"
+
+// periodic sampling of the CPU and memory use of running services, for 'service top'
+// every interval, the counters of all the processes of every service (cf. 'proctree_t') are read in a single pass:
+//  - on FreeBSD, with a single 'KERN_PROC_PROC' sysctl for every process on the system, matched up to services by PID
+//  - on Linux, which has no way of getting them all at once, from '/proc/<pid>/stat' for each process of a service
+// the CPU time of a service is that of its live processes (including what they reaped), plus that of the processes init reaped itself (cf. 'sched_t.usage'), so that it doesn't go backwards as processes come and go
+//
+// the last 'SAMPLER_WINDOW' samples of each service are kept in fixed-size rings, so that sampling never allocates
+
+#define SAMPLER_INTERVAL 2.0 // seconds, by default
+#define SAMPLER_WINDOW 30
+
+typedef struct {
+	uint32_t procs; // number of processes
+	float cpu; // share of a core used over the last interval (so can be more than 1 on multicore systems)
+	float cpu_avg; // over the window
+	float cpu_max;
+	uint64_t rss; // resident set size of all its processes, in kilobytes
+	uint64_t rss_max; // over the window
+} sampler_stats_t;
+
+typedef struct {
+	sched_t const* sched;
+	timers_t* timers;
+	long double interval;
+	uint32_t timer;
+
+	long double last_time;
+	size_t samples_len; // samples taken so far, the latest of which is at '(samples_len - 1) % SAMPLER_WINDOW' in each ring
+
+	uint64_t* cpu_times; // cumulative CPU time of each service at the last sample, in microseconds
+	uint32_t* procs; // number of processes of each service at the last sample
+
+	// rings of 'SAMPLER_WINDOW' samples per service
+
+	float* cpu;
+	uint64_t* rss;
+
+	// scratch space for reading in counters, reused from one sample to the next
+
+	void* buf;
+	size_t buf_len;
+	uint64_t* cpu_now;
+} sampler_t;
+
+// start sampling every 'interval' seconds, on 'timers'
+// 'sched->tree' must be set, as that's where the processes of each service are known from
+
+void sampler_init(sampler_t* sampler, sched_t const* sched, timers_t* timers, long double interval);
+void sampler_free(sampler_t* sampler);
+
+// take a sample right now (this is what the timer does)
+
+void sampler_sample(sampler_t* sampler);
+
+// latest stats of a service
+// returns false if there aren't enough samples yet (it takes two to tell how much CPU was used in between)
+
+bool sampler_stats(sampler_t const* sampler, uint32_t service, sampler_stats_t* stats);
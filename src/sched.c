@@ -0,0 +1,1412 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "sched.h"
+#include "timing.h"
+
+extern char** environ;
+
+static void build_rdeps(sched_t* sched);
+
+void sched_init(sched_t* sched, graph_t* graph) {
+	memset(sched, 0, sizeof *sched);
+
+	size_t services_len = graph->services_len;
+
+	sched->graph = graph;
+	sched->services_len = services_len;
+
+	sched->rc_subr = "/etc/rc.subr";
+	sched->wake_fd = -1;
+	sched->boost_timer = TIMER_NONE;
+
+	size_t alloc_len = services_len ? services_len : 1;
+
+	sched->flags = malloc(alloc_len * sizeof *sched->flags);
+	sched->states = calloc(alloc_len, sizeof *sched->states);
+	sched->pending = calloc(alloc_len, sizeof *sched->pending);
+
+	sched->pids = calloc(alloc_len, sizeof *sched->pids);
+	pidmap_init(&sched->pidmap, services_len);
+
+	sched->start_times = calloc(alloc_len, sizeof *sched->start_times);
+	sched->total_times = calloc(alloc_len, sizeof *sched->total_times);
+	sched->restarts = calloc(alloc_len, sizeof *sched->restarts);
+	sched->usage = calloc(alloc_len, sizeof *sched->usage);
+
+	sched->restart_policies = malloc(alloc_len * sizeof *sched->restart_policies);
+	sched->failures = calloc(alloc_len, sizeof *sched->failures);
+	sched->restart_timers = malloc(alloc_len * sizeof *sched->restart_timers);
+	sched->calls = calloc(alloc_len, sizeof *sched->calls);
+	sched->out_fds = malloc(alloc_len * sizeof *sched->out_fds);
+
+	sched->probe_timers = malloc(alloc_len * sizeof *sched->probe_timers);
+	sched->probe_failures = calloc(alloc_len, sizeof *sched->probe_failures);
+	sched->probe_pids = calloc(alloc_len, sizeof *sched->probe_pids);
+	pidmap_init(&sched->probes, 0);
+
+	sched->levels = malloc(alloc_len * sizeof *sched->levels);
+	sched->next_levels = malloc(alloc_len * sizeof *sched->next_levels);
+
+	for (size_t i = 0; i < services_len; i++) {
+		sched->restart_policies[i] = graph->services[i].restart;
+		sched->levels[i] = prio_class_level(graph->services[i].priority);
+		sched->restart_timers[i] = TIMER_NONE;
+		sched->out_fds[i] = -1;
+		sched->probe_timers[i] = TIMER_NONE;
+	}
+
+	// copy over flags, both as a bitmask per service and a bitset per flag
+
+	for (size_t i = 0; i < SERVICE_FLAG_COUNT; i++) {
+		sched->flag_bits[i] = bitset_new(services_len);
+	}
+
+	sched->scheduled = bitset_new(services_len);
+	sched->restart = bitset_new(services_len);
+	sched->stopping = bitset_new(services_len);
+	sched->satisfied = bitset_new(services_len);
+
+	for (size_t i = 0; i < services_len; i++) {
+		uint8_t flags = graph->services[i].flags;
+		sched->flags[i] = flags;
+
+		for (size_t j = 0; j < SERVICE_FLAG_COUNT; j++) {
+			if (flags & 1 << j) {
+				bitset_set(sched->flag_bits[j], i);
+			}
+		}
+	}
+
+	build_rdeps(sched);
+}
+
+// build reverse edges, so that completing services can find their dependents
+
+static void build_rdeps(sched_t* sched) {
+	graph_t* graph = sched->graph;
+	size_t services_len = sched->services_len;
+	size_t edges_len = graph->dep_offs[services_len];
+
+	free(sched->rdep_offs);
+	free(sched->rdeps);
+
+	sched->rdep_offs = calloc(services_len + 1, sizeof *sched->rdep_offs);
+	sched->rdeps = malloc((edges_len ? edges_len : 1) * sizeof *sched->rdeps);
+
+	for (size_t i = 0; i < edges_len; i++) {
+		sched->rdep_offs[graph->deps[i] + 1]++;
+	}
+
+	for (size_t i = 0; i < services_len; i++) {
+		sched->rdep_offs[i + 1] += sched->rdep_offs[i];
+	}
+
+	uint32_t* cursors = malloc((services_len ? services_len : 1) * sizeof *cursors);
+	memcpy(cursors, sched->rdep_offs, services_len * sizeof *cursors);
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		for (uint32_t j = graph->dep_offs[i]; j < graph->dep_offs[i + 1]; j++) {
+			sched->rdeps[cursors[graph->deps[j]]++] = i;
+		}
+	}
+
+	free(cursors);
+}
+
+void sched_free(sched_t* sched) {
+	free(sched->flags);
+	free(sched->states);
+	free(sched->pending);
+
+	free(sched->rdep_offs);
+	free(sched->rdeps);
+
+	for (size_t i = 0; i < SERVICE_FLAG_COUNT; i++) {
+		free(sched->flag_bits[i]);
+	}
+
+	free(sched->scheduled);
+	free(sched->restart);
+	free(sched->stopping);
+	free(sched->satisfied);
+
+	free(sched->pids);
+	pidmap_free(&sched->pidmap);
+
+	free(sched->start_times);
+	free(sched->total_times);
+	free(sched->restarts);
+	free(sched->usage);
+
+	for (size_t i = 0; i < sched->services_len; i++) {
+		free(sched->calls[i]);
+
+		if (sched->out_fds[i] >= 0) {
+			close(sched->out_fds[i]);
+		}
+	}
+
+	free(sched->restart_policies);
+	free(sched->failures);
+	free(sched->restart_timers);
+	free(sched->calls);
+	free(sched->out_fds);
+
+	free(sched->probe_timers);
+	free(sched->probe_failures);
+	free(sched->probe_pids);
+	pidmap_free(&sched->probes);
+
+	free(sched->levels);
+	free(sched->next_levels);
+
+	free(sched->boost_targets);
+	free(sched->estimates);
+	free(sched->finishes);
+	free(sched->boost_order);
+
+	free(sched->deferred);
+	free(sched->deferred_active);
+	free(sched->milestones);
+	free(sched->ready);
+}
+
+#define FLAG_BITS(flag) (sched->flag_bits[__builtin_ctz(SERVICE_FLAG_##flag)])
+
+static void count_pending(sched_t* sched);
+
+size_t sched_select(sched_t* sched, bool in_jail, bool in_vnet, bitset_word_t const* closure) {
+	size_t words = bitset_words(sched->services_len);
+
+	bitset_word_t const* on_start   = FLAG_BITS(ON_START);
+	bitset_word_t const* first_boot = FLAG_BITS(FIRST_BOOT);
+	bitset_word_t const* no_jail    = FLAG_BITS(DISABLE_IN_JAIL);
+	bitset_word_t const* no_vnet    = FLAG_BITS(DISABLE_IN_VNET);
+
+	bitset_word_t jail_mask = in_jail ? ~(bitset_word_t) 0 : 0;
+	bitset_word_t vnet_mask = in_vnet ? ~(bitset_word_t) 0 : 0;
+
+	for (size_t i = 0; i < words; i++) {
+		sched->scheduled[i] = on_start[i] & ~first_boot[i] & ~(no_jail[i] & jail_mask) & ~(no_vnet[i] & vnet_mask);
+	}
+
+	if (closure) {
+		for (size_t i = 0; i < words; i++) {
+			sched->scheduled[i] &= closure[i];
+		}
+	}
+
+	count_pending(sched);
+	return bitset_count(sched->scheduled, sched->services_len);
+}
+
+// count how many scheduled dependencies each scheduled service has to wait on
+// dependencies which aren't scheduled are never going to complete, so they aren't waited on at all
+
+static void count_pending(sched_t* sched) {
+	graph_t* graph = sched->graph;
+	size_t words = bitset_words(sched->services_len);
+
+	for (size_t word = 0; word < words; word++) {
+		for (bitset_word_t bits = sched->scheduled[word]; bits; bits &= bits - 1) {
+			uint32_t i = word * BITSET_WORD_BITS + __builtin_ctzll(bits);
+			uint32_t pending = 0;
+
+			for (uint32_t j = graph->dep_offs[i]; j < graph->dep_offs[i + 1]; j++) {
+				pending += bitset_test(sched->scheduled, graph->deps[j]);
+			}
+
+			sched->states[i] = SERVICE_STATE_WAITING;
+			sched->pending[i] = pending;
+		}
+	}
+}
+
+size_t sched_reduce(sched_t* sched, bool report) {
+	size_t removed = graph_reduce(sched->graph, sched->scheduled, report);
+
+	build_rdeps(sched);
+	count_pending(sched);
+
+	return removed;
+}
+
+static void complete(sched_t* sched, uint32_t service, int rv);
+static void release_dependents(sched_t* sched, uint32_t index);
+static void schedule_probe(sched_t* sched, uint32_t index);
+
+static bool is_deferred(sched_t const* sched, uint32_t index) {
+	return sched->deferred && bitset_test(sched->deferred, index);
+}
+
+// deferred services carry on in the background, and supervised ones may never exit (e.g. those running in the foreground), so the boot doesn't wait on either
+
+static bool holds_boot(sched_t const* sched, uint32_t index) {
+	return !is_deferred(sched, index) && sched->restart_policies[index] == SERVICE_RESTART_NEVER;
+}
+
+// start a service, 'booting' being whether it's started as part of the boot plan (i.e. once its dependencies have completed) rather than on request or to be restarted
+
+static void spawn(sched_t* sched, uint32_t index, bool booting) {
+	graph_t* graph = sched->graph;
+	service_t* service = &graph->services[index];
+
+	char const* name = graph_str(graph, service->name);
+	char const* path = graph_str(graph, service->path);
+
+	// memoised services whose inputs are unchanged since they last ran successfully are completed straight away when booting
+	// they're still run when started in any other way (i.e. on request, or restarted), as that's what was asked for, even if they were still waiting to be started by the boot (e.g. held-back deferred services)
+
+	bool skip = booting && sched->memo && memo_fresh(sched->memo, index);
+
+	if (sched->states[index] >= SERVICE_STATE_DONE) {
+		sched->restarts[index]++;
+	}
+
+	// record start time
+
+	if (skip) {
+		LOG_EVENT_INFO("Skipping %s, its inputs haven't changed since it last ran", name)
+	}
+
+	else {
+		LOG_EVENT_INFO("Starting %s", name)
+	}
+
+	sched->start_times[index] = __get_time();
+
+	// deferred services aren't part of the boot as far as its progress is concerned
+
+	if (sched->status && !is_deferred(sched, index)) {
+		status_started(sched->status, index, sched->start_times[index]);
+	}
+
+	if (skip) {
+		complete(sched, index, 0);
+		return;
+	}
+
+	// create new process for service in question
+	// supervised services keep the write end of their output pipe between restarts, so it's only created the first time around
+
+	bool supervised = sched->restart_policies[index] != SERVICE_RESTART_NEVER;
+	int out = sched->out_fds[index];
+
+	if (out < 0 && sched->output) {
+		out = output_pipe(sched->output, index);
+
+		if (supervised) {
+			sched->out_fds[index] = out;
+		}
+	}
+
+	pid_t pid = -1;
+
+	if (service->kind == SERVICE_KIND_RESEARCH) {
+		// research UNIX-style services are just a shell command, so they can be spawned without duplicating init's address space
+		// the command line is built once, and kept for restarts
+
+		if (!sched->calls[index] && asprintf(&sched->calls[index], ". %s && run_rc_script %s faststart", sched->rc_subr, path) < 0) {
+			sched->calls[index] = NULL;
+			errno = ENOMEM;
+		}
+
+		else {
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+
+			if (out >= 0) {
+				posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+				posix_spawn_file_actions_adddup2(&actions, out, STDERR_FILENO);
+			}
+
+			// each service gets a process group of its own, so that it can be signalled as a whole (cf. 'proctree_t')
+
+			posix_spawnattr_t attr;
+			posix_spawnattr_init(&attr);
+
+			posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+			posix_spawnattr_setpgroup(&attr, 0);
+
+			char* const argv[] = { "sh", "-c", sched->calls[index], NULL };
+			int rv = posix_spawnp(&pid, "sh", &actions, &attr, argv, environ);
+
+			posix_spawnattr_destroy(&attr);
+			posix_spawn_file_actions_destroy(&actions);
+
+			if (rv) {
+				pid = -1;
+				errno = rv;
+			}
+		}
+	}
+
+	else {
+		pid = fork();
+
+		if (!pid) {
+			setpgid(0, 0);
+
+			// the 'SIGCHLD' handler is only there to wake init up, not whenever the service's own children exit
+
+			signal(SIGCHLD, SIG_DFL);
+
+			if (out >= 0) {
+				dup2(out, STDOUT_FILENO);
+				dup2(out, STDERR_FILENO);
+			}
+
+			if (service->kind == SERVICE_KIND_AQUABSD) {
+				_exit(service->aquabsd.start());
+			}
+
+			else {
+				// TODO
+			}
+
+			_exit(EXIT_FAILURE);
+		}
+
+		// set the process group from here too, so that it's there by the time anything is done with it, whichever of us gets to run first
+
+		if (pid > 0) {
+			setpgid(pid, pid);
+		}
+	}
+
+	if (out >= 0 && !supervised) {
+		close(out);
+	}
+
+	if (pid < 0) {
+		LOG_ERROR("Couldn't start %s: %s", name, strerror(errno))
+
+		complete(sched, index, -1);
+		return;
+	}
+
+	sched->states[index] = SERVICE_STATE_RUNNING;
+	sched->pids[index] = pid;
+	sched->running++;
+	sched->boost_stale = true;
+
+	if (holds_boot(sched, index)) {
+		sched->holding++;
+	}
+
+	pidmap_insert(&sched->pidmap, pid, index);
+
+	if (sched->tree) {
+		proctree_add(sched->tree, index, pid);
+	}
+
+	// services run at the priority of their class, or whatever they were boosted to while waiting to start
+	// everything starts off at the normal level, as that's where init is
+
+	if (sched->levels[index] != PRIO_LEVEL_NORMAL) {
+		prio_set(pid, true, sched->levels[index]);
+	}
+
+	if (sched->readahead) {
+		readahead_started(sched->readahead, index, pid);
+	}
+
+	if (sched->table) {
+		table_started(sched->table, index, pid, sched->start_times[index], sched->restarts[index]);
+	}
+
+	if (sched->events) {
+		events_push(sched->events, sched->restarts[index] ? PROTO_EVENT_RESTARTED : PROTO_EVENT_STARTED, index, pid, 0, sched->start_times[index]);
+	}
+
+	schedule_probe(sched, index);
+
+	// supervised services may well never exit (e.g. those running in the foreground), so they're as good as done for their dependents once they've started
+
+	if (supervised) {
+		release_dependents(sched, index);
+	}
+}
+
+// deferred services
+
+// start as many released deferred services as we're allowed to
+// services which were already started some other way in the meantime (e.g. on request) are just dropped
+
+static void start_deferred(sched_t* sched) {
+	while (sched->ready_head < sched->ready_len && sched->deferred_running < sched->deferred_max) {
+		uint32_t index = sched->ready[sched->ready_head++];
+
+		if (sched->states[index] != SERVICE_STATE_WAITING) {
+			continue;
+		}
+
+		bitset_set(sched->deferred_active, index);
+		sched->deferred_running++;
+
+		spawn(sched, index, true);
+	}
+}
+
+// start a service whose dependencies have all completed, unless it's to be held back
+
+static void start_ready(sched_t* sched, uint32_t index) {
+	if (!is_deferred(sched, index)) {
+		spawn(sched, index, true);
+		return;
+	}
+
+	sched->ready[sched->ready_len++] = index;
+
+	if (sched->released) {
+		start_deferred(sched);
+	}
+}
+
+// start any dependents which were only waiting on a service, the first time it completes (or starts, for supervised services)
+
+static void release_dependents(sched_t* sched, uint32_t index) {
+	if (bitset_test(sched->satisfied, index)) {
+		return;
+	}
+
+	bitset_set(sched->satisfied, index);
+
+	for (uint32_t i = sched->rdep_offs[index]; i < sched->rdep_offs[index + 1]; i++) {
+		uint32_t dependent = sched->rdeps[i];
+
+		if (sched->states[dependent] != SERVICE_STATE_WAITING) {
+			continue;
+		}
+
+		if (!--sched->pending[dependent]) {
+			start_ready(sched, dependent);
+		}
+
+		// services only waiting on one last dependency are the next ones up, so get their files read in ahead of time
+
+		else if (sched->pending[dependent] == 1 && sched->readahead) {
+			readahead_hint(sched->readahead, dependent);
+		}
+	}
+}
+
+// send a signal to all the processes of a service, or just the one init started if that's all we know of
+// returns -1 with 'errno' set to 'ESRCH' if there's nothing to signal
+
+static int signal_service(sched_t* sched, uint32_t index, int sig) {
+	if (sched->tree) {
+		return proctree_kill(sched->tree, index, sig);
+	}
+
+	if (sched->states[index] != SERVICE_STATE_RUNNING) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	return kill(sched->pids[index], sig);
+}
+
+static void restart_timer(void* data, uint32_t index) {
+	sched_t* sched = data;
+	sched->restart_timers[index] = TIMER_NONE;
+
+	if (sched->states[index] != SERVICE_STATE_RUNNING) {
+		spawn(sched, index, false);
+	}
+}
+
+// restart a service which exited on its own, if its restart policy says so
+
+static void supervise(sched_t* sched, uint32_t index, int rv) {
+	uint8_t policy = sched->restart_policies[index];
+
+	if (policy == SERVICE_RESTART_NEVER || (policy == SERVICE_RESTART_ON_FAILURE && !rv)) {
+		return;
+	}
+
+	graph_t* graph = sched->graph;
+	char const* name = graph_str(graph, graph->services[index].name);
+
+	// a service which stayed up long enough is considered to have recovered from whatever made it crash before
+
+	if (sched->total_times[index] >= SCHED_STABLE_TIME) {
+		sched->failures[index] = 0;
+	}
+
+	uint32_t failures = ++sched->failures[index];
+
+	if (failures > SCHED_CRASH_LOOP) {
+		LOG_ERROR("%s exited %u times in a row, not restarting it anymore", name, SCHED_CRASH_LOOP + 1)
+
+		sched->failures[index] = 0;
+		return;
+	}
+
+	// the first restart is immediate, as most crashes are one-offs
+
+	if (failures == 1 || !sched->timers) {
+		LOG_INFO("Restarting %s", name)
+
+		spawn(sched, index, false);
+		return;
+	}
+
+	// back off exponentially after that, with "equal jitter" (i.e. somewhere between half and all of the delay)
+
+	long double delay = SCHED_BACKOFF_BASE * (1 << (failures - 2));
+
+	if (delay > SCHED_BACKOFF_MAX) {
+		delay = SCHED_BACKOFF_MAX;
+	}
+
+	delay = delay / 2 + delay / 2 * arc4random_uniform(1001) / 1000;
+
+	LOG_WARN("%s exited %u times in a row, restarting it in %.3Lf seconds", name, failures, delay)
+	sched->restart_timers[index] = timers_add(sched->timers, __get_time() + delay, restart_timer, sched, index);
+}
+
+// health probes
+
+static void probe_timer(void* data, uint32_t index);
+
+static void schedule_probe(sched_t* sched, uint32_t index) {
+	service_t* service = &sched->graph->services[index];
+
+	if (!sched->timers || service->probe == SERVICE_PROBE_NONE || sched->probe_timers[index] != TIMER_NONE) {
+		return;
+	}
+
+	long double jitter = SCHED_PROBE_JITTER * ((long double) arc4random_uniform(2001) / 1000 - 1);
+	long double delay = service->probe_interval * (1 + jitter);
+
+	sched->probe_timers[index] = timers_add(sched->timers, __get_time() + delay, probe_timer, sched, index);
+}
+
+static void cancel_probe(sched_t* sched, uint32_t index) {
+	if (sched->probe_timers[index] != TIMER_NONE) {
+		timers_cancel(sched->timers, sched->probe_timers[index]);
+		sched->probe_timers[index] = TIMER_NONE;
+	}
+
+	sched->probe_failures[index] = 0;
+}
+
+// returns false if the service was found to be unhealthy, in which case it isn't to be probed anymore
+
+static bool probe_completed(sched_t* sched, uint32_t index, bool healthy) {
+	if (healthy) {
+		sched->probe_failures[index] = 0;
+		return true;
+	}
+
+	if (++sched->probe_failures[index] < SCHED_PROBE_FAILURES) {
+		return true;
+	}
+
+	// the service is unhealthy, so stop probing it until it's been started again, and treat it as having crashed
+
+	char const* name = graph_name(sched->graph, index);
+	LOG_WARN("%s failed %d health probes in a row", name, SCHED_PROBE_FAILURES)
+
+	cancel_probe(sched, index);
+
+	if (sched->events) {
+		events_push(sched->events, PROTO_EVENT_UNHEALTHY, index, sched->pids[index], 0, __get_time());
+	}
+
+	// if it's still running, it's completed (and supervised) once it's reaped
+	// otherwise, whatever it left running (e.g. the daemon of a research UNIX-style service) is what's unhealthy, so get rid of that before restarting it
+
+	bool running = sched->states[index] == SERVICE_STATE_RUNNING;
+	signal_service(sched, index, SIGTERM);
+
+	if (!running) {
+		supervise(sched, index, -1);
+	}
+
+	return false;
+}
+
+static bool probe_connect(char const* path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		return false;
+	}
+
+	strcpy(addr.sun_path, path);
+
+	// UNIX-domain connections are established (or refused) straight away, so this never blocks
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (sock < 0) {
+		return false;
+	}
+
+	bool healthy = connect(sock, (struct sockaddr*) &addr, sizeof addr) == 0 || errno == EINPROGRESS;
+	close(sock);
+
+	return healthy;
+}
+
+static pid_t probe_exec(sched_t* sched, uint32_t index, char const* cmd) {
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+
+	// probes write to the service's output if we have it at hand, and nowhere otherwise, so that they don't clutter the console
+
+	int out = sched->out_fds[index];
+
+	if (out >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, out, STDERR_FILENO);
+	}
+
+	else {
+		posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+		posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	}
+
+	pid_t pid;
+	char* const argv[] = { "sh", "-c", (char*) cmd, NULL };
+	int rv = posix_spawnp(&pid, "sh", &actions, NULL, argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (rv) {
+		LOG_WARN("Couldn't run health probe of %s: %s", graph_name(sched->graph, index), strerror(rv))
+		return -1;
+	}
+
+	return pid;
+}
+
+static void probe_timer(void* data, uint32_t index) {
+	sched_t* sched = data;
+	sched->probe_timers[index] = TIMER_NONE;
+
+	// only services which are up are probed (for research UNIX-style services, that includes those whose script completed after forking off the actual daemon)
+
+	uint8_t state = sched->states[index];
+
+	if (state != SERVICE_STATE_RUNNING && state != SERVICE_STATE_DONE) {
+		sched->probe_failures[index] = 0;
+		return;
+	}
+
+	// an exec probe still running from last time is taking too long, which counts as a failure
+
+	pid_t prev = sched->probe_pids[index];
+
+	if (prev) {
+		pidmap_remove(&sched->probes, prev);
+		sched->probe_pids[index] = 0;
+
+		kill(prev, SIGKILL);
+
+		if (!probe_completed(sched, index, false)) {
+			return;
+		}
+	}
+
+	schedule_probe(sched, index);
+
+	service_t* service = &sched->graph->services[index];
+	char const* arg = graph_str(sched->graph, service->probe_arg);
+
+	if (service->probe == SERVICE_PROBE_CONNECT) {
+		probe_completed(sched, index, probe_connect(arg));
+		return;
+	}
+
+	pid_t pid = probe_exec(sched, index, arg);
+
+	if (pid < 0) {
+		probe_completed(sched, index, false);
+		return;
+	}
+
+	sched->probe_pids[index] = pid;
+	pidmap_insert(&sched->probes, pid, index);
+}
+
+static void complete(sched_t* sched, uint32_t index, int rv) {
+	graph_t* graph = sched->graph;
+	service_t* service = &graph->services[index];
+
+	char const* name = graph_str(graph, service->name);
+	pid_t pid = sched->pids[index];
+
+	if (rv) {
+		LOG_WARN("Something went wrong running the %s service at '%s'", name, graph_str(graph, service->path))
+	}
+
+	sched->states[index] = rv ? SERVICE_STATE_FAILED : SERVICE_STATE_DONE;
+	sched->pids[index] = 0;
+	sched->boost_stale = true;
+
+	LOG_EVENT_SUCCESS("Completed %s", name)
+
+	if (sched->status && !is_deferred(sched, index)) {
+		status_completed(sched->status, index, rv);
+	}
+
+	// compute total time service took
+
+	long double now = __get_time();
+	sched->total_times[index] = now - sched->start_times[index];
+
+	if (sched->table) {
+		table_completed(sched->table, index, rv, now);
+	}
+
+	if (sched->memo) {
+		memo_completed(sched->memo, index, rv);
+	}
+
+	// services stopped or restarted on request were expected to exit, so that isn't a failure as far as subscribers are concerned
+
+	bool requested = bitset_test(sched->stopping, index) || bitset_test(sched->restart, index);
+
+	if (bitset_test(sched->stopping, index)) {
+		bitset_clear(sched->stopping, index);
+		cancel_probe(sched, index);
+	}
+
+	if (sched->events) {
+		events_push(sched->events, requested ? PROTO_EVENT_EXITED : rv ? PROTO_EVENT_FAILED : PROTO_EVENT_READY, index, pid, rv, now);
+	}
+
+	// make room for the next deferred service
+
+	if (sched->deferred && bitset_test(sched->deferred_active, index)) {
+		bitset_clear(sched->deferred_active, index);
+		sched->deferred_running--;
+
+		start_deferred(sched);
+	}
+
+	release_dependents(sched, index);
+
+	// if the service was stopped to be restarted, start it right back up
+
+	if (bitset_test(sched->restart, index)) {
+		bitset_clear(sched->restart, index);
+		spawn(sched, index, false);
+
+		return;
+	}
+
+	if (!requested) {
+		supervise(sched, index, rv);
+	}
+}
+
+static int exit_status(int status) {
+	if (WIFSIGNALED(status)) {
+		return -1;
+	}
+
+	if (WIFEXITED(status)) {
+		return WEXITSTATUS(status);
+	}
+
+	return 0;
+}
+
+// reap a child process, and complete the service it belonged to
+// returns the PID reaped (0 if there was nothing to reap with 'WNOHANG'), or -1 on error
+
+static pid_t reap(sched_t* sched, int options) {
+	int status = 0;
+	struct rusage ru;
+	pid_t pid;
+
+	while ((pid = wait4(-1, &status, options, &ru)) < 0 && errno == EINTR);
+
+	if (pid < 0) {
+		if (errno != ECHILD) {
+			LOG_ERROR("wait4: %s", strerror(errno))
+		}
+
+		return -1;
+	}
+
+	if (!pid) {
+		return 0;
+	}
+
+	// as we're PID 1 (or at least a subreaper), we may well be reaping processes which aren't ours (orphans, or descendants of services)
+
+	uint32_t owner = sched->tree ? proctree_reaped(sched->tree, pid) : PIDMAP_NONE;
+	uint32_t index = pidmap_remove(&sched->pidmap, pid);
+
+	// account for whatever the process used (and whatever it reaped itself) to the service it belonged to, before it's completed
+
+	owner = owner == PIDMAP_NONE ? index : owner;
+
+	if (owner != PIDMAP_NONE) {
+		usage_add(&sched->usage[owner], &ru);
+
+		if (sched->table) {
+			table_usage(sched->table, owner, &sched->usage[owner]);
+		}
+	}
+
+	if (index != PIDMAP_NONE) {
+		sched->running--;
+
+		if (holds_boot(sched, index)) {
+			sched->holding--;
+		}
+
+		complete(sched, index, exit_status(status));
+	}
+
+	else if ((index = pidmap_remove(&sched->probes, pid)) != PIDMAP_NONE) {
+		sched->probe_pids[index] = 0;
+		probe_completed(sched, index, WIFEXITED(status) && !WEXITSTATUS(status));
+	}
+
+	return pid;
+}
+
+// priorities and boosting
+
+// level a service runs at when it isn't boosted, i.e. that of its class, or low for deferred services
+
+static uint8_t base_level(sched_t const* sched, uint32_t index) {
+	if (is_deferred(sched, index)) {
+		return PRIO_LEVEL_LOW;
+	}
+
+	return prio_class_level(sched->graph->services[index].priority);
+}
+
+// move a service to another priority level, along with everything it has running
+
+static void set_level(sched_t* sched, uint32_t index, uint8_t level) {
+	if (sched->levels[index] == level) {
+		return;
+	}
+
+	sched->levels[index] = level;
+	proctree_t* tree = sched->tree;
+
+	// without fork events, all we have to go on is the process group, as for signals
+
+	if (tree && tree->tracking) {
+		for (uint32_t i = 0; i < tree->lens[index]; i++) {
+			prio_set(tree->pids[index][i], false, level);
+		}
+	}
+
+	else if (sched->states[index] == SERVICE_STATE_RUNNING) {
+		prio_set(sched->pids[index], true, level);
+	}
+}
+
+void sched_boost(sched_t* sched, size_t targets_len, uint32_t const* targets, float const* estimates) {
+	size_t services_len = sched->services_len;
+	size_t alloc_len = services_len ? services_len : 1;
+
+	// only targets which are going to be started can be held up
+
+	sched->boost_targets = malloc((targets_len ? targets_len : 1) * sizeof *sched->boost_targets);
+	sched->boost_targets_len = 0;
+
+	for (size_t i = 0; i < targets_len; i++) {
+		if (bitset_test(sched->scheduled, targets[i])) {
+			sched->boost_targets[sched->boost_targets_len++] = targets[i];
+		}
+	}
+
+	sched->estimates = malloc(alloc_len * sizeof *sched->estimates);
+	sched->finishes = calloc(alloc_len, sizeof *sched->finishes);
+
+	for (size_t i = 0; i < services_len; i++) {
+		sched->estimates[i] = estimates ? estimates[i] : SCHED_BOOST_ESTIMATE;
+	}
+
+	// topological order of the scheduled services, which we get by running through the boot plan once without any timing (as for simulations)
+
+	uint32_t* order = malloc(alloc_len * sizeof *order);
+	uint32_t* pending = malloc(alloc_len * sizeof *pending);
+
+	size_t order_len = 0;
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		pending[i] = sched->pending[i];
+
+		if (sched->states[i] == SERVICE_STATE_WAITING && !pending[i]) {
+			order[order_len++] = i;
+		}
+	}
+
+	for (size_t i = 0; i < order_len; i++) {
+		uint32_t service = order[i];
+
+		for (uint32_t j = sched->rdep_offs[service]; j < sched->rdep_offs[service + 1]; j++) {
+			uint32_t dependent = sched->rdeps[j];
+
+			if (sched->states[dependent] == SERVICE_STATE_WAITING && !--pending[dependent]) {
+				order[order_len++] = dependent;
+			}
+		}
+	}
+
+	free(pending);
+
+	sched->boost_order = order;
+	sched->boost_order_len = order_len;
+
+	sched->boost_stale = true;
+}
+
+static void unboost(sched_t* sched) {
+	for (uint32_t i = 0; i < sched->services_len; i++) {
+		set_level(sched, i, base_level(sched, i));
+	}
+
+	sched->boost_targets_len = 0;
+}
+
+// work out which services are holding up the targets now, and boost them (and only them)
+// this goes over all the services left to complete, which become fewer and fewer as the boot goes on (cf. 'refresh_boosts' for how often)
+
+static void update_boosts(sched_t* sched) {
+	graph_t* graph = sched->graph;
+	uint8_t const* states = sched->states;
+
+	uint32_t* order = sched->boost_order;
+	uint8_t* next = sched->next_levels;
+	long double* finishes = sched->finishes;
+
+	long double now = __get_time();
+
+	// once all the targets are reached, there's nothing left to hold up
+
+	bool reached = true;
+
+	for (size_t i = 0; i < sched->boost_targets_len; i++) {
+		reached &= states[sched->boost_targets[i]] >= SERVICE_STATE_DONE;
+	}
+
+	if (reached) {
+		LOG_VERBOSE("Boot target reached, no longer boosting anything")
+
+		unboost(sched);
+		return;
+	}
+
+	// expected time each service left is to complete at, dependencies first
+	// services which have completed are dropped from the order as we go, their finish time won't change anymore (nor will they hold anything up)
+
+	size_t order_len = 0;
+
+	for (size_t i = 0; i < sched->boost_order_len; i++) {
+		uint32_t service = order[i];
+		uint8_t state = states[service];
+
+		if (state >= SERVICE_STATE_DONE) {
+			finishes[service] = sched->start_times[service] + sched->total_times[service];
+			set_level(sched, service, base_level(sched, service));
+
+			continue;
+		}
+
+		// services taking longer than expected are expected to complete any moment now
+
+		long double start = state == SERVICE_STATE_RUNNING ? sched->start_times[service] : now;
+
+		if (state == SERVICE_STATE_WAITING) {
+			for (uint32_t j = graph->dep_offs[service]; j < graph->dep_offs[service + 1]; j++) {
+				long double dep_finish = finishes[graph->deps[j]];
+				start = dep_finish > start ? dep_finish : start;
+			}
+		}
+
+		long double finish = start + sched->estimates[service];
+		finishes[service] = finish > now ? finish : now;
+
+		next[service] = base_level(sched, service);
+		order[order_len++] = service;
+	}
+
+	sched->boost_order_len = order_len;
+
+	// the critical path starts from the target expected to be reached last, and follows whichever dependency each service is expected to be waiting on the longest, up to the first service which is already running
+
+	uint32_t service = GRAPH_NONE;
+	long double latest = -1;
+
+	for (size_t i = 0; i < sched->boost_targets_len; i++) {
+		uint32_t target = sched->boost_targets[i];
+
+		if (states[target] < SERVICE_STATE_DONE && finishes[target] > latest) {
+			service = target;
+			latest = finishes[target];
+		}
+	}
+
+	while (service != GRAPH_NONE) {
+		next[service] = PRIO_LEVEL_BOOST;
+
+		if (states[service] != SERVICE_STATE_WAITING) {
+			break;
+		}
+
+		uint32_t holdup = GRAPH_NONE;
+		latest = -1;
+
+		for (uint32_t j = graph->dep_offs[service]; j < graph->dep_offs[service + 1]; j++) {
+			uint32_t dep = graph->deps[j];
+
+			if ((states[dep] == SERVICE_STATE_WAITING || states[dep] == SERVICE_STATE_RUNNING) && finishes[dep] > latest) {
+				holdup = dep;
+				latest = finishes[dep];
+			}
+		}
+
+		service = holdup;
+	}
+
+	// services blocked waiting on others lend them their priority (at most that of the high class, or everything the targets depend on would be boosted too)
+	// dependents come before their dependencies in reverse order, so this is passed all the way up
+
+	for (size_t i = order_len; i--;) {
+		uint32_t waiter = order[i];
+
+		if (states[waiter] != SERVICE_STATE_WAITING || next[waiter] < PRIO_LEVEL_HIGH) {
+			continue;
+		}
+
+		for (uint32_t j = graph->dep_offs[waiter]; j < graph->dep_offs[waiter + 1]; j++) {
+			uint32_t dep = graph->deps[j];
+
+			if (states[dep] < SERVICE_STATE_DONE && next[dep] < PRIO_LEVEL_HIGH) {
+				next[dep] = PRIO_LEVEL_HIGH;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < order_len; i++) {
+		set_level(sched, order[i], next[order[i]]);
+	}
+}
+
+static void boost_timer(void* data, uint32_t index);
+
+// work the boosts out again if anything started or completed since the last time, but no more often than every 'SCHED_BOOST_INTERVAL'
+// if it's too soon, this is left to a timer (or, if there are none, to whenever something next starts or completes after that)
+
+static void refresh_boosts(sched_t* sched) {
+	if (!sched->boost_targets_len || !sched->boost_stale) {
+		return;
+	}
+
+	long double now = __get_time();
+
+	if (now < sched->boost_due) {
+		if (sched->timers && sched->boost_timer == TIMER_NONE) {
+			sched->boost_timer = timers_add(sched->timers, sched->boost_due, boost_timer, sched, 0);
+		}
+
+		return;
+	}
+
+	sched->boost_stale = false;
+	sched->boost_due = now + SCHED_BOOST_INTERVAL;
+
+	update_boosts(sched);
+}
+
+static void boost_timer(void* data, uint32_t index) {
+	(void) index;
+
+	sched_t* sched = data;
+	sched->boost_timer = TIMER_NONE;
+
+	// timers only have a resolution of a tick, so this may well run a hair before it's due
+
+	sched->boost_due = 0;
+	refresh_boosts(sched);
+}
+
+size_t sched_defer(sched_t* sched, size_t milestones_len, uint32_t const* milestones, size_t concurrency) {
+	graph_t* graph = sched->graph;
+	size_t services_len = sched->services_len;
+	size_t words = bitset_words(services_len);
+
+	// whatever the milestones depend on can't be held back
+
+	bitset_word_t* closure = bitset_new(services_len);
+	graph_closure(graph, milestones_len, milestones, closure);
+
+	bitset_word_t const* deferred = FLAG_BITS(DEFERRED);
+	size_t deferred_len = 0;
+
+	// neither can whatever services which aren't deferred depend on, as the boot would then be done before they even started
+
+	uint32_t* roots = malloc((services_len ? services_len : 1) * sizeof *roots);
+	size_t roots_len = 0;
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		if (bitset_test(sched->scheduled, i) && !bitset_test(deferred, i)) {
+			roots[roots_len++] = i;
+		}
+	}
+
+	bitset_word_t* depended = bitset_new(services_len);
+	graph_closure(graph, roots_len, roots, depended);
+
+	free(roots);
+
+	sched->deferred = bitset_new(services_len);
+
+	for (size_t word = 0; word < words; word++) {
+		bitset_word_t needed = sched->scheduled[word] & deferred[word] & closure[word];
+		bitset_word_t promoted = sched->scheduled[word] & deferred[word] & depended[word] & ~closure[word];
+
+		sched->deferred[word] = sched->scheduled[word] & deferred[word] & ~closure[word] & ~depended[word];
+
+		for (; needed; needed &= needed - 1) {
+			uint32_t i = word * BITSET_WORD_BITS + __builtin_ctzll(needed);
+			LOG_WARN("%s is deferred, but the boot milestone depends on it, so it's started as usual", graph_name(graph, i))
+		}
+
+		for (; promoted; promoted &= promoted - 1) {
+			uint32_t i = word * BITSET_WORD_BITS + __builtin_ctzll(promoted);
+			LOG_WARN("%s is deferred, but services which aren't deferred depend on it, so it's started as usual", graph_name(graph, i))
+		}
+
+		for (bitset_word_t bits = sched->deferred[word]; bits; bits &= bits - 1) {
+			uint32_t i = word * BITSET_WORD_BITS + __builtin_ctzll(bits);
+
+			sched->levels[i] = PRIO_LEVEL_LOW;
+			deferred_len++;
+		}
+	}
+
+	free(closure);
+	free(depended);
+
+	if (!deferred_len) {
+		free(sched->deferred);
+		sched->deferred = NULL;
+
+		return 0;
+	}
+
+	sched->deferred_active = bitset_new(services_len);
+	sched->deferred_max = concurrency ? concurrency : 1;
+	sched->ready = malloc(deferred_len * sizeof *sched->ready);
+
+	// only milestones which are going to be started can be reached
+
+	sched->milestones = malloc((milestones_len ? milestones_len : 1) * sizeof *sched->milestones);
+
+	for (size_t i = 0; i < milestones_len; i++) {
+		if (bitset_test(sched->scheduled, milestones[i])) {
+			sched->milestones[sched->milestones_len++] = milestones[i];
+		}
+	}
+
+	return deferred_len;
+}
+
+// with no milestones to speak of, deferred services are only released once the boot is idle
+
+static bool milestones_reached(sched_t const* sched) {
+	if (!sched->milestones_len) {
+		return false;
+	}
+
+	for (size_t i = 0; i < sched->milestones_len; i++) {
+		if (sched->states[sched->milestones[i]] < SERVICE_STATE_DONE) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// wait for something to happen while booting, i.e. a child exiting, a process of a service forking or exiting, or a timer being due, and handle it
+// returns -1 if there's nothing left to wait on
+
+static int wait_boot(sched_t* sched) {
+	if (sched->wake_fd < 0) {
+		if (reap(sched, 0) < 0) {
+			return -1;
+		}
+	}
+
+	else {
+		int timeout = sched->timers ? timers_timeout(sched->timers, __get_time()) : -1;
+
+		// 'poll' just ignores negative file descriptors, so there's no need to leave out the process tree if there isn't one
+
+		struct pollfd fds[] = {
+			{ .fd = sched->wake_fd, .events = POLLIN },
+			{ .fd = sched->tree ? sched->tree->fd : -1, .events = POLLIN },
+		};
+
+		if (poll(fds, sizeof fds / sizeof *fds, timeout) < 0 && errno != EINTR) {
+			LOG_ERROR("poll: %s", strerror(errno))
+			return -1;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			char buf[64];
+			while (read(sched->wake_fd, buf, sizeof buf) > 0);
+		}
+
+		// reap regardless of whether we were woken up for it, in case anything exited before the 'SIGCHLD' handler was installed
+		// this is done before handling process events, as there's no need to hang onto the service of anything which is reaped by then
+
+		sched_reap(sched);
+
+		if (fds[1].revents & POLLIN) {
+			proctree_process(sched->tree);
+		}
+	}
+
+	if (sched->timers) {
+		timers_run(sched->timers, __get_time());
+	}
+
+	return 0;
+}
+
+void sched_run(sched_t* sched) {
+	// start everything which doesn't have to wait on anything
+	// the rest is started as its dependencies complete
+
+	for (uint32_t i = 0; i < sched->services_len; i++) {
+		if (sched->states[i] == SERVICE_STATE_WAITING && !sched->pending[i]) {
+			start_ready(sched, i);
+		}
+	}
+
+	// the critical path moves as services start and complete, so keep up with it
+
+	refresh_boosts(sched);
+
+	for (;;) {
+		// release deferred services once the milestones are reached, or there's nothing else left to wait on
+
+		if (sched->deferred && !sched->released && (milestones_reached(sched) || !sched->holding)) {
+			LOG_INFO("%s, releasing deferred services", sched->holding ? "Reached boot milestone" : "Nothing else left running")
+
+			sched->released = true;
+			start_deferred(sched);
+		}
+
+		// the boot is done once everything it waits on is (cf. 'holds_boot')
+
+		if (!sched->holding) {
+			break;
+		}
+
+		if (wait_boot(sched) < 0) {
+			break;
+		}
+
+		refresh_boosts(sched);
+	}
+
+	// whatever is left boosted (if the targets couldn't be reached) can go back to normal now
+
+	if (sched->boost_targets_len) {
+		unboost(sched);
+	}
+
+	if (sched->timers && sched->boost_timer != TIMER_NONE) {
+		timers_cancel(sched->timers, sched->boost_timer);
+		sched->boost_timer = TIMER_NONE;
+	}
+}
+
+size_t sched_reap(sched_t* sched) {
+	size_t reaped = 0;
+
+	while (reap(sched, WNOHANG) > 0) {
+		reaped++;
+	}
+
+	return reaped;
+}
+
+int sched_start(sched_t* sched, uint32_t index) {
+	if (sched->states[index] == SERVICE_STATE_RUNNING) {
+		errno = EALREADY;
+		return -1;
+	}
+
+	if (sched->restart_timers[index] != TIMER_NONE) {
+		timers_cancel(sched->timers, sched->restart_timers[index]);
+		sched->restart_timers[index] = TIMER_NONE;
+	}
+
+	sched->failures[index] = 0;
+	spawn(sched, index, false);
+	return 0;
+}
+
+int sched_stop(sched_t* sched, uint32_t index) {
+	if (sched->restart_timers[index] != TIMER_NONE) {
+		timers_cancel(sched->timers, sched->restart_timers[index]);
+		sched->restart_timers[index] = TIMER_NONE;
+
+		return 0;
+	}
+
+	bitset_clear(sched->restart, index);
+
+	if (signal_service(sched, index, SIGTERM) < 0) {
+		return -1;
+	}
+
+	// a service which has already completed has nothing left to complete, its leftover processes are just gone once they exit
+
+	if (sched->states[index] == SERVICE_STATE_RUNNING) {
+		bitset_set(sched->stopping, index);
+	}
+
+	return 0;
+}
+
+int sched_restart(sched_t* sched, uint32_t index) {
+	// a service which has already completed is started again straight away, whatever it left running is just told to go away
+
+	if (sched->states[index] != SERVICE_STATE_RUNNING) {
+		signal_service(sched, index, SIGTERM);
+		return sched_start(sched, index);
+	}
+
+	if (signal_service(sched, index, SIGTERM) < 0) {
+		return -1;
+	}
+
+	bitset_set(sched->restart, index);
+	return 0;
+}
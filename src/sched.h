@@ -0,0 +1,214 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include "bitset.h"
+#include "events.h"
+#include "graph.h"
+#include "memo.h"
+#include "output.h"
+#include "pidmap.h"
+#include "prio.h"
+#include "proctree.h"
+#include "readahead.h"
+#include "status.h"
+#include "table.h"
+#include "timer.h"
+#include "usage.h"
+
+typedef enum {
+	SERVICE_STATE_INACTIVE, // not scheduled to be started
+	SERVICE_STATE_WAITING,  // scheduled, but waiting on dependencies to complete
+	SERVICE_STATE_RUNNING,
+	SERVICE_STATE_DONE,
+	SERVICE_STATE_FAILED,
+} service_state_t;
+
+// the scheduler's view of services, as parallel arrays indexed by service (struct-of-arrays)
+// everything touched on each scheduling pass is kept together and as small as possible, so that passes stay in cache even with huge numbers of services
+
+typedef struct {
+	graph_t* graph;
+	size_t services_len;
+
+	char const* rc_subr; // path to the 'rc.subr' script research UNIX-style services are run through
+	output_t* output; // where to capture the output of services, or NULL for them to just inherit init's stdout/stderr
+	status_t* status; // where to report services starting and completing on the console, or NULL for none
+	table_t* table; // shared-memory status table to publish the status of services to, or NULL for none
+	events_t* events; // ring to push service lifecycle events to for subscribers, or NULL for none
+	readahead_t* readahead; // boot readahead to hint at which services are about to start, or NULL for none
+	memo_t* memo; // store of the last runs of memoised services, to skip those whose inputs haven't changed on boot, or NULL to always run them
+	timers_t* timers; // timers to schedule delayed restarts and health probes on, or NULL for services to always be restarted straight away and never be probed
+	proctree_t* tree; // all the processes of each service, for signals to reach the whole service, or NULL to only ever signal the processes init started
+	int wake_fd; // read end of a self-pipe written to on 'SIGCHLD', for 'sched_run' to wait on alongside 'timers' and 'tree', or -1 for it to just block until a child exits (so timers only run in between)
+
+	// hot state
+
+	uint8_t* flags; // 'service_flag_t' bitmask
+	uint8_t* states; // 'service_state_t'
+	uint32_t* pending; // number of dependencies left to complete
+
+	// reverse edges (i.e. which services depend on each service), in the same compressed sparse row form as 'graph_t.deps'
+
+	uint32_t* rdep_offs;
+	uint32_t* rdeps;
+
+	// the same flags, transposed as one bitset per flag, so that filtering services is just a bunch of word-wise operations
+
+	bitset_word_t* flag_bits[SERVICE_FLAG_COUNT];
+	bitset_word_t* scheduled;
+	bitset_word_t* restart; // services to start again once they've been stopped
+	bitset_word_t* stopping; // services stopped on request, whose exit is expected
+	bitset_word_t* satisfied; // services whose dependents no longer wait on them (once they've completed, or started for supervised ones)
+
+	// running processes
+
+	size_t running;
+	size_t holding; // running services the boot waits on, i.e. all but deferred and supervised ones
+	pid_t* pids;
+	pidmap_t pidmap;
+
+	// cold state (timing stuff)
+
+	long double* start_times;
+	long double* total_times;
+	uint32_t* restarts; // number of times each service was started again after the first
+	usage_t* usage; // resources used by the processes of each service reaped so far (including the daemons it left behind, if 'tree' is set)
+
+	// supervision (cf. 'service_restart_t')
+	// the spawn state of supervised services is kept around between restarts, so that restarting them is just a 'posix_spawn' away
+
+	uint8_t* restart_policies; // 'service_restart_t'
+	uint32_t* failures; // consecutive times each service exited too soon, reset once it stays up for 'SCHED_STABLE_TIME'
+	uint32_t* restart_timers; // pending restart of each service, or 'TIMER_NONE'
+	char** calls; // command lines research UNIX-style services are run with, built on first start
+	int* out_fds; // write ends of the output pipes of supervised services, or -1
+
+	// health probes (cf. 'service_probe_t')
+
+	uint32_t* probe_timers; // next probe of each service, or 'TIMER_NONE'
+	uint8_t* probe_failures; // consecutive probes each service failed
+	pid_t* probe_pids; // running exec probe of each service, or 0
+	pidmap_t probes; // the same, the other way around, for reaping
+
+	// priorities (cf. 'prio.h'), and boosting of the services holding up the boot target (cf. 'sched_boost')
+
+	uint8_t* levels; // 'prio_level_t' each service runs (or is to be started) at
+	uint8_t* next_levels; // scratch space for working out the next ones
+
+	size_t boost_targets_len; // 0 if nothing is being boosted (anymore)
+	uint32_t* boost_targets;
+	float* estimates; // expected duration of each service, in seconds
+	long double* finishes; // expected time each service is to complete at
+
+	size_t boost_order_len;
+	uint32_t* boost_order; // services left to complete, dependencies first
+
+	bool boost_stale; // whether anything started or completed since the boosts were last worked out
+	long double boost_due; // earliest time they're to be worked out again
+	uint32_t boost_timer; // pending timer to do so, or 'TIMER_NONE'
+
+	// deferred services (cf. 'sched_defer')
+
+	bitset_word_t* deferred; // services held back while booting, or NULL if none are
+	bitset_word_t* deferred_active; // deferred services started once released, which haven't completed yet
+	bool released;
+
+	size_t milestones_len;
+	uint32_t* milestones;
+
+	size_t deferred_max; // most deferred services to run at once
+	size_t deferred_running;
+
+	size_t ready_head;
+	size_t ready_len;
+	uint32_t* ready; // deferred services whose dependencies have completed, in the order they did
+} sched_t;
+
+// backoff between restarts of a crashing service, in seconds
+// the first restart is immediate, and each one after that waits twice as long as the previous one (with jitter, so that services which crashed together don't all come back together)
+
+#define SCHED_BACKOFF_BASE 0.1
+#define SCHED_BACKOFF_MAX 30.0
+
+// how long a service has to stay up for its crash to not count towards a crash loop, and how many crashes in a row are considered to be one
+// once in a crash loop, the service is left failed until it's started again on request
+
+#define SCHED_STABLE_TIME 10.0
+#define SCHED_CRASH_LOOP 5
+
+// services are probed every 'service_t.probe_interval' seconds, give or take 'SCHED_PROBE_JITTER' of that so that services started together aren't all probed together
+// exec probes still running by the next probe count as failed, and a service failing 'SCHED_PROBE_FAILURES' probes in a row is considered unhealthy
+// unhealthy services are killed if they're still running, and then restarted according to their restart policy just as if they had crashed
+
+#define SCHED_PROBE_JITTER 0.1
+#define SCHED_PROBE_FAILURES 3
+
+// expected duration of services which have never run before, in seconds, when working out the critical path
+// what matters is that they're all the same, so that the critical path is just the longest chain of them
+
+#define SCHED_BOOST_ESTIMATE 0.1
+
+// most often the critical path is worked out again while booting, in seconds, as that goes over all the services left to complete each time
+
+#define SCHED_BOOST_INTERVAL 0.05
+
+// most deferred services to run at once by default
+
+#define SCHED_DEFERRED_CONCURRENCY 2
+
+void sched_init(sched_t* sched, graph_t* graph);
+void sched_free(sched_t* sched);
+
+// select which services are to be started
+// these are the ones to be started on boot (minus those disabled in the current environment), and, if 'closure' is set, only those in it
+// returns the number of services selected
+
+size_t sched_select(sched_t* sched, bool in_jail, bool in_vnet, bitset_word_t const* closure);
+
+// remove the redundant dependencies among the selected services (cf. 'graph_reduce'), so there's less to wait on when scheduling
+// this has to be done on the selection rather than on the whole graph, as a dependency is only implied by another one if whatever's in between actually runs
+// to be called right after 'sched_select'
+// returns the number of dependencies removed
+
+size_t sched_reduce(sched_t* sched, bool report);
+
+// while booting, boost the priority of the services holding up 'targets', on top of their priority class:
+//  - the critical path, i.e. the chain of services expected to hold up the targets the longest, given how long each service is expected to take ('estimates', in seconds, or NULL if there's nothing to go on)
+//  - whatever services of the high priority class (or on the critical path) are waiting on, so that they aren't held up by lower priority services hogging the CPU or disk
+// the critical path is worked out again as services start and complete (at most every 'SCHED_BOOST_INTERVAL'), as it moves with services taking more or less time than expected
+// boosting stops once all the targets have completed, at which point everything goes back to its priority class
+// to be called between 'sched_select' and 'sched_run'
+
+void sched_boost(sched_t* sched, size_t targets_len, uint32_t const* targets, float const* estimates);
+
+// hold back the selected services flagged 'SERVICE_FLAG_DEFERRED' (e.g. repository syncs, or updating the locate database) while booting, so that they don't compete with what's needed to get to 'milestones'
+// they're released once all the milestones have completed, or once there's nothing else left running (i.e. the system is idle as far as the boot is concerned), whichever comes first
+// deferred services the milestones or any services which aren't deferred depend on can't be held back without holding those up too (past the end of the boot, for the latter), so they're started as usual
+// released services are started in the order they became ready, at most 'concurrency' at a time, and at low priority (unless something more important ends up waiting on them)
+// 'sched_run' doesn't wait for them to complete, they carry on in the background and are reaped with 'sched_reap' like anything else
+// to be called between 'sched_select' and 'sched_run'
+// returns the number of services deferred
+
+size_t sched_defer(sched_t* sched, size_t milestones_len, uint32_t const* milestones, size_t concurrency);
+
+// start all selected services, each as soon as all its dependencies have completed, and wait for them all to complete (apart from deferred ones)
+// supervised services (cf. 'service_restart_t') don't hold up the boot either, as they may well be long-running, and their dependents only wait on them to have started
+// while waiting, children are reaped, process events handled, and timers run (e.g. delayed restarts and health probes) just as once booted
+
+void sched_run(sched_t* sched);
+
+// reap all the child processes which have exited (without blocking), completing the services they belonged to
+// returns the number of processes reaped
+
+size_t sched_reap(sched_t* sched);
+
+// start, stop (with 'SIGTERM'), or restart individual services, e.g. on request once booted
+// these don't wait on anything, stopped services are completed when they're reaped
+// stopping or restarting a service signals all its processes, including those left behind by services which have completed (e.g. daemons forked off by research UNIX-style services)
+// starting or stopping a service cancels its pending restart, if any
+// return -1 with 'errno' set to 'EALREADY' if the service is already running (for 'sched_start'), or 'ESRCH' if it has no processes left and no pending restart (for 'sched_stop')
+
+int sched_start(sched_t* sched, uint32_t index);
+int sched_stop(sched_t* sched, uint32_t index);
+int sched_restart(sched_t* sched, uint32_t index);
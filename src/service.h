@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// types
+
+typedef enum {
+	SERVICE_KIND_GENERIC,
+	SERVICE_KIND_RESEARCH, // for research UNIX-style runcom scripts
+	SERVICE_KIND_AQUABSD,
+} service_kind_t;
+
+// service flags (these are what NetBSD would call "keywords")
+
+typedef enum {
+	SERVICE_FLAG_ON_START        = 1 << 0,
+	SERVICE_FLAG_ON_STOP         = 1 << 1,
+	SERVICE_FLAG_ON_RESUME       = 1 << 2,
+
+	SERVICE_FLAG_FIRST_BOOT      = 1 << 3,
+
+	SERVICE_FLAG_DISABLE_IN_JAIL = 1 << 4,
+	SERVICE_FLAG_DISABLE_IN_VNET = 1 << 5,
+
+	SERVICE_FLAG_DEFERRED        = 1 << 6, // held back until the boot milestone is reached (cf. 'sched_defer')
+} service_flag_t;
+
+#define SERVICE_FLAG_COUNT 7
+
+// what to do when a service exits on its own (i.e. without having been stopped on request)
+// 'always' is only really meant for services which run in the foreground, as the start scripts of daemons exit as soon as they've forked
+
+typedef enum {
+	SERVICE_RESTART_NEVER,
+	SERVICE_RESTART_ON_FAILURE,
+	SERVICE_RESTART_ALWAYS,
+} service_restart_t;
+
+// priority class a service runs at, both on the CPU and for I/O (cf. 'prio.h')
+// 'high' is for services things are waiting on interactively (e.g. those a login prompt needs), and 'low' for background work (e.g. indexers) which shouldn't get in anyone's way
+
+typedef enum {
+	SERVICE_PRIORITY_NORMAL,
+	SERVICE_PRIORITY_HIGH,
+	SERVICE_PRIORITY_LOW,
+} service_priority_t;
+
+// how to check that a service is healthy, periodically once it's been started
+
+typedef enum {
+	SERVICE_PROBE_NONE,
+	SERVICE_PROBE_EXEC, // run a shell command, healthy if it exits successfully
+	SERVICE_PROBE_CONNECT, // connect to a UNIX-domain socket, healthy if the service is accepting connections on it
+} service_probe_t;
+
+#define SERVICE_PROBE_INTERVAL 30 // default seconds between probes
+
+typedef int (*aquabsd_start_func_t) (void);
+
+typedef struct {
+	void* lib;
+	aquabsd_start_func_t start;
+} service_aquabsd_t;
+
+// this only holds what's rarely needed about a service
+// everything the scheduler looks at all the time (flags, state, &c) is kept separately in 'sched_t', as parallel arrays
+
+typedef struct {
+	service_kind_t kind;
+	uint8_t flags; // copied over to the scheduler once the graph is built
+	uint8_t restart; // 'service_restart_t', same here
+	uint8_t priority; // 'service_priority_t', same here
+
+	// these are IDs in the graph's string table
+
+	uint32_t name;
+	uint32_t path;
+
+	// health probe, if any (the command or socket path is another ID in the string table)
+
+	uint8_t probe; // 'service_probe_t'
+	uint32_t probe_arg;
+	float probe_interval; // seconds
+
+	// whitespace-separated lists of the files and sysctl OIDs the service depends on and produces, if it's memoised (cf. 'memo.h'), or 'STRTAB_NONE'
+
+	uint32_t inputs;
+	uint32_t outputs;
+
+	// kind-specific members
+
+	union {
+		service_aquabsd_t aquabsd;
+	};
+} service_t;
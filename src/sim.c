@@ -0,0 +1,486 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static char const* policy_names[SIM_POLICY_COUNT] = {
+	[SIM_POLICY_ORDER]    = "order",
+	[SIM_POLICY_CRITICAL] = "critical",
+	[SIM_POLICY_LONGEST]  = "longest",
+	[SIM_POLICY_SHORTEST] = "shortest",
+	[SIM_POLICY_FANOUT]   = "fanout",
+};
+
+sim_policy_t sim_policy(char const* name) {
+	for (sim_policy_t policy = 0; policy < SIM_POLICY_COUNT; policy++) {
+		if (!strcmp(policy_names[policy], name)) {
+			return policy;
+		}
+	}
+
+	return SIM_POLICY_COUNT;
+}
+
+void sim_init(sim_t* sim, sched_t* sched, sim_policy_t policy, size_t concurrency) {
+	memset(sim, 0, sizeof *sim);
+
+	sim->sched = sched;
+	sim->policy = policy;
+	sim->concurrency = concurrency;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	sim->cpus = cpus > 0 ? cpus : 1;
+
+	size_t services_len = sched->services_len;
+	size_t alloc_len = services_len ? services_len : 1;
+
+	sim->durations = malloc(alloc_len * sizeof *sim->durations);
+	sim->cpu = malloc(alloc_len * sizeof *sim->cpu);
+
+	for (size_t i = 0; i < services_len; i++) {
+		sim->durations[i] = SIM_DEFAULT_DURATION;
+		sim->cpu[i] = SIM_DEFAULT_CPU;
+	}
+
+	sim->ready_times = calloc(alloc_len, sizeof *sim->ready_times);
+	sim->start_times = calloc(alloc_len, sizeof *sim->start_times);
+	sim->end_times = calloc(alloc_len, sizeof *sim->end_times);
+	sim->released_by = malloc(alloc_len * sizeof *sim->released_by);
+
+	sim->last = GRAPH_NONE;
+}
+
+void sim_free(sim_t* sim) {
+	free(sim->durations);
+	free(sim->cpu);
+
+	free(sim->ready_times);
+	free(sim->start_times);
+	free(sim->end_times);
+	free(sim->released_by);
+}
+
+int sim_load_profile(sim_t* sim, char const* path) {
+	FILE* fp = fopen(path, "r");
+
+	if (!fp) {
+		return -1;
+	}
+
+	graph_t* graph = sim->sched->graph;
+	size_t services_len = sim->sched->services_len;
+
+	// services not in the profile keep whatever default is in effect when the profile has been read in full, so keep track of those which are
+
+	bool* listed = calloc(services_len ? services_len : 1, sizeof *listed);
+
+	long double default_duration = SIM_DEFAULT_DURATION;
+	float default_cpu = SIM_DEFAULT_CPU;
+
+	int entries = 0;
+	char line[512];
+
+	while (fgets(line, sizeof line, fp)) {
+		char name[256];
+		long double duration;
+		float cpu = SIM_DEFAULT_CPU;
+
+		if (*line == '#' || sscanf(line, "%255s %Lf %f", name, &duration, &cpu) < 2) {
+			continue;
+		}
+
+		if (!strcmp(name, "*")) {
+			default_duration = duration;
+			default_cpu = cpu;
+		}
+
+		else {
+			uint32_t service = graph_search(graph, name);
+
+			if (service == GRAPH_NONE) {
+				continue;
+			}
+
+			sim->durations[service] = duration;
+			sim->cpu[service] = cpu;
+			listed[service] = true;
+		}
+
+		entries++;
+	}
+
+	fclose(fp);
+
+	for (size_t i = 0; i < services_len; i++) {
+		if (!listed[i]) {
+			sim->durations[i] = default_duration;
+			sim->cpu[i] = default_cpu;
+		}
+	}
+
+	free(listed);
+	return entries;
+}
+
+int sim_save_profile(sched_t const* sched, char const* path) {
+	FILE* fp = fopen(path, "w");
+
+	if (!fp) {
+		return -1;
+	}
+
+	fprintf(fp, "# service duration (seconds) cpu (fraction of the duration spent on-CPU)\n");
+
+	for (size_t i = 0; i < sched->services_len; i++) {
+		if (sched->states[i] < SERVICE_STATE_DONE) {
+			continue;
+		}
+
+		// the CPU time of a service may well exceed its duration, if it runs several processes or threads at once
+
+		long double duration = sched->total_times[i];
+		usage_t const* usage = &sched->usage[i];
+
+		long double cpu = duration > 0 ? (usage->utime + usage->stime) / duration : 0;
+		cpu = cpu > 1 ? 1 : cpu;
+
+		fprintf(fp, "%s %Lf %.3Lf\n", graph_name(sched->graph, i), duration, cpu);
+	}
+
+	return fclose(fp);
+}
+
+// binary heap of services ordered by a key per service
+// ties are broken by service index, so that simulations are deterministic
+
+typedef struct {
+	size_t len;
+	uint32_t* services;
+
+	long double const* keys;
+	bool min; // smallest key first if set, largest key first otherwise
+} heap_t;
+
+static bool heap_before(heap_t const* heap, uint32_t a, uint32_t b) {
+	long double ka = heap->keys[a];
+	long double kb = heap->keys[b];
+
+	if (ka != kb) {
+		return heap->min ? ka < kb : ka > kb;
+	}
+
+	return a < b;
+}
+
+static void heap_push(heap_t* heap, uint32_t service) {
+	size_t i = heap->len++;
+
+	while (i) {
+		size_t parent = (i - 1) / 2;
+
+		if (!heap_before(heap, service, heap->services[parent])) {
+			break;
+		}
+
+		heap->services[i] = heap->services[parent];
+		i = parent;
+	}
+
+	heap->services[i] = service;
+}
+
+static uint32_t heap_pop(heap_t* heap) {
+	uint32_t top = heap->services[0];
+	uint32_t service = heap->services[--heap->len];
+
+	size_t i = 0;
+
+	for (;;) {
+		size_t child = i * 2 + 1;
+
+		if (child >= heap->len) {
+			break;
+		}
+
+		if (child + 1 < heap->len && heap_before(heap, heap->services[child + 1], heap->services[child])) {
+			child++;
+		}
+
+		if (!heap_before(heap, heap->services[child], service)) {
+			break;
+		}
+
+		heap->services[i] = heap->services[child];
+		i = child;
+	}
+
+	heap->services[i] = service;
+	return top;
+}
+
+// compute the priority of each service under the simulation's policy (higher goes first)
+
+static void priorities(sim_t const* sim, long double* keys) {
+	sched_t const* sched = sim->sched;
+	size_t services_len = sched->services_len;
+
+	if (sim->policy != SIM_POLICY_CRITICAL) {
+		for (uint32_t i = 0; i < services_len; i++) {
+			long double fanout = sched->rdep_offs[i + 1] - sched->rdep_offs[i];
+
+			keys[i] =
+				sim->policy == SIM_POLICY_LONGEST  ?  sim->durations[i] :
+				sim->policy == SIM_POLICY_SHORTEST ? -sim->durations[i] :
+				sim->policy == SIM_POLICY_FANOUT   ?  fanout :
+				-(long double) i;
+		}
+
+		return;
+	}
+
+	// for the critical path policy, the priority of a service is the length of the longest path from its start to the end of the boot (its "bottom level")
+	// this is computed in reverse topological order of the selected services, which we get by running through the boot plan once without any timing
+
+	uint32_t* order = malloc((services_len ? services_len : 1) * sizeof *order);
+	uint32_t* pending = malloc((services_len ? services_len : 1) * sizeof *pending);
+
+	size_t order_len = 0;
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		pending[i] = sched->pending[i];
+
+		if (sched->states[i] == SERVICE_STATE_WAITING && !pending[i]) {
+			order[order_len++] = i;
+		}
+	}
+
+	for (size_t i = 0; i < order_len; i++) {
+		uint32_t service = order[i];
+
+		for (uint32_t j = sched->rdep_offs[service]; j < sched->rdep_offs[service + 1]; j++) {
+			uint32_t dependent = sched->rdeps[j];
+
+			if (sched->states[dependent] == SERVICE_STATE_WAITING && !--pending[dependent]) {
+				order[order_len++] = dependent;
+			}
+		}
+	}
+
+	while (order_len--) {
+		uint32_t service = order[order_len];
+		long double longest = 0;
+
+		for (uint32_t j = sched->rdep_offs[service]; j < sched->rdep_offs[service + 1]; j++) {
+			uint32_t dependent = sched->rdeps[j];
+
+			if (sched->states[dependent] == SERVICE_STATE_WAITING && keys[dependent] > longest) {
+				longest = keys[dependent];
+			}
+		}
+
+		keys[service] = sim->durations[service] + longest;
+	}
+
+	free(order);
+	free(pending);
+}
+
+void sim_run(sim_t* sim) {
+	sched_t const* sched = sim->sched;
+	size_t services_len = sched->services_len;
+	size_t alloc_len = services_len ? services_len : 1;
+
+	long double* keys = calloc(alloc_len, sizeof *keys);
+	priorities(sim, keys);
+
+	heap_t ready = {
+		.services = malloc(alloc_len * sizeof *ready.services),
+		.keys = keys,
+		.min = false,
+	};
+
+	heap_t running = {
+		.services = malloc(alloc_len * sizeof *running.services),
+		.keys = sim->end_times,
+		.min = true,
+	};
+
+	// the scheduler's own pending counts are left alone, so that it can still be run for real afterwards
+
+	uint32_t* pending = malloc(alloc_len * sizeof *pending);
+	memcpy(pending, sched->pending, services_len * sizeof *pending);
+
+	for (uint32_t i = 0; i < services_len; i++) {
+		sim->released_by[i] = GRAPH_NONE;
+
+		if (sched->states[i] == SERVICE_STATE_WAITING && !pending[i]) {
+			heap_push(&ready, i);
+		}
+	}
+
+	long double now = 0;
+
+	sim->boot_time = 0;
+	sim->last = GRAPH_NONE;
+
+	for (;;) {
+		// start as many ready services as we're allowed to
+
+		while (ready.len && (!sim->concurrency || running.len < sim->concurrency)) {
+			uint32_t service = heap_pop(&ready);
+
+			sim->start_times[service] = now;
+			sim->end_times[service] = now + sim->durations[service];
+
+			heap_push(&running, service);
+		}
+
+		if (!running.len) {
+			break;
+		}
+
+		// complete all the services which end next (there may be more than one at the same time)
+
+		now = sim->end_times[running.services[0]];
+
+		while (running.len && sim->end_times[running.services[0]] == now) {
+			uint32_t service = heap_pop(&running);
+
+			sim->boot_time = now;
+			sim->last = service;
+
+			for (uint32_t j = sched->rdep_offs[service]; j < sched->rdep_offs[service + 1]; j++) {
+				uint32_t dependent = sched->rdeps[j];
+
+				if (sched->states[dependent] != SERVICE_STATE_WAITING || --pending[dependent]) {
+					continue;
+				}
+
+				sim->ready_times[dependent] = now;
+				sim->released_by[dependent] = service;
+
+				heap_push(&ready, dependent);
+			}
+		}
+	}
+
+	free(keys);
+	free(ready.services);
+	free(running.services);
+	free(pending);
+
+	// CPU utilisation curve
+	// spread each service's CPU time evenly over its duration, and then cap each slice to the number of CPUs we have
+
+	memset(sim->curve, 0, sizeof sim->curve);
+
+	if (sim->boot_time <= 0) {
+		return;
+	}
+
+	long double slice = sim->boot_time / SIM_CURVE_LEN;
+
+	for (size_t i = 0; i < services_len; i++) {
+		if (sched->states[i] != SERVICE_STATE_WAITING || sim->durations[i] <= 0) {
+			continue;
+		}
+
+		long double start = sim->start_times[i];
+		long double end = sim->end_times[i];
+
+		for (size_t j = start / slice; j < SIM_CURVE_LEN && j * slice < end; j++) {
+			long double from = start > j * slice ? start : j * slice;
+			long double to = end < (j + 1) * slice ? end : (j + 1) * slice;
+
+			if (to > from) {
+				sim->curve[j] += sim->cpu[i] * (to - from) / slice;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < SIM_CURVE_LEN; i++) {
+		long double load = sim->curve[i] < sim->cpus ? sim->curve[i] : sim->cpus;
+		sim->curve[i] = load / sim->cpus;
+	}
+}
+
+#define CURVE_BAR_WIDTH 50
+
+void sim_report(sim_t const* sim, FILE* fp) {
+	sched_t const* sched = sim->sched;
+	graph_t const* graph = sched->graph;
+
+	size_t simulated = 0;
+
+	for (size_t i = 0; i < sched->services_len; i++) {
+		simulated += sched->states[i] == SERVICE_STATE_WAITING;
+	}
+
+	fprintf(fp, "Predicted boot time: %.3Lf seconds (%zu services, '%s' policy, ", sim->boot_time, simulated, policy_names[sim->policy]);
+
+	if (sim->concurrency) {
+		fprintf(fp, "at most %zu at once, ", sim->concurrency);
+	}
+
+	else {
+		fprintf(fp, "no concurrency limit, ");
+	}
+
+	fprintf(fp, "%zu CPUs)\n", sim->cpus);
+
+	// critical path, i.e. the chain of services which each held up the next, ending with the last service to complete
+
+	size_t path_len = 0;
+
+	for (uint32_t service = sim->last; service != GRAPH_NONE; service = sim->released_by[service]) {
+		path_len++;
+	}
+
+	uint32_t* path = malloc((path_len ? path_len : 1) * sizeof *path);
+	size_t i = path_len;
+
+	for (uint32_t service = sim->last; service != GRAPH_NONE; service = sim->released_by[service]) {
+		path[--i] = service;
+	}
+
+	fprintf(fp, "\nCritical path (%zu services):\n", path_len);
+
+	for (i = 0; i < path_len; i++) {
+		uint32_t service = path[i];
+		long double waited = sim->start_times[service] - sim->ready_times[service];
+
+		fprintf(fp, "  %9.3Lf s  +%8.3Lf s  %s", sim->start_times[service], sim->durations[service], graph_name(graph, service));
+
+		if (waited > 0) {
+			fprintf(fp, " (waited %.3Lf s for a slot)", waited);
+		}
+
+		fprintf(fp, "\n");
+	}
+
+	free(path);
+
+	// CPU utilisation curve
+
+	fprintf(fp, "\nCPU utilisation:\n");
+
+	long double slice = sim->boot_time / SIM_CURVE_LEN;
+	long double average = 0;
+
+	for (i = 0; i < SIM_CURVE_LEN; i++) {
+		long double utilisation = sim->curve[i];
+		average += utilisation / SIM_CURVE_LEN;
+
+		fprintf(fp, "  %9.3Lf s  %3.0Lf%%  ", i * slice, utilisation * 100);
+
+		for (size_t j = 0; j < utilisation * CURVE_BAR_WIDTH + .5; j++) {
+			fputc('#', fp);
+		}
+
+		fprintf(fp, "\n");
+	}
+
+	fprintf(fp, "\nAverage CPU utilisation: %.0Lf%%\n", average * 100);
+}
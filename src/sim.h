@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "sched.h"
+
+// offline boot simulator
+// replays a profile of service durations through the boot plan selected by a scheduler, without actually starting anything
+// this is for evaluating scheduling policies and concurrency limits without having to reboot a bunch of times
+
+typedef enum {
+	SIM_POLICY_ORDER,    // start ready services in the order they were discovered in
+	SIM_POLICY_CRITICAL, // start services with the longest path left to the end of the boot first
+	SIM_POLICY_LONGEST,  // start the longest services first
+	SIM_POLICY_SHORTEST, // start the shortest services first
+	SIM_POLICY_FANOUT,   // start services with the most dependents first
+	SIM_POLICY_COUNT,
+} sim_policy_t;
+
+// number of samples in the CPU utilisation curve
+
+#define SIM_CURVE_LEN 20
+
+// duration and CPU usage (as a fraction of the duration spent on-CPU) of services which aren't in the profile
+
+#define SIM_DEFAULT_DURATION 0.1
+#define SIM_DEFAULT_CPU 1.0
+
+typedef struct {
+	sched_t* sched;
+
+	sim_policy_t policy;
+	size_t concurrency; // maximum number of services running at once, or 0 for no limit
+	size_t cpus;
+
+	// profile
+
+	long double* durations;
+	float* cpu;
+
+	// results
+
+	long double* ready_times;
+	long double* start_times;
+	long double* end_times;
+	uint32_t* released_by; // last dependency to complete before each service was ready, or 'GRAPH_NONE'
+
+	long double boot_time;
+	uint32_t last; // last service to complete
+
+	long double curve[SIM_CURVE_LEN]; // average fraction of all CPUs in use over each slice of the boot
+} sim_t;
+
+// sets up a simulation of the services selected by 'sched'
+// every service starts off with the default duration, until a profile is loaded
+
+void sim_init(sim_t* sim, sched_t* sched, sim_policy_t policy, size_t concurrency);
+void sim_free(sim_t* sim);
+
+sim_policy_t sim_policy(char const* name); // returns 'SIM_POLICY_COUNT' if there's no policy by that name
+
+// profiles are text files with one service per line: its name, its duration in seconds, and optionally the fraction of that time it spent on-CPU
+// a '*' name sets the default for all services not listed, which is useful for synthetic profiles
+// returns the number of entries loaded, or -1 if the profile couldn't be opened (in which case 'errno' is set)
+
+int sim_load_profile(sim_t* sim, char const* path);
+
+// writes a profile of the last boot run by 'sched'
+// returns -1 if the profile couldn't be written (in which case 'errno' is set)
+
+int sim_save_profile(sched_t const* sched, char const* path);
+
+void sim_run(sim_t* sim);
+void sim_report(sim_t const* sim, FILE* fp); // predicted boot time, critical path, and CPU utilisation curve
@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <umber.h>
+#define UMBER_COMPONENT "GAIA"
+
+#include "log.h"
+#include "status.h"
+#include "timing.h"
+
+// render the current status into 'buf'
+
+static void render(status_t* status, char* buf, size_t len) {
+	long double now = __get_time();
+
+	int written = snprintf(buf, len, "[%7.1Lfs] %zu running, %zu/%zu done", now - status->start_time, status->running_len, status->done, status->scheduled);
+
+	if (status->failed && written > 0 && (size_t) written < len) {
+		written += snprintf(buf + written, len - written, ", %zu failed", status->failed);
+	}
+
+	// find the slowest services still running, i.e. those which started first
+
+	uint32_t slowest[STATUS_SLOWEST];
+	size_t slowest_len = 0;
+
+	for (size_t i = 0; i < status->running_len; i++) {
+		size_t j;
+
+		if (slowest_len < STATUS_SLOWEST) {
+			j = slowest_len++;
+		}
+
+		else if (status->running_starts[i] < status->running_starts[slowest[STATUS_SLOWEST - 1]]) {
+			j = STATUS_SLOWEST - 1;
+		}
+
+		else {
+			continue;
+		}
+
+		// keep the list sorted by start time
+
+		slowest[j] = i;
+
+		for (; j > 0 && status->running_starts[slowest[j - 1]] > status->running_starts[slowest[j]]; j--) {
+			uint32_t tmp = slowest[j - 1];
+
+			slowest[j - 1] = slowest[j];
+			slowest[j] = tmp;
+		}
+	}
+
+	for (size_t i = 0; i < slowest_len && written > 0 && (size_t) written < len; i++) {
+		uint32_t service = status->running[slowest[i]];
+		long double elapsed = now - status->running_starts[slowest[i]];
+
+		written += snprintf(buf + written, len - written, "%s%s (%.1Lfs)", i ? ", " : " | waiting on ", graph_name(status->graph, service), elapsed);
+	}
+}
+
+static void* status_thread(void* arg) {
+	status_t* status = arg;
+
+	bool tty = isatty(STDERR_FILENO);
+	long interval = tty ? STATUS_INTERVAL_TTY : STATUS_INTERVAL_PLAIN;
+
+	pthread_mutex_lock(&status->lock);
+
+	while (!status->stopping) {
+		// only render if something's changed, or if there are services running (as their elapsed times have changed)
+		// we don't hold the lock while writing to the console, so a slow console never holds up the scheduler
+
+		if (status->changed || (tty && status->running_len)) {
+			status->changed = false;
+
+			char buf[256];
+			render(status, buf, sizeof buf);
+
+			pthread_mutex_unlock(&status->lock);
+			log_status(buf);
+			pthread_mutex_lock(&status->lock);
+		}
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+
+		deadline.tv_nsec += interval % 1000 * 1000000;
+		deadline.tv_sec += interval / 1000 + deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+
+		while (!status->stopping && pthread_cond_timedwait(&status->cond, &status->lock, &deadline) != ETIMEDOUT);
+	}
+
+	pthread_mutex_unlock(&status->lock);
+	return NULL;
+}
+
+void status_start(status_t* status, graph_t const* graph, size_t scheduled) {
+	memset(status, 0, sizeof *status);
+
+	status->graph = graph;
+	status->scheduled = scheduled;
+	status->start_time = __get_time();
+	status->changed = true;
+
+	size_t services_len = graph->services_len ? graph->services_len : 1;
+
+	status->running = malloc(services_len * sizeof *status->running);
+	status->running_starts = malloc(services_len * sizeof *status->running_starts);
+	status->positions = malloc(services_len * sizeof *status->positions);
+
+	pthread_mutex_init(&status->lock, NULL);
+	pthread_cond_init(&status->cond, NULL);
+
+	if (pthread_create(&status->thread, NULL, status_thread, status)) {
+		LOG_WARN("pthread_create: %s", strerror(errno))
+		return; // keep showing events on the console then
+	}
+
+	status->started = true;
+	log_quiet_events(true);
+}
+
+void status_stop(status_t* status) {
+	pthread_mutex_lock(&status->lock);
+	status->stopping = true;
+	pthread_cond_signal(&status->cond);
+	pthread_mutex_unlock(&status->lock);
+
+	if (status->started) {
+		pthread_join(status->thread, NULL);
+	}
+
+	log_status(NULL);
+	log_quiet_events(false);
+
+	free(status->running);
+	free(status->running_starts);
+	free(status->positions);
+
+	pthread_mutex_destroy(&status->lock);
+	pthread_cond_destroy(&status->cond);
+}
+
+void status_started(status_t* status, uint32_t service, long double time) {
+	pthread_mutex_lock(&status->lock);
+
+	status->positions[service] = status->running_len;
+	status->running[status->running_len] = service;
+	status->running_starts[status->running_len++] = time;
+
+	status->changed = true;
+	pthread_mutex_unlock(&status->lock);
+}
+
+void status_completed(status_t* status, uint32_t service, bool failed) {
+	pthread_mutex_lock(&status->lock);
+
+	// move the last running service into the completed one's place
+
+	uint32_t pos = status->positions[service];
+	uint32_t last = status->running[--status->running_len];
+
+	status->running[pos] = last;
+	status->running_starts[pos] = status->running_starts[status->running_len];
+	status->positions[last] = pos;
+
+	status->done++;
+	status->failed += failed;
+
+	status->changed = true;
+	pthread_mutex_unlock(&status->lock);
+}
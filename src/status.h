@@ -0,0 +1,46 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// console status renderer
+// instead of a line on the console for each service starting and completing, a compact summary is shown and refreshed at a fixed maximum rate
+// the scheduler only updates a few counters here, and all the formatting and writing to the console is done on a separate thread
+
+#define STATUS_INTERVAL_TTY 200 // milliseconds between refreshes on terminals
+#define STATUS_INTERVAL_PLAIN 2000 // milliseconds between refreshes otherwise (e.g. serial consoles), where each refresh is a new line
+#define STATUS_SLOWEST 3 // how many of the slowest services still running to show
+
+typedef struct {
+	graph_t const* graph;
+
+	pthread_mutex_t lock;
+	bool changed;
+	bool stopping;
+
+	long double start_time;
+	size_t scheduled;
+	size_t done;
+	size_t failed;
+
+	// services currently running, with where each one is in that list so that they can be removed in constant time
+
+	size_t running_len;
+	uint32_t* running;
+	long double* running_starts;
+	uint32_t* positions;
+
+	bool started; // whether the thread could be created at all
+	pthread_t thread;
+	pthread_cond_t cond;
+} status_t;
+
+void status_start(status_t* status, graph_t const* graph, size_t scheduled);
+void status_stop(status_t* status); // clears the status line, and starts showing event records on the console again
+
+void status_started(status_t* status, uint32_t service, long double time);
+void status_completed(status_t* status, uint32_t service, bool failed);
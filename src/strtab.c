@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "strtab.h"
+
+#define INITIAL_BUF_CAP 4096
+#define INITIAL_CAP 256
+
+static uint32_t hash(char const* str) {
+	// FNV-1a
+
+	uint32_t hash = 2166136261u;
+
+	for (; *str; str++) {
+		hash ^= (uint8_t) *str;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void strtab_init(strtab_t* strtab) {
+	memset(strtab, 0, sizeof *strtab);
+
+	strtab->buf_cap = INITIAL_BUF_CAP;
+	strtab->buf = malloc(strtab->buf_cap);
+
+	strtab->cap = INITIAL_CAP;
+	strtab->offsets = malloc(strtab->cap * sizeof *strtab->offsets);
+
+	strtab->buckets_len = INITIAL_CAP * 2;
+	strtab->buckets = malloc(strtab->buckets_len * sizeof *strtab->buckets);
+	memset(strtab->buckets, 0xff, strtab->buckets_len * sizeof *strtab->buckets); // all 'STRTAB_NONE'
+}
+
+void strtab_free(strtab_t* strtab) {
+	free(strtab->buf);
+	free(strtab->offsets);
+	free(strtab->buckets);
+}
+
+void strtab_shrink(strtab_t* strtab) {
+	strtab->buf_cap = strtab->buf_len ? strtab->buf_len : 1;
+	strtab->buf = realloc(strtab->buf, strtab->buf_cap);
+
+	strtab->cap = strtab->len ? strtab->len : 1;
+	strtab->offsets = realloc(strtab->offsets, strtab->cap * sizeof *strtab->offsets);
+}
+
+// returns the bucket either containing the string, or the empty bucket where it should go
+
+static uint32_t* find_bucket(strtab_t const* strtab, char const* str) {
+	size_t mask = strtab->buckets_len - 1;
+
+	for (size_t i = hash(str) & mask;; i = (i + 1) & mask) {
+		uint32_t* bucket = &strtab->buckets[i];
+
+		if (*bucket == STRTAB_NONE || strcmp(strtab_str(strtab, *bucket), str) == 0) {
+			return bucket;
+		}
+	}
+}
+
+uint32_t strtab_find(strtab_t const* strtab, char const* str) {
+	return *find_bucket(strtab, str);
+}
+
+static void grow_buckets(strtab_t* strtab) {
+	free(strtab->buckets);
+
+	strtab->buckets_len *= 2;
+	strtab->buckets = malloc(strtab->buckets_len * sizeof *strtab->buckets);
+	memset(strtab->buckets, 0xff, strtab->buckets_len * sizeof *strtab->buckets);
+
+	for (uint32_t id = 0; id < strtab->len; id++) {
+		*find_bucket(strtab, strtab_str(strtab, id)) = id;
+	}
+}
+
+uint32_t strtab_intern(strtab_t* strtab, char const* str) {
+	uint32_t* bucket = find_bucket(strtab, str);
+
+	if (*bucket != STRTAB_NONE) {
+		return *bucket;
+	}
+
+	// copy string over to the buffer
+	// 'str' may point into the buffer itself (it's already interned then, so we never get here in that case)
+
+	size_t size = strlen(str) + 1;
+
+	while (strtab->buf_len + size > strtab->buf_cap) {
+		strtab->buf_cap *= 2;
+		strtab->buf = realloc(strtab->buf, strtab->buf_cap);
+	}
+
+	memcpy(strtab->buf + strtab->buf_len, str, size);
+
+	// give it an ID
+
+	if (strtab->len == strtab->cap) {
+		strtab->cap *= 2;
+		strtab->offsets = realloc(strtab->offsets, strtab->cap * sizeof *strtab->offsets);
+	}
+
+	uint32_t id = strtab->len++;
+
+	strtab->offsets[id] = strtab->buf_len;
+	strtab->buf_len += size;
+
+	*bucket = id;
+
+	// keep the load factor of the hash table under 1/2
+
+	if (strtab->len * 2 > strtab->buckets_len) {
+		grow_buckets(strtab);
+	}
+
+	return id;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// table of interned strings
+// every distinct string is stored exactly once in a single contiguous buffer, and is referred to by a dense 32-bit ID
+// note that interning a new string may move the buffer, so pointers returned by 'strtab_str' are only valid until the next call to 'strtab_intern'
+
+#define STRTAB_NONE UINT32_MAX
+
+typedef struct {
+	size_t buf_len;
+	size_t buf_cap;
+	char* buf;
+
+	// maps IDs to offsets in 'buf'
+
+	size_t len;
+	size_t cap;
+	uint32_t* offsets;
+
+	// open addressing hash table of IDs (always a power of two in size, 'STRTAB_NONE' for empty buckets)
+
+	size_t buckets_len;
+	uint32_t* buckets;
+} strtab_t;
+
+void strtab_init(strtab_t* strtab);
+void strtab_free(strtab_t* strtab);
+
+void strtab_shrink(strtab_t* strtab); // release unused capacity, for once no more strings are expected to be interned
+
+uint32_t strtab_intern(strtab_t* strtab, char const* str);
+uint32_t strtab_find(strtab_t const* strtab, char const* str);
+
+static inline char const* strtab_str(strtab_t const* strtab, uint32_t id) {
+	return strtab->buf + strtab->offsets[id];
+}
@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sched.h"
+#include "table.h"
+
+int table_init(table_t* table, graph_t const* graph, uint8_t const* states) {
+	memset(table, 0, sizeof *table);
+
+	size_t services_len = graph->services_len;
+	size_t size = table_size(services_len);
+
+	// replace whatever table a previous instance of init might have left behind, rather than resize it under its readers' feet
+
+	shm_unlink(TABLE_SHM_NAME);
+	int fd = shm_open(TABLE_SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		int err = errno;
+
+		close(fd);
+		shm_unlink(TABLE_SHM_NAME);
+
+		errno = err;
+		return -1;
+	}
+
+	void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		int err = errno;
+		shm_unlink(TABLE_SHM_NAME);
+
+		errno = err;
+		return -1;
+	}
+
+	// the object starts out zeroed, so only what isn't zero needs filling in
+	// the magic number is written last, so that nothing reads a half-initialized table
+
+	table->size = size;
+	table->header = map;
+	table->entries = table_entries(map);
+
+	for (size_t i = 0; i < services_len; i++) {
+		table_entry_t* entry = &table->entries[i];
+
+		strncpy(entry->name, graph_name(graph, i), TABLE_NAME_LEN - 1);
+		entry->service.state = states[i];
+	}
+
+	table_header_t* header = table->header;
+
+	header->version = TABLE_VERSION;
+	header->entry_size = sizeof(table_entry_t);
+	header->services_len = services_len;
+	header->init_pid = getpid();
+
+	atomic_thread_fence(memory_order_release);
+	header->magic = TABLE_MAGIC;
+
+	return 0;
+}
+
+void table_free(table_t* table) {
+	if (!table->header) {
+		return;
+	}
+
+	munmap(table->header, table->size);
+	shm_unlink(TABLE_SHM_NAME);
+
+	memset(table, 0, sizeof *table);
+}
+
+// write a service's entry under its sequence lock
+
+static void publish(table_t* table, uint32_t service, table_service_t const* data) {
+	table_entry_t* entry = &table->entries[service];
+	uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&entry->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy((void*) &entry->service, data, sizeof *data);
+
+	atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+	atomic_fetch_add_explicit(&table->header->generation, 1, memory_order_release);
+}
+
+void table_started(table_t* table, uint32_t service, pid_t pid, long double start_time, uint32_t restarts) {
+	if (!table->header) {
+		return;
+	}
+
+	// we're the only writer, so our own copy of the entry is always consistent
+
+	table_service_t data = table->entries[service].service;
+
+	data.state = SERVICE_STATE_RUNNING;
+	data.pid = pid;
+	data.restarts = restarts;
+	data.start_time = start_time;
+	data.exit_time = 0;
+
+	publish(table, service, &data);
+}
+
+void table_completed(table_t* table, uint32_t service, int rv, long double exit_time) {
+	if (!table->header) {
+		return;
+	}
+
+	table_service_t data = table->entries[service].service;
+
+	data.state = rv ? SERVICE_STATE_FAILED : SERVICE_STATE_DONE;
+	data.pid = 0;
+	data.exit_code = rv;
+	data.exit_time = exit_time;
+
+	publish(table, service, &data);
+}
+
+void table_usage(table_t* table, uint32_t service, usage_t const* usage) {
+	if (!table->header) {
+		return;
+	}
+
+	table_service_t data = table->entries[service].service;
+
+	data.utime = usage->utime;
+	data.stime = usage->stime;
+	data.maxrss = usage->maxrss;
+	data.inblock = usage->inblock;
+	data.oublock = usage->oublock;
+	data.nvcsw = usage->nvcsw;
+	data.nivcsw = usage->nivcsw;
+
+	publish(table, service, &data);
+}
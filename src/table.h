@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "graph.h"
+#include "libinit/table.h"
+#include "usage.h"
+
+// publishing side of the shared-memory status table (cf. 'libinit/table.h')
+// only ever written to from the scheduler, on init's main thread, so there's only ever a single writer
+
+typedef struct {
+	size_t size;
+	table_header_t* header; // NULL if the table couldn't be created, in which case updates do nothing
+	table_entry_t* entries;
+} table_t;
+
+// create the table, with an entry for each service in 'graph', in the initial state given by 'states'
+// returns -1 and sets 'errno' if the shared memory object couldn't be created
+
+int table_init(table_t* table, graph_t const* graph, uint8_t const* states);
+void table_free(table_t* table);
+
+void table_started(table_t* table, uint32_t service, pid_t pid, long double start_time, uint32_t restarts);
+void table_completed(table_t* table, uint32_t service, int rv, long double exit_time);
+void table_usage(table_t* table, uint32_t service, usage_t const* usage);
@@ -0,0 +1,258 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_SLOT_BITS)
+#define RANGE ((uint64_t) 1 << LEVEL_SHIFT(TIMER_LEVELS)) // ticks the whole wheel spans
+
+// the same conversion must be used everywhere, so that rounding never makes 'timers_timeout' and 'timers_run' disagree on whether a tick is due
+
+static inline uint64_t to_ticks(long double time) {
+	long double ticks = time * TIMER_HZ;
+	return ticks > 0 ? (uint64_t) ticks : 0;
+}
+
+void timers_init(timers_t* timers, long double now) {
+	memset(timers, 0, sizeof *timers);
+
+	timers->tick = to_ticks(now);
+	timers->free = TIMER_NONE;
+
+	for (size_t i = 0; i < TIMER_LEVELS * TIMER_SLOTS; i++) {
+		timers->heads[i] = TIMER_NONE;
+	}
+}
+
+void timers_free(timers_t* timers) {
+	free(timers->entries);
+}
+
+// put a timer in the slot for its deadline, relative to the current tick
+
+static void link(timers_t* timers, uint32_t id) {
+	timer_entry_t* timer = &timers->entries[id];
+
+	if (timer->expires < timers->tick) {
+		timer->expires = timers->tick;
+	}
+
+	uint64_t expires = timer->expires;
+	uint64_t delta = expires - timers->tick;
+
+	size_t level = 0;
+
+	while (level < TIMER_LEVELS - 1 && delta >> LEVEL_SHIFT(level + 1)) {
+		level++;
+	}
+
+	// park timers too far out for the wheel in the last slot it can hold, they'll be put back in once it comes around
+
+	if (delta >= RANGE) {
+		expires = timers->tick + RANGE - 1;
+	}
+
+	size_t slot = expires >> LEVEL_SHIFT(level) & (TIMER_SLOTS - 1);
+	size_t index = level * TIMER_SLOTS + slot;
+
+	timer->slot = index;
+	timer->prev = TIMER_NONE;
+	timer->next = timers->heads[index];
+
+	if (timer->next != TIMER_NONE) {
+		timers->entries[timer->next].prev = id;
+	}
+
+	timers->heads[index] = id;
+	timers->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+static void unlink(timers_t* timers, uint32_t id) {
+	timer_entry_t* timer = &timers->entries[id];
+
+	if (timer->prev != TIMER_NONE) {
+		timers->entries[timer->prev].next = timer->next;
+	}
+
+	else {
+		timers->heads[timer->slot] = timer->next;
+	}
+
+	if (timer->next != TIMER_NONE) {
+		timers->entries[timer->next].prev = timer->prev;
+	}
+
+	if (timers->heads[timer->slot] == TIMER_NONE) {
+		timers->occupied[timer->slot / TIMER_SLOTS] &= ~((uint64_t) 1 << timer->slot % TIMER_SLOTS);
+	}
+}
+
+uint32_t timers_add(timers_t* timers, long double deadline, timer_func_t func, void* data, uint32_t arg) {
+	uint32_t id = timers->free;
+
+	if (id != TIMER_NONE) {
+		timers->free = timers->entries[id].next;
+	}
+
+	else {
+		if (timers->entries_len == timers->entries_cap) {
+			timers->entries_cap = timers->entries_cap ? timers->entries_cap * 2 : 16;
+			timers->entries = realloc(timers->entries, timers->entries_cap * sizeof *timers->entries);
+		}
+
+		id = timers->entries_len++;
+	}
+
+	// round the deadline up to the next tick, so that timers never run early
+
+	uint64_t expires = to_ticks(deadline);
+	expires += expires < deadline * TIMER_HZ;
+
+	timers->entries[id] = (timer_entry_t) {
+		.expires = expires,
+		.func = func,
+		.data = data,
+		.arg = arg,
+	};
+
+	link(timers, id);
+	timers->len++;
+
+	return id;
+}
+
+void timers_cancel(timers_t* timers, uint32_t id) {
+	unlink(timers, id);
+	timers->len--;
+
+	timers->entries[id].func = NULL;
+	timers->entries[id].next = timers->free;
+	timers->free = id;
+}
+
+// find the next tick at which something needs doing, i.e. running the timers in a slot of the finest wheel, or cascading a slot of a coarser one
+// a slot of wheel 'level' is processed on the first tick which is a multiple of that wheel's granularity, and whose index in that wheel is the slot's
+
+static bool next_tick(timers_t const* timers, uint64_t* next) {
+	bool found = false;
+
+	for (size_t level = 0; level < TIMER_LEVELS; level++) {
+		uint64_t occupied = timers->occupied[level];
+
+		if (!occupied) {
+			continue;
+		}
+
+		size_t shift = LEVEL_SHIFT(level);
+		uint64_t units = (timers->tick + ((uint64_t) 1 << shift) - 1) >> shift;
+		size_t base = units & (TIMER_SLOTS - 1);
+
+		// rotate the occupancy mask so that the slot for 'units' comes first
+
+		uint64_t rotated = base ? occupied >> base | occupied << (TIMER_SLOTS - base) : occupied;
+		uint64_t tick = (units + __builtin_ctzll(rotated)) << shift;
+
+		if (!found || tick < *next) {
+			*next = tick;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+int timers_timeout(timers_t const* timers, long double now) {
+	uint64_t tick;
+
+	if (!timers->len || !next_tick(timers, &tick)) {
+		return -1;
+	}
+
+	uint64_t now_ticks = to_ticks(now);
+
+	if (tick <= now_ticks) {
+		return 0;
+	}
+
+	// ticks are milliseconds, so this is just rounding up to the tick
+	// this is never less than 1 though, even if rounding says it should be, as 'timers_run' would see that the tick isn't due yet and we'd spin
+
+	long double left = tick - now * TIMER_HZ;
+
+	if (left > INT_MAX) {
+		return INT_MAX;
+	}
+
+	int ms = left;
+	ms += ms < left;
+
+	return ms < 1 ? 1 : ms;
+}
+
+// move the timers in a slot of a coarser wheel down to finer ones, now that their deadlines are close enough
+
+static void cascade(timers_t* timers, size_t level) {
+	size_t slot = timers->tick >> LEVEL_SHIFT(level) & (TIMER_SLOTS - 1);
+	size_t index = level * TIMER_SLOTS + slot;
+
+	uint32_t id = timers->heads[index];
+
+	timers->heads[index] = TIMER_NONE;
+	timers->occupied[level] &= ~((uint64_t) 1 << slot);
+
+	while (id != TIMER_NONE) {
+		uint32_t next = timers->entries[id].next;
+
+		link(timers, id);
+		id = next;
+	}
+}
+
+size_t timers_run(timers_t* timers, long double now) {
+	uint64_t target = to_ticks(now);
+	size_t ran = 0;
+
+	uint64_t tick;
+
+	while (timers->len && next_tick(timers, &tick) && tick <= target) {
+		timers->tick = tick;
+
+		// coarser wheels are cascaded as the finer ones wrap around
+		// parked timers are cascaded like any others, and just end up parked again if they're still too far out
+
+		for (size_t level = 1; level < TIMER_LEVELS; level++) {
+			if (tick & (((uint64_t) 1 << LEVEL_SHIFT(level)) - 1)) {
+				break;
+			}
+
+			cascade(timers, level);
+		}
+
+		// run what's due on this tick
+		// timers are removed before they're run, so that their callbacks are free to add new timers (which may well reuse their entries, or be due on this same tick)
+
+		size_t index = tick & (TIMER_SLOTS - 1);
+		uint32_t id;
+
+		while ((id = timers->heads[index]) != TIMER_NONE) {
+			timer_entry_t timer = timers->entries[id];
+
+			timers_cancel(timers, id);
+			timer.func(timer.data, timer.arg);
+
+			ran++;
+		}
+
+		timers->tick = tick + 1;
+	}
+
+	// nothing else is due by 'now', so skip straight to it
+
+	if (timers->tick < target) {
+		timers->tick = target;
+	}
+
+	return ran;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// central timers of init, so that things happening after a delay (e.g. restarting a crashed service, or probing its health) don't each need a thread or a timer of their own
+// the main loop sleeps until the next timer is due (cf. 'timers_timeout'), and then runs all those which are due
+//
+// timers are kept in a hierarchical timing wheel, as in the classic BSD and Linux kernel callouts: 'TIMER_LEVELS' wheels of 'TIMER_SLOTS' slots each, each wheel being 'TIMER_SLOTS' times coarser than the one below it
+// a timer goes in the slot of the finest wheel which can still hold its deadline, and is moved down ("cascaded") to finer wheels as its deadline gets closer, until it's run from the finest one
+// each slot is a doubly-linked list, so that adding and cancelling timers are both constant time, whatever the number of timers
+// which slots are occupied is kept track of as a bitmask per wheel, so that finding the next thing to do never means walking over empty slots, and an idle init doesn't wake up any more than it needs to
+//
+// the wheel ticks every millisecond, so timers may run up to a millisecond after their deadline (never before)
+// timers due further out than the coarsest wheel can hold (about 12 days) are parked in its last slot, and put back in the wheel when that slot comes around
+// timers are identified by the slot they're in, which is reused once the timer has run or been cancelled, so whoever holds on to an ID must forget it when its timer runs
+
+#define TIMER_NONE UINT32_MAX
+
+#define TIMER_HZ 1000 // ticks per second
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 5
+
+typedef void (*timer_func_t)(void* data, uint32_t arg);
+
+typedef struct {
+	uint64_t expires; // tick at which the timer is due
+	timer_func_t func;
+	void* data;
+	uint32_t arg;
+
+	// neighbours in the timer's slot, or the next free timer if this one is free
+
+	uint32_t next;
+	uint32_t prev;
+	uint16_t slot; // wheel slot the timer is in ('level * TIMER_SLOTS + slot')
+} timer_entry_t;
+
+typedef struct {
+	uint64_t tick; // next tick to be processed, all the ones before it have been
+	size_t len; // number of pending timers
+
+	size_t entries_len;
+	size_t entries_cap;
+	timer_entry_t* entries;
+	uint32_t free; // first free entry, or 'TIMER_NONE'
+
+	uint32_t heads[TIMER_LEVELS * TIMER_SLOTS]; // first timer in each slot, or 'TIMER_NONE'
+	uint64_t occupied[TIMER_LEVELS]; // bitmask of the non-empty slots of each wheel
+} timers_t;
+
+// 'now' is the current time, in seconds on 'CLOCK_MONOTONIC', from which the wheel starts ticking
+
+void timers_init(timers_t* timers, long double now);
+void timers_free(timers_t* timers);
+
+// call 'func(data, arg)' once 'deadline' (in seconds on 'CLOCK_MONOTONIC') has passed
+// returns the ID of the timer, for cancelling it
+
+uint32_t timers_add(timers_t* timers, long double deadline, timer_func_t func, void* data, uint32_t arg);
+void timers_cancel(timers_t* timers, uint32_t id);
+
+// milliseconds until the wheel next needs to be run (rounded up, and 0 if it's already due), or -1 if there are no timers, as 'poll' expects
+// this may be a bit earlier than the next timer is due, when timers need to be cascaded down to a finer wheel before then
+
+int timers_timeout(timers_t const* timers, long double now);
+
+// run all the timers due by 'now', in order of deadline (timers due on the same tick run in no particular order)
+// timers may add or cancel other timers from their callbacks
+// returns the number of timers run
+
+size_t timers_run(timers_t* timers, long double now);
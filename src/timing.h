@@ -0,0 +1,10 @@
+#pragma once
+
+#include <time.h>
+
+static inline long double __get_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long double) now.tv_sec + 1.e-9 * (long double) now.tv_nsec;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/resource.h>
+
+// resources used by processes, as reported by 'wait4' when they're reaped (cf. getrusage(2))
+// these are summed over all the processes of a service, including the ones reaped by its own processes (which 'wait4' already counts in)
+
+typedef struct {
+	double utime; // seconds of user CPU time
+	double stime; // seconds of system CPU time
+	uint64_t maxrss; // largest resident set size of any one of the processes, in kilobytes
+	uint64_t inblock; // block input operations
+	uint64_t oublock; // block output operations
+	uint64_t nvcsw; // voluntary context switches (i.e. waiting on something, mostly I/O)
+	uint64_t nivcsw; // involuntary context switches (i.e. preempted, mostly for hogging the CPU)
+} usage_t;
+
+_Static_assert(sizeof(usage_t) == 56, "usage must stay fixed-size, as it's stored as-is in the boot history");
+
+static inline void usage_add(usage_t* usage, struct rusage const* ru) {
+	usage->utime += ru->ru_utime.tv_sec + 1.e-6 * ru->ru_utime.tv_usec;
+	usage->stime += ru->ru_stime.tv_sec + 1.e-6 * ru->ru_stime.tv_usec;
+
+	if ((uint64_t) ru->ru_maxrss > usage->maxrss) {
+		usage->maxrss = ru->ru_maxrss;
+	}
+
+	usage->inblock += ru->ru_inblock;
+	usage->oublock += ru->ru_oublock;
+	usage->nvcsw += ru->ru_nvcsw;
+	usage->nivcsw += ru->ru_nivcsw;
+}